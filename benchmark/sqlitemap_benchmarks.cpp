@@ -0,0 +1,302 @@
+// sqlitemap
+// SPDX-FileCopyrightText: 2024-present Benno Waldhauer
+// SPDX-License-Identifier: MIT
+
+#include <benchmark/benchmark.h>
+#include <bw/sqlitemap/sqlitemap.hpp>
+#include <random>
+#include <vector>
+
+using namespace bw::sqlitemap;
+
+// Benchmarks of the sqlitemap core operations. All maps use a temporary database file, which is
+// removed when the map is closed. Arguments of each benchmark are given as named ranges:
+//   key_size/value_size - size in bytes of generated string keys and string or blob values
+//   auto_commit         - 1 commits every write on its own, 0 uses one transaction per run
+//   rows                - number of entries present before the measurement starts
+
+namespace {
+
+constexpr int num_prefilled_rows = 10'000;
+
+template <typename T> T make_key(int i, size_t size)
+{
+    if constexpr (std::is_same_v<T, std::string>)
+    {
+        auto key = std::to_string(i);
+        return std::string(key.size() < size ? size - key.size() : 0, 'k') + key;
+    }
+    else
+    {
+        return static_cast<T>(i);
+    }
+}
+
+template <typename T> T make_value(int i, size_t size)
+{
+    if constexpr (std::is_same_v<T, std::string>)
+    {
+        return std::string(size, static_cast<char>('a' + i % 26));
+    }
+    else if constexpr (std::is_same_v<T, blob>)
+    {
+        return blob(size, static_cast<std::byte>(i));
+    }
+    else
+    {
+        return static_cast<T>(i);
+    }
+}
+
+template <typename K, typename V> auto make_map(bool auto_commit)
+{
+    return sqlitemap(config<K, V>().auto_commit(auto_commit));
+}
+
+template <typename MAP> void prefill(MAP& sm, int rows, size_t key_size, size_t value_size)
+{
+    using K = typename MAP::key_type;
+    using V = typename MAP::mapped_type;
+
+    std::vector<std::pair<K, V>> entries;
+    entries.reserve(rows);
+    for (int i = 0; i < rows; i++)
+        entries.emplace_back(make_key<K>(i, key_size), make_value<V>(i, value_size));
+
+    sm.insert(entries.begin(), entries.end());
+    sm.commit();
+}
+
+template <typename K, typename V> size_t entry_size(size_t key_size, size_t value_size)
+{
+    size_t k = std::is_arithmetic_v<K> ? sizeof(K) : key_size;
+    size_t v = std::is_arithmetic_v<V> ? sizeof(V) : value_size;
+    return k + v;
+}
+
+template <typename K, typename V> void BM_set(benchmark::State& state)
+{
+    auto key_size = state.range(0);
+    auto value_size = state.range(1);
+    auto sm = make_map<K, V>(state.range(2) != 0);
+
+    auto value = make_value<V>(0, value_size);
+    int i = 0;
+    for (auto _ : state)
+    {
+        sm.set(make_key<K>(i++ % num_prefilled_rows, key_size), value);
+    }
+    sm.commit();
+
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * entry_size<K, V>(key_size, value_size));
+}
+
+template <typename K, typename V> void BM_try_get(benchmark::State& state)
+{
+    auto key_size = state.range(0);
+    auto value_size = state.range(1);
+    auto sm = make_map<K, V>(false);
+    prefill(sm, num_prefilled_rows, key_size, value_size);
+
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> dist(0, num_prefilled_rows - 1);
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(sm.try_get(make_key<K>(dist(gen), key_size)));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * entry_size<K, V>(key_size, value_size));
+}
+
+template <typename K, typename V> void BM_contains(benchmark::State& state)
+{
+    auto key_size = state.range(0);
+    auto sm = make_map<K, V>(false);
+    prefill(sm, num_prefilled_rows, key_size, 16);
+
+    std::mt19937 gen(42);
+    // half of the looked up keys do not exist
+    std::uniform_int_distribution<int> dist(0, 2 * num_prefilled_rows - 1);
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(sm.contains(make_key<K>(dist(gen), key_size)));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+template <typename K, typename V> void BM_del(benchmark::State& state)
+{
+    auto key_size = state.range(0);
+    auto sm = make_map<K, V>(state.range(1) != 0);
+
+    int i = 0;
+    for (auto _ : state)
+    {
+        if (i % num_prefilled_rows == 0)
+        {
+            state.PauseTiming();
+            prefill(sm, num_prefilled_rows, key_size, 16);
+            state.ResumeTiming();
+        }
+        sm.del(make_key<K>(i++ % num_prefilled_rows, key_size));
+    }
+    sm.commit();
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+template <typename K, typename V> void BM_size(benchmark::State& state)
+{
+    auto sm = make_map<K, V>(false);
+    prefill(sm, state.range(0), 16, 16);
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(sm.size());
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+template <typename K, typename V, column_option OPTION> void BM_iterate(benchmark::State& state)
+{
+    auto rows = state.range(0);
+    auto value_size = state.range(1);
+    auto sm = make_map<K, V>(false);
+    prefill(sm, rows, 16, value_size);
+
+    for (auto _ : state)
+    {
+        if constexpr (OPTION == column_option::key)
+        {
+            for (auto it = sm.keys_begin(); it != sm.keys_end(); ++it)
+                benchmark::DoNotOptimize(*it);
+        }
+        else if constexpr (OPTION == column_option::value)
+        {
+            for (auto it = sm.values_begin(); it != sm.values_end(); ++it)
+                benchmark::DoNotOptimize(*it);
+        }
+        else
+        {
+            for (const auto& entry : sm)
+                benchmark::DoNotOptimize(entry);
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * rows);
+}
+
+template <typename K, typename V> void BM_insert_range(benchmark::State& state)
+{
+    auto batch_size = state.range(0);
+    auto value_size = state.range(1);
+    auto sm = make_map<K, V>(state.range(2) != 0);
+
+    int offset = 0;
+    std::vector<std::pair<K, V>> batch;
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        batch.clear();
+        for (int i = 0; i < batch_size; i++, offset++)
+            batch.emplace_back(make_key<K>(offset, 16), make_value<V>(offset, value_size));
+        state.ResumeTiming();
+
+        sm.insert(batch.begin(), batch.end());
+    }
+    sm.commit();
+
+    state.SetItemsProcessed(state.iterations() * batch_size);
+    state.SetBytesProcessed(state.iterations() * batch_size * entry_size<K, V>(16, value_size));
+}
+
+template <typename K, typename V> void BM_erase_if(benchmark::State& state)
+{
+    auto rows = state.range(0);
+    auto sm = make_map<K, V>(false);
+
+    int i = 0;
+    auto every_second = [&i](const auto&) { return i++ % 2 == 0; };
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        prefill(sm, rows, 16, 16);
+        state.ResumeTiming();
+
+        benchmark::DoNotOptimize(sm.erase_if(every_second));
+        sm.commit();
+    }
+
+    state.SetItemsProcessed(state.iterations() * rows);
+}
+
+void write_args(benchmark::internal::Benchmark* b)
+{
+    b->ArgNames({"key_size", "value_size", "auto_commit"});
+    for (int64_t auto_commit : {0, 1})
+        for (int64_t value_size : {16, 1024, 64 * 1024})
+            b->Args({16, value_size, auto_commit});
+    b->Args({256, 16, 0});
+}
+
+// sizes of integral keys and values are fixed
+void fixed_size_write_args(benchmark::internal::Benchmark* b)
+{
+    b->ArgNames({"key_size", "value_size", "auto_commit"});
+    b->Args({0, 0, 0});
+    b->Args({0, 0, 1});
+}
+
+void read_args(benchmark::internal::Benchmark* b)
+{
+    b->ArgNames({"key_size", "value_size"});
+    for (int64_t value_size : {16, 1024, 64 * 1024})
+        b->Args({16, value_size});
+    b->Args({256, 16});
+}
+
+void iterate_args(benchmark::internal::Benchmark* b)
+{
+    b->ArgNames({"rows", "value_size"});
+    b->ArgsProduct({{1'000, 100'000}, {16, 1024}});
+    b->Unit(benchmark::kMillisecond);
+}
+
+} // namespace
+
+using str = std::string;
+
+BENCHMARK(BM_set<str, str>)->Apply(write_args);
+BENCHMARK(BM_set<int, int>)->Apply(fixed_size_write_args);
+BENCHMARK(BM_set<str, blob>)->Apply(write_args);
+
+BENCHMARK(BM_try_get<str, str>)->Apply(read_args);
+BENCHMARK(BM_try_get<int, int>)->ArgNames({"key_size", "value_size"})->Args({0, 0});
+BENCHMARK(BM_try_get<str, blob>)->Apply(read_args);
+
+BENCHMARK(BM_contains<str, str>)->ArgName("key_size")->Arg(16)->Arg(256);
+BENCHMARK(BM_contains<int, int>)->ArgName("key_size")->Arg(0);
+
+BENCHMARK(BM_del<str, str>)->ArgNames({"key_size", "auto_commit"})->Args({16, 0})->Args({16, 1});
+BENCHMARK(BM_del<int, int>)->ArgNames({"key_size", "auto_commit"})->Args({0, 0})->Args({0, 1});
+
+BENCHMARK(BM_size<str, str>)->ArgName("rows")->Arg(1'000)->Arg(100'000);
+
+BENCHMARK(BM_iterate<str, str, column_option::key>)->Apply(iterate_args);
+BENCHMARK(BM_iterate<str, str, column_option::value>)->Apply(iterate_args);
+BENCHMARK(BM_iterate<str, str, column_option::key_value>)->Apply(iterate_args);
+BENCHMARK(BM_iterate<str, blob, column_option::key_value>)->Apply(iterate_args);
+BENCHMARK(BM_iterate<int, int, column_option::key_value>)->Apply(iterate_args);
+
+BENCHMARK(BM_insert_range<str, str>)
+    ->ArgNames({"batch_size", "value_size", "auto_commit"})
+    ->ArgsProduct({{100, 10'000}, {16, 1024}, {0, 1}});
+BENCHMARK(BM_insert_range<int, int>)
+    ->ArgNames({"batch_size", "value_size", "auto_commit"})
+    ->ArgsProduct({{100, 10'000}, {0}, {0, 1}});
+
+BENCHMARK(BM_erase_if<str, str>)->ArgName("rows")->Arg(1'000)->Arg(10'000);
@@ -55,10 +55,22 @@ if %errorlevel% equ 0 (
 )
 echo Project build examples: %build_examples%
 
+echo %* | find /i "with_benchmarks" > nul
+if %errorlevel% equ 0 (
+    set "build_benchmarks=ON"
+    set "vcpkg_features=benchmarks"
+) else (
+    set "build_benchmarks=OFF"
+    set "vcpkg_features="
+)
+echo Project build benchmarks: %build_benchmarks%
+
 cmake -B "%build_dir%" -S . ^
     -DSM_BUILD_TESTS=%build_tests% ^
     -DSM_SKIP_TESTS=%skip_tests% ^
     -DSM_BUILD_EXAMPLES=%build_examples% ^
+    -DSM_BUILD_BENCHMARKS=%build_benchmarks% ^
+    -DVCPKG_MANIFEST_FEATURES="%vcpkg_features%" ^
     -DCMAKE_CXX_FLAGS="/utf-8 /EHsc" ^
     -DCMAKE_BUILD_TYPE=%build_type% ^
     -DCMAKE_TOOLCHAIN_FILE="%toolchain_file%" ^
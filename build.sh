@@ -51,6 +51,16 @@ else
 fi
 echo "project build examples: $build_examples"
 
+if [[ "${@#with_benchmarks}" = "$@" ]]
+then
+    build_benchmarks="OFF"
+    vcpkg_features=""
+else
+    build_benchmarks="ON"
+    vcpkg_features="benchmarks"
+fi
+echo "project build benchmarks: $build_benchmarks"
+
 if [[ "${@#clang}" = "$@" ]]
 then
     compiler="g++"
@@ -63,6 +73,8 @@ cmake -B build -S . \
     -D"SM_BUILD_TESTS=$build_tests" \
     -D"SM_SKIP_TESTS=$skip_tests" \
     -D"SM_BUILD_EXAMPLES=$build_examples" \
+    -D"SM_BUILD_BENCHMARKS=$build_benchmarks" \
+    -D"VCPKG_MANIFEST_FEATURES=$vcpkg_features" \
     -D"SM_ENABLE_COVERAGE=$code_coverage" \
     -D"CMAKE_BUILD_TYPE=$build_type" \
     -D"CMAKE_TOOLCHAIN_FILE=$toolchain_file" \
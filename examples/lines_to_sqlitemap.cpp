@@ -27,7 +27,8 @@ class processor
                  .filename(file)
                  .table(table)
                  .mode(sm::operation_mode::w)
-                 .auto_commit(false))
+                 .auto_commit(true)
+                 .write_behind_rows(100)) // group commit of up to 100 lines
         , line_count(0)
         , echo(echo)
     {
@@ -45,9 +46,6 @@ class processor
         std::string value = "[" + std::to_string(timestamp) + "," + processed_line + "]";
         db.set(count, value);
 
-        if (count % 100 == 0)
-            db.commit();
-
         if (echo)
             std::cout << line << std::endl;
     }
@@ -3,6 +3,7 @@
 // SPDX-License-Identifier: MIT
 
 #include <array>
+#include <limits>
 #include <bw/sqlitemap/sqlitemap.hpp>
 
 namespace sm = bw::sqlitemap;
@@ -56,10 +57,18 @@ class tiles
     using value_codec_t = sm::codecs::value_codec<value_type, sm::blob>;
     using db = sm::sqlitemap<sm::codecs::codec_pair<key_codec_t, value_codec_t>>;
 
+    // keys are stored in an order preserving encoding, i.e. sorted by zoom, col and row
+    static key_codec_t key_codec()
+    {
+        return sm::ordered_key_codec(
+            [](const tile_location& l) { return std::tie(l.zoom, l.col, l.row); },
+            [](const std::tuple<int, int, int>& t)
+            { return tile_location{std::get<0>(t), std::get<1>(t), std::get<2>(t)}; });
+    }
+
   public:
     tiles()
-        : data(sm::config(key_codec_t{to_blob<key_type>, from_blob<key_type>},
-                          value_codec_t{to_blob<value_type>, from_blob<value_type>})
+        : data(sm::config(key_codec(), value_codec_t{to_blob<value_type>, from_blob<value_type>})
                    .log_level(sm::log_level::debug))
     {
         data.set(tile_location{0, 0, 0}, tile_bitmap{1, 1, 0, 0, //
@@ -89,14 +98,17 @@ class tiles
         data.commit();
     }
 
-    void print()
+    // prints all tiles of a zoom level, which are found by a range scan over the keys
+    void print(int zoom)
     {
-        for (const auto& e : data)
+        constexpr int min = std::numeric_limits<int>::min();
+        auto [first, last] = data.range({zoom, min, min}, {zoom + 1, min, min});
+        for (auto it = first; it != last; ++it)
         {
-            std::cout << "\nzoom: " << e.first.zoom << " col:" << e.first.col
-                      << " row:" << e.first.row << "\n\n";
+            std::cout << "\nzoom: " << it->first.zoom << " col:" << it->first.col
+                      << " row:" << it->first.row << "\n\n";
 
-            e.second.print();
+            it->second.print();
 
             std::cout << std::endl;
         }
@@ -111,7 +123,8 @@ int main()
     std::cout << "sqlitemap_tiles - Demo of using blob data for storing keys and values\n\n";
 
     tiles tiles;
-    tiles.print();
+    tiles.print(0);
+    tiles.print(1);
 
     return 0;
 }
@@ -2,8 +2,7 @@
 // SPDX-FileCopyrightText: 2024-present Benno Waldhauer
 // SPDX-License-Identifier: MIT
 
-#include <bw/sqlitemap/sqlitemap.hpp>
-#include <zlib.h>
+#include <bw/sqlitemap/compression.hpp>
 
 constexpr char lorem_ipsum[] =
     "Lorem ipsum\n"
@@ -26,60 +25,30 @@ constexpr char lorem_ipsum[] =
     "vero eros et accumsan et iusto odio dignissim qui blandit praesent luptatum zzril delenit\n"
     "augue duis dolore te feugait nulla facilisi.\n";
 
-bw::sqlitemap::blob compress_doc(const std::string& input)
+int main()
 {
-    // store the original size as 4byte int before compressed payload
-
-    auto original_size = static_cast<uint32_t>(input.size());
-    auto compressed_size = compressBound(input.size());
-    bw::sqlitemap::blob compressed(sizeof(uint32_t) + compressed_size);
-    std::memcpy(compressed.data(), &original_size, sizeof(uint32_t));
-
-    int res =
-        compress(reinterpret_cast<Bytef*>(compressed.data() + sizeof(uint32_t)), &compressed_size,
-                 reinterpret_cast<const Bytef*>(input.data()), original_size);
-
-    if (res != Z_OK)
-    {
-        throw std::runtime_error("Compression failed");
-    }
+    std::cout << "sqlitemap_zlib - Example of storing zlib compressed documents in a sqlitemap\n";
 
-    compressed.resize(sizeof(uint32_t) + compressed_size);
-    return compressed;
-}
+    namespace sm = bw::sqlitemap;
 
-std::string decompress_doc(const bw::sqlitemap::blob& compressed)
-{
-    // read the original size from first 4bytes of compressed data
+    // compressor is shared with the codec, its dictionaries are kept in the same database
+    sm::compression::compressor compressor(sm::compression::algorithm::zlib);
+    compressor.level(9);
 
-    if (compressed.size() < sizeof(uint32_t))
-    {
-        throw std::runtime_error("Input too small to contain size");
-    }
+    auto vc = sm::compressed_value_codec(compressor);
+    sm::sqlitemap db(sm::config(vc).filename("documents.db"));
+    compressor.load(db);
 
-    uLongf original_size = 0;
-    std::memcpy(&original_size, compressed.data(), sizeof(uint32_t));
+    db["lorem_ipsum"] = lorem_ipsum;
 
-    std::string decompressed(original_size, '\0');
-    int res = uncompress(reinterpret_cast<Bytef*>(decompressed.data()), &original_size,
-                         reinterpret_cast<const Bytef*>(compressed.data() + sizeof(uint32_t)),
-                         compressed.size() - sizeof(uint32_t));
-    if (res != Z_OK)
+    // similar documents compress better when a dictionary was trained from samples of them
+    if (!compressor.dictionary_id())
     {
-        throw std::runtime_error("Decompression failed");
+        compressor.train_from(db);
+        compressor.save(db);
     }
 
-    return decompressed;
-}
-
-int main()
-{
-    std::cout << "sqlitemap_zlib - Example of storing zlib compressed documents in a sqlitemap\n";
-
-    auto vc = bw::sqlitemap::value_codec(compress_doc, decompress_doc);
-    bw::sqlitemap::sqlitemap db(bw::sqlitemap::config(vc).filename("documents.db"));
-
-    db["lorem_ipsum"] = lorem_ipsum;
+    db["lorem_ipsum_2"] = std::string(lorem_ipsum).substr(0, 400);
     db.commit();
 
     std::cout << "\nDocument 'lorem_ipsum'\n\n" << db["lorem_ipsum"] << "\n";
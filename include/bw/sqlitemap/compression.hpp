@@ -0,0 +1,680 @@
+// sqlitemap — Persistent Map Backed by SQLite
+// version 1.1.0
+// https://github.com/bw-hro/sqlitemap
+
+// SPDX-FileCopyrightText: 2024-present Benno Waldhauer
+// SPDX-License-Identifier: MIT
+
+// Compressing value codec for sqlitemap, requires linking zlib. Support for zstd is enabled by
+// defining SM_WITH_ZSTD and linking zstd.
+
+#pragma once
+
+#include <bw/sqlitemap/sqlitemap.hpp>
+
+#include <cstdint>
+#include <limits>
+#include <zlib.h>
+
+#ifdef SM_WITH_ZSTD
+#include <zdict.h>
+#include <zstd.h>
+#include <zstd_errors.h>
+#endif
+
+namespace bw::sqlitemap
+{
+namespace compression
+{
+
+enum class algorithm
+{
+    zlib,
+    zstd
+};
+
+inline std::string to_string(algorithm algo)
+{
+    switch (algo)
+    {
+    case algorithm::zlib:
+        return "zlib";
+    case algorithm::zstd:
+        return "zstd";
+    default:
+        return "unknown";
+    }
+}
+
+// Name of the side table which keeps the dictionaries of all tables of a database
+constexpr const char* dictionaries_table = "_sqlitemap_dictionaries";
+
+// Values smaller than this number of bytes are stored uncompressed by default
+constexpr size_t default_min_size = 64;
+
+constexpr size_t default_dictionary_size = 16 * 1024;
+constexpr size_t default_max_samples = 1000;
+
+inline int default_level(algorithm algo)
+{
+#ifdef SM_WITH_ZSTD
+    if (algo == algorithm::zstd)
+        return ZSTD_CLEVEL_DEFAULT;
+#endif
+    return algo == algorithm::zlib ? Z_DEFAULT_COMPRESSION : 0;
+}
+
+} // namespace compression
+
+namespace details
+{
+
+// Every compressed value starts with a frame header. Values stored uncompressed consist of the
+// raw frame type followed by the data. Otherwise the original size and the id of the dictionary
+// used, 0 when none, follow as 32 bit little endian integers ahead of the compressed payload.
+enum compression_frame : uint8_t
+{
+    raw_frame = 0,
+    zlib_frame = 1,
+    zstd_frame = 2
+};
+
+constexpr size_t compression_header_size = 1 + 4 + 4;
+
+inline void put_u32(std::byte* out, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+        out[i] = static_cast<std::byte>((value >> (8 * i)) & 0xff);
+}
+
+inline uint32_t get_u32(const std::byte* in)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++)
+        value |= static_cast<uint32_t>(in[i]) << (8 * i);
+    return value;
+}
+
+// Views encoded strings and blobs as bytes
+template <typename T> blob_view as_bytes(const T& data)
+{
+    return blob_view(reinterpret_cast<const std::byte*>(data.data()), data.size());
+}
+
+// Raw deflate streams without zlib header and checksum, kept per thread to avoid allocating
+// the compression state for every value
+struct zlib_deflater
+{
+    z_stream stream{};
+    int level = 0;
+    bool initialized = false;
+
+    ~zlib_deflater()
+    {
+        if (initialized)
+            deflateEnd(&stream);
+    }
+
+    z_stream& reset(int new_level)
+    {
+        if (initialized && level == new_level)
+        {
+            deflateReset(&stream);
+            return stream;
+        }
+
+        if (initialized)
+            deflateEnd(&stream);
+
+        initialized = deflateInit2(&stream, new_level, Z_DEFLATED, -MAX_WBITS, 8,
+                                   Z_DEFAULT_STRATEGY) == Z_OK;
+        if (!initialized)
+            throw sqlitemap_error("Failed to initialize zlib compression");
+
+        level = new_level;
+        return stream;
+    }
+};
+
+struct zlib_inflater
+{
+    z_stream stream{};
+    bool initialized = false;
+
+    ~zlib_inflater()
+    {
+        if (initialized)
+            inflateEnd(&stream);
+    }
+
+    z_stream& reset()
+    {
+        if (initialized)
+        {
+            inflateReset(&stream);
+            return stream;
+        }
+
+        initialized = inflateInit2(&stream, -MAX_WBITS) == Z_OK;
+        if (!initialized)
+            throw sqlitemap_error("Failed to initialize zlib decompression");
+
+        return stream;
+    }
+};
+
+// Compresses input into out, returns 0 when the result does not fit into capacity bytes
+inline size_t zlib_compress(blob_view input, blob_view dict, int level, std::byte* out,
+                            size_t capacity)
+{
+    thread_local zlib_deflater deflater;
+    auto& stream = deflater.reset(level);
+
+    if (!dict.empty() &&
+        deflateSetDictionary(&stream, reinterpret_cast<const Bytef*>(dict.data()),
+                             static_cast<uInt>(dict.size())) != Z_OK)
+        throw sqlitemap_error("Failed to set zlib dictionary");
+
+    stream.next_in = const_cast<Bytef*>(reinterpret_cast<const Bytef*>(input.data()));
+    stream.avail_in = static_cast<uInt>(input.size());
+    stream.next_out = reinterpret_cast<Bytef*>(out);
+    stream.avail_out = static_cast<uInt>(capacity);
+
+    int rc = deflate(&stream, Z_FINISH);
+    if (rc == Z_STREAM_END)
+        return capacity - stream.avail_out;
+
+    if (rc == Z_OK || rc == Z_BUF_ERROR)
+        return 0;
+
+    throw sqlitemap_error("zlib compression failed with code " + std::to_string(rc));
+}
+
+inline void zlib_decompress(blob_view payload, blob_view dict, std::byte* out, size_t size)
+{
+    thread_local zlib_inflater inflater;
+    auto& stream = inflater.reset();
+
+    // raw inflate streams accept the dictionary upfront
+    if (!dict.empty() &&
+        inflateSetDictionary(&stream, reinterpret_cast<const Bytef*>(dict.data()),
+                             static_cast<uInt>(dict.size())) != Z_OK)
+        throw sqlitemap_error("Failed to set zlib dictionary");
+
+    stream.next_in = const_cast<Bytef*>(reinterpret_cast<const Bytef*>(payload.data()));
+    stream.avail_in = static_cast<uInt>(payload.size());
+    stream.next_out = reinterpret_cast<Bytef*>(out);
+    stream.avail_out = static_cast<uInt>(size);
+
+    int rc = inflate(&stream, Z_FINISH);
+    if (rc != Z_STREAM_END || stream.avail_out != 0)
+        throw sqlitemap_error("zlib decompression failed with code " + std::to_string(rc));
+}
+
+#ifdef SM_WITH_ZSTD
+
+inline size_t zstd_compress(blob_view input, const ZSTD_CDict* dict, int level, std::byte* out,
+                            size_t capacity)
+{
+    thread_local std::unique_ptr<ZSTD_CCtx, decltype(&ZSTD_freeCCtx)> ctx(ZSTD_createCCtx(),
+                                                                         &ZSTD_freeCCtx);
+    size_t n = dict ? ZSTD_compress_usingCDict(ctx.get(), out, capacity, input.data(),
+                                               input.size(), dict)
+                    : ZSTD_compressCCtx(ctx.get(), out, capacity, input.data(), input.size(),
+                                        level);
+    if (!ZSTD_isError(n))
+        return n;
+
+    if (ZSTD_getErrorCode(n) == ZSTD_error_dstSize_tooSmall)
+        return 0;
+
+    throw sqlitemap_error(std::string("zstd compression failed: ") + ZSTD_getErrorName(n));
+}
+
+inline void zstd_decompress(blob_view payload, const ZSTD_DDict* dict, std::byte* out,
+                            size_t size)
+{
+    thread_local std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> ctx(ZSTD_createDCtx(),
+                                                                         &ZSTD_freeDCtx);
+    size_t n = dict ? ZSTD_decompress_usingDDict(ctx.get(), out, size, payload.data(),
+                                                 payload.size(), dict)
+                    : ZSTD_decompressDCtx(ctx.get(), out, size, payload.data(), payload.size());
+    if (ZSTD_isError(n) || n != size)
+        throw sqlitemap_error(std::string("zstd decompression failed: ") +
+                              (ZSTD_isError(n) ? ZSTD_getErrorName(n) : "size mismatch"));
+}
+
+#endif
+
+} // namespace details
+
+namespace compression
+{
+
+/**
+ * @class compressor
+ * @brief Compresses encoded values, optionally using a trained dictionary.
+ *
+ * Small and repetitive values, e.g. JSON documents, compress poorly on their own. A dictionary
+ * trained from sample values provides their common content upfront, which improves the ratio
+ * considerably. Dictionaries are identified by ids stored with each compressed value, so values
+ * compressed with former dictionaries remain readable as long as those are loaded as well.
+ * Dictionaries can be saved to and loaded from a side table of the database of a sqlitemap.
+ *
+ * Values smaller than min_size, or which do not get smaller, are stored uncompressed.
+ *
+ * Copies of a compressor share settings and dictionaries, so a compressor can still be used
+ * to train or load dictionaries after a value codec was created from it. All operations are
+ * thread-safe.
+ */
+class compressor
+{
+  public:
+    compressor(algorithm algo = algorithm::zlib)
+        : _state(std::make_shared<state>())
+    {
+#ifndef SM_WITH_ZSTD
+        if (algo == algorithm::zstd)
+            throw sqlitemap_error("zstd compression requires SM_WITH_ZSTD to be defined");
+#endif
+        _state->algo = algo;
+        _state->level = default_level(algo);
+    }
+
+    algorithm algo() const
+    {
+        return _state->algo;
+    }
+
+    int level() const
+    {
+        std::lock_guard lock(_state->mutex);
+        return _state->level;
+    }
+
+    compressor& level(int level)
+    {
+        std::lock_guard lock(_state->mutex);
+        _state->level = level;
+        if (_state->current)
+            _state->current = prepare(_state->current->id, _state->current->data);
+        return *this;
+    }
+
+    size_t min_size() const
+    {
+        std::lock_guard lock(_state->mutex);
+        return _state->min_size;
+    }
+
+    compressor& min_size(size_t min_size)
+    {
+        std::lock_guard lock(_state->mutex);
+        _state->min_size = min_size;
+        return *this;
+    }
+
+    // id of the dictionary used for compression, if any
+    std::optional<uint32_t> dictionary_id() const
+    {
+        std::lock_guard lock(_state->mutex);
+        if (!_state->current)
+            return std::nullopt;
+        return _state->current->id;
+    }
+
+    size_t num_dictionaries() const
+    {
+        std::lock_guard lock(_state->mutex);
+        return _state->dictionaries.size();
+    }
+
+    // Adds a dictionary and uses it for compression from now on, returns its id
+    uint32_t add_dictionary(blob data)
+    {
+        std::lock_guard lock(_state->mutex);
+        uint32_t id = _state->dictionaries.empty() ? 1 : _state->dictionaries.rbegin()->first + 1;
+        use_dictionary(id, std::move(data));
+        return id;
+    }
+
+    // Trains a dictionary of up to max_size bytes from samples of encoded values, e.g. strings
+    // or blobs, adds it and returns its id. zlib has no trainer, its dictionary consists of the
+    // content of the samples, preferring later ones.
+    template <typename SAMPLES>
+    uint32_t train(const SAMPLES& samples, size_t max_size = default_dictionary_size)
+    {
+        blob content;
+        std::vector<size_t> sizes;
+        for (const auto& sample : samples)
+        {
+            auto bytes = details::as_bytes(sample);
+            content.insert(content.end(), bytes.begin(), bytes.end());
+            sizes.push_back(bytes.size());
+        }
+
+        if (content.empty())
+            throw sqlitemap_error("Training a dictionary requires samples");
+
+        blob dictionary;
+#ifdef SM_WITH_ZSTD
+        if (algo() == algorithm::zstd)
+        {
+            dictionary.resize(max_size);
+            size_t n = ZDICT_trainFromBuffer(dictionary.data(), dictionary.size(), content.data(),
+                                             sizes.data(), static_cast<unsigned>(sizes.size()));
+            if (ZDICT_isError(n))
+                throw sqlitemap_error(std::string("Failed to train zstd dictionary: ") +
+                                      ZDICT_getErrorName(n));
+            dictionary.resize(n);
+        }
+#endif
+        if (algo() == algorithm::zlib)
+        {
+            // zlib refers back at most 32 KiB, the end of the dictionary is used first
+            auto size = std::min({max_size, content.size(), size_t(1) << MAX_WBITS});
+            dictionary.assign(content.end() - size, content.end());
+        }
+
+        return add_dictionary(std::move(dictionary));
+    }
+
+    // Trains a dictionary from up to max_samples values randomly picked from sm, which has to use
+    // a value codec of this compressor
+    template <typename MAP>
+    uint32_t train_from(MAP& sm, size_t max_samples = default_max_samples,
+                        size_t max_size = default_dictionary_size)
+    {
+        sm.flush();
+        auto db = sm.get_connection();
+        sqlite3_stmt* raw_stmt = nullptr;
+        details::prepare_checked(db, sm.sql("SELECT value FROM :table ORDER BY random() LIMIT ?"),
+                                 &raw_stmt);
+        std::unique_ptr<sqlite3_stmt, decltype(&sqlite3_finalize)> stmt(raw_stmt,
+                                                                        &sqlite3_finalize);
+        details::bind_param_checked(stmt.get(), 1, static_cast<sqlite3_int64>(max_samples),
+                                    "Failed to bind limit", db);
+
+        std::vector<blob> samples;
+        int rc = SQLITE_ROW;
+        while ((rc = sqlite3_step(stmt.get())) == SQLITE_ROW)
+            samples.push_back(decompress(details::column_view<blob>(stmt.get(), 0)));
+
+        details::check_done(rc, "Failed to read samples", db);
+        return train(samples, max_size);
+    }
+
+    // Saves all dictionaries to the side table of the database of sm. Changes are part of the
+    // current transaction of sm, if any.
+    template <typename MAP> void save(MAP& sm) const
+    {
+        if (sm.is_read_only())
+            throw sqlitemap_error("Refusing to save dictionaries to read-only sqlitemap");
+
+        auto db = sm.get_connection();
+        auto table = std::string(dictionaries_table);
+        details::exec_checked(db, "CREATE TABLE IF NOT EXISTS " + table +
+                                      " (table_name TEXT NOT NULL, id INTEGER NOT NULL, "
+                                      "data BLOB NOT NULL, PRIMARY KEY (table_name, id))");
+
+        sqlite3_stmt* raw_stmt = nullptr;
+        details::prepare_checked(db, "REPLACE INTO " + table + " VALUES (?, ?, ?)", &raw_stmt);
+        std::unique_ptr<sqlite3_stmt, decltype(&sqlite3_finalize)> stmt(raw_stmt,
+                                                                        &sqlite3_finalize);
+
+        std::lock_guard lock(_state->mutex);
+        for (const auto& [id, dictionary] : _state->dictionaries)
+        {
+            details::bind_param_checked(stmt.get(), 1, sm.config().table(), "", db);
+            details::bind_param_checked(stmt.get(), 2, static_cast<sqlite3_int64>(id), "", db);
+            details::bind_param_checked(stmt.get(), 3, blob_view(dictionary->data), "", db,
+                                        SQLITE_STATIC);
+            details::check_done(sqlite3_step(stmt.get()), "Failed to save dictionary", db);
+            sqlite3_reset(stmt.get());
+            sqlite3_clear_bindings(stmt.get());
+        }
+    }
+
+    // Loads all dictionaries saved for the table of sm, the latest one is used for compression.
+    // Returns the number of loaded dictionaries.
+    template <typename MAP> size_t load(const MAP& sm)
+    {
+        auto db = sm.get_connection();
+        auto table = std::string(dictionaries_table);
+
+        bool exists = false;
+        auto exists_callback = [](void* exists_ptr, int argc, char** argv, char** col_name)
+        {
+            *static_cast<bool*>(exists_ptr) = true;
+            return 0;
+        };
+        details::exec_checked(db,
+                              "SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = " +
+                                  details::quote_literal(table),
+                              exists_callback, &exists);
+        if (!exists)
+            return 0; // no dictionaries saved to this database yet
+
+        sqlite3_stmt* raw_stmt = nullptr;
+        details::prepare_checked(
+            db, "SELECT id, data FROM " + table + " WHERE table_name = ? ORDER BY id", &raw_stmt);
+        std::unique_ptr<sqlite3_stmt, decltype(&sqlite3_finalize)> stmt(raw_stmt,
+                                                                        &sqlite3_finalize);
+
+        int rc = SQLITE_OK;
+        details::bind_param_checked(stmt.get(), 1, sm.config().table(), "", db);
+
+        size_t num_loaded = 0;
+        std::lock_guard lock(_state->mutex);
+        while ((rc = sqlite3_step(stmt.get())) == SQLITE_ROW)
+        {
+            auto id = static_cast<uint32_t>(details::column_value<sqlite3_int64>(stmt.get(), 0));
+            use_dictionary(id, details::column_value<blob>(stmt.get(), 1));
+            num_loaded++;
+        }
+
+        details::check_done(rc, "Failed to load dictionaries", db);
+        return num_loaded;
+    }
+
+    // Compresses data into a frame, cf. details::compression_frame
+    blob compress(blob_view data) const
+    {
+        auto [level, min_size, dictionary] = settings();
+
+        blob frame;
+        if (data.size() >= min_size && data.size() > details::compression_header_size &&
+            data.size() <= std::numeric_limits<uint32_t>::max())
+        {
+            // compressed frame has to be smaller than the raw frame to be worth it
+            frame.resize(data.size() + 1);
+            auto payload = frame.data() + details::compression_header_size;
+            auto capacity = frame.size() - details::compression_header_size;
+            size_t n = 0;
+
+            if (algo() == algorithm::zlib)
+            {
+                blob_view dict = dictionary ? blob_view(dictionary->data) : blob_view();
+                n = details::zlib_compress(data, dict, level, payload, capacity);
+            }
+#ifdef SM_WITH_ZSTD
+            else if (algo() == algorithm::zstd)
+            {
+                auto dict = dictionary ? dictionary->cdict.get() : nullptr;
+                n = details::zstd_compress(data, dict, level, payload, capacity);
+            }
+#endif
+
+            if (n > 0)
+            {
+                auto type = algo() == algorithm::zlib ? details::zlib_frame : details::zstd_frame;
+                frame[0] = static_cast<std::byte>(type);
+                details::put_u32(frame.data() + 1, static_cast<uint32_t>(data.size()));
+                details::put_u32(frame.data() + 5, dictionary ? dictionary->id : 0);
+                frame.resize(details::compression_header_size + n);
+                return frame;
+            }
+        }
+
+        frame.resize(data.size() + 1);
+        frame[0] = static_cast<std::byte>(details::raw_frame);
+        if (!data.empty())
+            std::memcpy(frame.data() + 1, data.data(), data.size());
+        return frame;
+    }
+
+    // Decompresses a frame into std::string or blob, regardless of the algorithm used
+    template <typename T = blob> T decompress(blob_view frame) const
+    {
+        static_assert(std::is_same_v<T, std::string> || std::is_same_v<T, blob>,
+                      "Values can only be decompressed into std::string or blob");
+
+        if (frame.empty())
+            throw sqlitemap_error("Compressed value lacks frame header");
+
+        T output;
+        auto type = static_cast<uint8_t>(frame[0]);
+        if (type == details::raw_frame)
+        {
+            output.resize(frame.size() - 1);
+            if (!output.empty())
+                std::memcpy(output.data(), frame.data() + 1, output.size());
+            return output;
+        }
+
+        if (frame.size() < details::compression_header_size)
+            throw sqlitemap_error("Compressed value has truncated frame header");
+
+        output.resize(details::get_u32(frame.data() + 1));
+        auto dictionary = find_dictionary(details::get_u32(frame.data() + 5));
+        auto out = reinterpret_cast<std::byte*>(output.data());
+        blob_view payload(frame.data() + details::compression_header_size,
+                          frame.size() - details::compression_header_size);
+
+        if (type == details::zlib_frame)
+        {
+            blob_view dict = dictionary ? blob_view(dictionary->data) : blob_view();
+            details::zlib_decompress(payload, dict, out, output.size());
+        }
+        else if (type == details::zstd_frame)
+        {
+#ifdef SM_WITH_ZSTD
+            auto dict = dictionary ? dictionary->ddict.get() : nullptr;
+            details::zstd_decompress(payload, dict, out, output.size());
+#else
+            throw sqlitemap_error("Decompressing zstd values requires SM_WITH_ZSTD to be defined");
+#endif
+        }
+        else
+        {
+            throw sqlitemap_error("Unknown compression frame type " + std::to_string(type));
+        }
+
+        return output;
+    }
+
+  private:
+    struct dictionary
+    {
+        uint32_t id;
+        blob data;
+#ifdef SM_WITH_ZSTD
+        std::shared_ptr<ZSTD_CDict> cdict;
+        std::shared_ptr<ZSTD_DDict> ddict;
+#endif
+    };
+
+    struct state
+    {
+        mutable std::mutex mutex;
+        algorithm algo = algorithm::zlib;
+        int level = 0;
+        size_t min_size = default_min_size;
+        std::map<uint32_t, std::shared_ptr<const dictionary>> dictionaries;
+        std::shared_ptr<const dictionary> current;
+    };
+
+    struct compression_settings
+    {
+        int level;
+        size_t min_size;
+        std::shared_ptr<const dictionary> current;
+    };
+
+    compression_settings settings() const
+    {
+        std::lock_guard lock(_state->mutex);
+        return {_state->level, _state->min_size, _state->current};
+    }
+
+    std::shared_ptr<const dictionary> find_dictionary(uint32_t id) const
+    {
+        if (id == 0)
+            return nullptr;
+
+        std::lock_guard lock(_state->mutex);
+        auto found = _state->dictionaries.find(id);
+        if (found == _state->dictionaries.end())
+            throw sqlitemap_error("Unknown compression dictionary " + std::to_string(id));
+        return found->second;
+    }
+
+    // requires lock of state mutex
+    std::shared_ptr<const dictionary> prepare(uint32_t id, blob data) const
+    {
+        auto dict = std::make_shared<dictionary>();
+        dict->id = id;
+        dict->data = std::move(data);
+#ifdef SM_WITH_ZSTD
+        if (_state->algo == algorithm::zstd)
+        {
+            dict->cdict.reset(
+                ZSTD_createCDict(dict->data.data(), dict->data.size(), _state->level),
+                &ZSTD_freeCDict);
+            dict->ddict.reset(ZSTD_createDDict(dict->data.data(), dict->data.size()),
+                              &ZSTD_freeDDict);
+            if (!dict->cdict || !dict->ddict)
+                throw sqlitemap_error("Failed to prepare zstd dictionary");
+        }
+#endif
+        return dict;
+    }
+
+    // requires lock of state mutex
+    void use_dictionary(uint32_t id, blob data)
+    {
+        auto dict = prepare(id, std::move(data));
+        _state->dictionaries[id] = dict;
+        _state->current = _state->dictionaries.rbegin()->second;
+    }
+
+    std::shared_ptr<state> _state;
+};
+
+} // namespace compression
+
+// Wraps an inner value codec and compresses its encoded strings or blobs, values are stored as
+// blobs. Uses std::string values by default.
+template <typename VC = decltype(value_codec<std::string>())>
+auto compressed_value_codec(compression::compressor compressor,
+                            VC inner = value_codec<std::string>())
+{
+    static_assert(codecs::is_value_codec<std::decay_t<VC>>::value,
+                  "VC must be a specialization of value_codec<IN_T, OUT_T>");
+
+    using in_type = typename VC::in_type;
+    using out_type = typename VC::out_type;
+    static_assert(std::is_same_v<out_type, std::string> || std::is_same_v<out_type, blob>,
+                  "Inner value codec has to encode values as std::string or blob");
+
+    return value_codec(
+        [compressor, inner](const in_type& value) -> blob
+        {
+            decltype(auto) encoded = inner.encode(value);
+            return compressor.compress(details::as_bytes(encoded));
+        },
+        [compressor, inner](const blob& compressed) -> in_type
+        { return inner.decode(compressor.decompress<out_type>(compressed)); });
+}
+
+} // namespace bw::sqlitemap
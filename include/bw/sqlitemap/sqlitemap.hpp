@@ -7,18 +7,41 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <cstddef>
+#include <cstdint>
+#include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <filesystem>
 #include <functional>
+#include <future>
 #include <iostream>
+#include <limits>
+#include <list>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <optional>
 #include <random>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#if __cplusplus >= 202002L && __has_include(<span>)
+#include <span>
+#endif
+
+#if __cplusplus >= 202002L && __has_include(<coroutine>)
+#include <coroutine>
+#endif
 
 #include <sqlite3.h>
 
@@ -27,6 +50,66 @@ namespace bw::sqlitemap
 
 using blob = std::vector<std::byte>;
 
+// Non-owning view on blob data, e.g. a blob column of the current row of a statement
+class blob_view
+{
+  public:
+    blob_view() = default;
+
+    blob_view(const std::byte* data, size_t size)
+        : _data(data)
+        , _size(size)
+    {
+    }
+
+    blob_view(const blob& data)
+        : _data(data.data())
+        , _size(data.size())
+    {
+    }
+
+    const std::byte* data() const
+    {
+        return _data;
+    }
+
+    size_t size() const
+    {
+        return _size;
+    }
+
+    bool empty() const
+    {
+        return _size == 0;
+    }
+
+    const std::byte* begin() const
+    {
+        return _data;
+    }
+
+    const std::byte* end() const
+    {
+        return _data + _size;
+    }
+
+    const std::byte& operator[](size_t index) const
+    {
+        return _data[index];
+    }
+
+#ifdef __cpp_lib_span
+    operator std::span<const std::byte>() const
+    {
+        return {_data, _size};
+    }
+#endif
+
+  private:
+    const std::byte* _data = nullptr;
+    size_t _size = 0;
+};
+
 namespace codecs
 {
 
@@ -243,7 +326,7 @@ template <typename T> T column_value(sqlite3_stmt* stmt, int index)
     {
         const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, index));
         if (text)
-            return std::string(text);
+            return std::string(text, static_cast<size_t>(sqlite3_column_bytes(stmt, index)));
         else
             return "";
     }
@@ -285,11 +368,71 @@ template <typename T> T column_value(sqlite3_stmt* stmt, int index)
     }
 }
 
-template <typename T> int bind_param(sqlite3_stmt* stmt, int index, const T& value)
+// View type handed out for a column of type T: std::string_view for text, blob_view for blobs and
+// the value itself for numeric types
+template <typename T> struct column_view_type
+{
+    using type = T;
+};
+
+template <> struct column_view_type<std::string>
+{
+    using type = std::string_view;
+};
+
+template <> struct column_view_type<blob>
+{
+    using type = blob_view;
+};
+
+template <typename T> using column_view_t = typename column_view_type<T>::type;
+
+// Borrows the column value of the current row without copying it. The view is only valid until
+// the statement is stepped, reset or finalized.
+template <typename T> column_view_t<T> column_view(sqlite3_stmt* stmt, int index)
 {
     if constexpr (std::is_same_v<T, std::string>)
     {
-        return sqlite3_bind_text(stmt, index, value.c_str(), -1, SQLITE_TRANSIENT);
+        const unsigned char* text = sqlite3_column_text(stmt, index);
+        if (!text)
+            return {};
+
+        auto num_bytes = static_cast<size_t>(sqlite3_column_bytes(stmt, index));
+        return std::string_view(reinterpret_cast<const char*>(text), num_bytes);
+    }
+    else if constexpr (std::is_same_v<T, blob>)
+    {
+        const void* data = sqlite3_column_blob(stmt, index);
+        if (!data)
+            return {};
+
+        auto num_bytes = static_cast<size_t>(sqlite3_column_bytes(stmt, index));
+        return blob_view(static_cast<const std::byte*>(data), num_bytes);
+    }
+    else
+    {
+        return column_value<T>(stmt, index);
+    }
+}
+
+// Borrows a value kept in memory in the same form column_view hands it out
+template <typename T> column_view_t<T> as_view(const T& value)
+{
+    return column_view_t<T>(value);
+}
+
+// Binds value to the parameter at index. Text and blob values are copied by SQLite unless
+// SQLITE_STATIC is passed as destructor, which requires the value to outlive its binding, i.e.
+// until the parameter is bound again, the bindings are cleared or the statement is finalized.
+template <typename T>
+int bind_param(sqlite3_stmt* stmt, int index, const T& value,
+               sqlite3_destructor_type destructor = SQLITE_TRANSIENT)
+{
+    if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>)
+    {
+        // sqlite binds NULL for a null pointer, which empty views may have
+        auto data = value.data() ? value.data() : "";
+        return sqlite3_bind_text64(stmt, index, data, value.size(), destructor, SQLITE_UTF8);
     }
     else if constexpr (std::is_integral_v<T>)
     {
@@ -306,10 +449,18 @@ template <typename T> int bind_param(sqlite3_stmt* stmt, int index, const T& val
     {
         return sqlite3_bind_double(stmt, index, static_cast<double>(value));
     }
-    else if constexpr (std::is_same_v<T, blob>)
+    else if constexpr (std::is_same_v<T, blob> || std::is_same_v<T, blob_view>)
+    {
+        auto data = value.data() ? static_cast<const void*>(value.data()) : "";
+        return sqlite3_bind_blob64(stmt, index, data, value.size(), destructor);
+    }
+#ifdef __cpp_lib_span
+    else if constexpr (std::is_same_v<T, std::span<const std::byte>>)
     {
-        return sqlite3_bind_blob(stmt, index, value.data(), value.size(), SQLITE_TRANSIENT);
+        auto data = value.data() ? static_cast<const void*>(value.data()) : "";
+        return sqlite3_bind_blob64(stmt, index, data, value.size(), destructor);
     }
+#endif
     else if constexpr (std::is_same_v<T, std::nullptr_t>)
     {
         return sqlite3_bind_null(stmt, index);
@@ -319,16 +470,18 @@ template <typename T> int bind_param(sqlite3_stmt* stmt, int index, const T& val
         // compile time error for not supported types
         static_assert(has_native_sqlite_support<T>(),
                       "Unsupported type for sqlite3_bind. Supported types are std::string, "
-                      "integral types, floating-point types, and std::nullptr_t.");
+                      "std::string_view, blob, blob_view, std::span<const std::byte>, integral "
+                      "types, floating-point types, and std::nullptr_t.");
         return SQLITE_ERROR; // should never be reached
     }
 }
 
 template <typename T>
 int bind_param_checked(sqlite3_stmt* stmt, int index, const T& value,
-                       const std::string& message = "", sqlite3* db = nullptr)
+                       const std::string& message = "", sqlite3* db = nullptr,
+                       sqlite3_destructor_type destructor = SQLITE_TRANSIENT)
 {
-    int rc = bind_param(stmt, index, value);
+    int rc = bind_param(stmt, index, value, destructor);
     check_ok(rc, message, db);
     return rc;
 }
@@ -349,1916 +502,5152 @@ inline int exec_checked(sqlite3* db, const std::string& sql,
     return rc;
 }
 
-// Base template for function traits
-template <typename Func> struct function_traits;
-
-// Specialization for function pointers
-template <typename R, typename Arg> struct function_traits<R (*)(Arg)>
-{
-    using return_type = R;
-    using argument_type = Arg;
-};
-
-// Specialization for lambdas and functors
-template <typename F> struct function_traits : function_traits<decltype(&F::operator())>
+// Reads the current value of a pragma, returns std::nullopt if the pragma yields no value
+inline std::optional<std::string> pragma_value(sqlite3* db, const std::string& flag)
 {
-};
+    std::optional<std::string> value;
+    auto callback = [](void* result, int argc, char** argv, char** col_name)
+    {
+        if (argc > 0 && argv[0])
+            *static_cast<std::optional<std::string>*>(result) = argv[0];
+        return 0;
+    };
+    exec_checked(db, "PRAGMA " + flag, callback, &value);
+    return value;
+}
 
-// Specialization for lambdas with const operator()
-template <typename R, typename C, typename Arg> struct function_traits<R (C::*)(Arg) const>
+struct statement_stats
 {
-    using return_type = R;
-    using argument_type = Arg;
+    std::string shape;           // Unformatted sql template, e.g. "SELECT value FROM :table ..."
+    uint64_t runs = 0;           // Number of completed or reset executions
+    uint64_t vm_steps = 0;       // Virtual machine operations, a measure of the work done
+    uint64_t fullscan_steps = 0; // Forward steps of full table scans, indicating missing indexes
+    uint64_t sorts = 0;          // Sort operations, which need the sorter
+    uint64_t autoindexes = 0;    // Rows inserted into automatic indexes
+    uint64_t reprepares = 0;     // Automatic re-preparations, e.g. after schema changes
 };
 
-// Ensure specialization for non-const lambdas
-template <typename R, typename C, typename Arg> struct function_traits<R (C::*)(Arg)>
+/**
+ * @class statement_cache
+ * @brief Keeps prepared statements of a single connection for reuse.
+ *
+ * Statements are looked up by their shape, i.e. the unformatted sql template like
+ * "SELECT value FROM :table WHERE key = ?". A statement is handed out exclusively via a
+ * statement_cache::handle, so concurrent callers never share a statement. When the handle goes
+ * out of scope the statement is reset, its bindings are cleared and it is kept for the next
+ * caller as long as the cache capacity is not exceeded, otherwise it gets finalized.
+ *
+ * A capacity of 0 disables caching, so every statement is prepared and finalized on each use.
+ * On release the counters of sqlite3_stmt_status are added to the statistics of the shape and
+ * reset, so statistics of a shape survive its statements being finalized.
+ */
+class statement_cache
 {
-    using return_type = R;
-    using argument_type = Arg;
-};
+  public:
+    class handle
+    {
+      public:
+        handle(statement_cache* cache, std::string_view shape, sqlite3_stmt* stmt,
+               size_t generation)
+            : _cache(cache)
+            , _shape(shape)
+            , _stmt(stmt)
+            , _generation(generation)
+        {
+        }
 
-// Generates a unique name for the temporary sqlite database.
-static std::string generate_temp_filename()
-{
-    using namespace std::chrono;
+        handle(const handle&) = delete;
+        handle& operator=(const handle&) = delete;
 
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> dist(10000, 99999);
-    int random_number = dist(gen);
+        handle(handle&& other) noexcept
+            : _cache(other._cache)
+            , _shape(other._shape)
+            , _stmt(std::exchange(other._stmt, nullptr))
+            , _generation(other._generation)
+        {
+        }
 
-    auto now = system_clock::now();
-    auto timestamp = duration_cast<milliseconds>(now.time_since_epoch()).count();
+        ~handle()
+        {
+            if (_stmt)
+                _cache->release(_shape, _stmt, _generation);
+        }
 
-    std::string prefix = "sqlitemap";
-    std::string ts = std::to_string(timestamp);
-    std::string rn = std::to_string(random_number);
-    return prefix + "_" + ts + "_" + rn;
-}
+        sqlite3_stmt* get() const
+        {
+            return _stmt;
+        }
 
-} // namespace details
+      private:
+        statement_cache* _cache;
+        std::string_view _shape;
+        sqlite3_stmt* _stmt;
+        size_t _generation;
+    };
 
-namespace codecs
-{
+    explicit statement_cache(size_t capacity)
+        : _capacity(capacity)
+    {
+    }
 
-enum class sqlite_storage_class
-{
-    INTEGER,
-    REAL,
-    TEXT,
-    BLOB
-};
+    statement_cache(const statement_cache&) = delete;
+    statement_cache& operator=(const statement_cache&) = delete;
 
-template <typename T> constexpr sqlite_storage_class sqlite_storage_class_from_type()
-{
-    if constexpr (std::is_integral_v<T>)
+    ~statement_cache()
     {
-        return sqlite_storage_class::INTEGER;
+        clear();
     }
-    else if constexpr (std::is_floating_point_v<T>)
+
+    // Returns a statement for the given shape. When no idle statement is available a new one is
+    // prepared from the sql text provided by make_sql.
+    template <typename MakeSql>
+    handle acquire(sqlite3* db, std::string_view shape, MakeSql&& make_sql)
     {
-        return sqlite_storage_class::REAL;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _shapes.find(shape);
+            if (it != _shapes.end() && !it->second.idle.empty())
+            {
+                sqlite3_stmt* stmt = it->second.idle.back();
+                it->second.idle.pop_back();
+                _num_idle--;
+                return handle(this, it->first, stmt, _generation);
+            }
+        }
+
+        sqlite3_stmt* stmt = nullptr;
+        prepare_checked(db, make_sql(), &stmt);
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _shapes.try_emplace(std::string(shape)).first;
+        it->second.stats.shape = it->first;
+        return handle(this, it->first, stmt, _generation);
     }
-    else if constexpr (std::is_same_v<T, std::string>)
+
+    // Finalizes all idle statements. Must be called before the connection gets closed.
+    // Statements still in use will be finalized on release instead of being kept.
+    void clear()
     {
-        return sqlite_storage_class::TEXT;
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (auto& [shape, entry] : _shapes)
+        {
+            for (auto stmt : entry.idle)
+                sqlite3_finalize(stmt);
+            entry.idle.clear();
+        }
+        _num_idle = 0;
+        _generation++;
     }
-    else if constexpr (std::is_same_v<T, const char*>)
+
+    size_t capacity() const
     {
-        return sqlite_storage_class::TEXT;
+        return _capacity;
     }
-    else if constexpr (std::is_same_v<T, blob>)
+
+    size_t num_idle() const
     {
-        return sqlite_storage_class::BLOB;
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _num_idle;
     }
-}
 
-inline std::string to_string(sqlite_storage_class sc)
-{
-    switch (sc)
+    // Accumulated statistics of all shapes, ordered by shape
+    std::vector<statement_stats> stats() const
     {
-    case sqlite_storage_class::INTEGER:
-        return "INTEGER";
-    case sqlite_storage_class::REAL:
-        return "REAL";
-    case sqlite_storage_class::TEXT:
-        return "TEXT";
-    case sqlite_storage_class::BLOB:
-        return "BLOB";
-    default:
-        return "UNKOWN";
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::vector<statement_stats> result;
+        result.reserve(_shapes.size());
+        for (const auto& [shape, entry] : _shapes)
+            result.push_back(entry.stats);
+        return result;
     }
-}
 
-// identity function, just returns the input
-template <typename T> T identity(const T& input)
-{
-    return input;
-}
+  private:
+    struct shape_entry
+    {
+        std::vector<sqlite3_stmt*> idle;
+        statement_stats stats;
+    };
 
-/**
- * @class codec
- * @brief Base class for encoding and decoding operations.
- *
- * This template struct provides a common interface for encoding and decoding
- * operations, which are used for converting between different data types.
- *
- * @tparam IN_T The input type for encoding.
- * @tparam OUT_T The output type for decoding.
- *
- * codec is a fundamental building block of the database management system,
- * providing the necessary functionality for encoding and decoding operations.
- */
+    void release(std::string_view shape, sqlite3_stmt* stmt, size_t generation)
+    {
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
 
-template <typename IN_T, typename OUT_T> struct codec
-{
-    using in_type = IN_T;
-    using out_type = OUT_T;
+        auto take = [stmt](int op)
+        { return static_cast<uint64_t>(sqlite3_stmt_status(stmt, op, 1)); };
+        auto vm_steps = take(SQLITE_STMTSTATUS_VM_STEP);
+        auto fullscan_steps = take(SQLITE_STMTSTATUS_FULLSCAN_STEP);
+        auto sorts = take(SQLITE_STMTSTATUS_SORT);
+        auto autoindexes = take(SQLITE_STMTSTATUS_AUTOINDEX);
+        auto reprepares = take(SQLITE_STMTSTATUS_REPREPARE);
+        auto runs = take(SQLITE_STMTSTATUS_RUN);
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _shapes.find(shape);
+        if (it != _shapes.end())
+        {
+            auto& stats = it->second.stats;
+            stats.runs += runs;
+            stats.vm_steps += vm_steps;
+            stats.fullscan_steps += fullscan_steps;
+            stats.sorts += sorts;
+            stats.autoindexes += autoindexes;
+            stats.reprepares += reprepares;
+        }
+
+        if (_num_idle >= _capacity || generation != _generation || it == _shapes.end())
+        {
+            sqlite3_finalize(stmt);
+            return;
+        }
+
+        it->second.idle.push_back(stmt);
+        _num_idle++;
+    }
 
-    const std::function<OUT_T(const IN_T&)> encode;
-    const std::function<IN_T(const OUT_T&)> decode;
+    size_t _capacity;
+    size_t _num_idle = 0;
+    size_t _generation = 0;
+    std::map<std::string, shape_entry, std::less<>> _shapes;
+    mutable std::mutex _mutex;
 };
 
-struct key_codec_tag
+struct sqlite_stats
 {
+    // sqlite3_db_status of the connection, memory in bytes
+    int64_t cache_hits = 0;     // Pager cache hits since the connection was opened
+    int64_t cache_misses = 0;   // Pager cache misses, i.e. pages read from disk or mmap
+    int64_t cache_writes = 0;   // Dirty pages written to disk
+    int64_t cache_spills = 0;   // Dirty pages written before commit, as the cache was full
+    int64_t cache_memory = 0;   // Heap memory used by the pager cache
+    int64_t schema_memory = 0;  // Heap memory used by the schema
+    int64_t stmt_memory = 0;    // Heap memory used by all prepared statements
+    int64_t lookaside_used = 0; // Lookaside memory slots currently checked out
+
+    // sqlite3_status64 of the whole process, memory in bytes
+    int64_t memory_used = 0;        // Heap memory currently allocated by SQLite
+    int64_t memory_highwater = 0;   // Max heap memory allocated by SQLite
+    int64_t malloc_count = 0;       // Number of outstanding allocations
+    int64_t pagecache_overflow = 0; // Page cache memory allocated from the heap instead
+
+    // statistics of each statement shape of the statement cache
+    std::vector<statement_stats> statements;
 };
 
-template <typename IN_T, typename OUT_T>
-struct key_codec : public codec<IN_T, OUT_T>, public key_codec_tag
+// Collects sqlite3_db_status of db, the process wide sqlite3_status64 and statement statistics
+inline sqlite_stats collect_stats(sqlite3* db, std::vector<statement_stats> statements)
 {
-    using codec<IN_T, OUT_T>::codec;
-
-    key_codec(std::function<OUT_T(const IN_T&)> encode, std::function<IN_T(const OUT_T&)> decode)
-        : codec<IN_T, OUT_T>{encode, decode}
+    sqlite_stats stats;
+    auto db_status = [db](int op)
     {
-    }
-};
+        int current = 0;
+        int max = 0;
+        sqlite3_db_status(db, op, &current, &max, 0);
+        return static_cast<int64_t>(current);
+    };
+    stats.cache_hits = db_status(SQLITE_DBSTATUS_CACHE_HIT);
+    stats.cache_misses = db_status(SQLITE_DBSTATUS_CACHE_MISS);
+    stats.cache_writes = db_status(SQLITE_DBSTATUS_CACHE_WRITE);
+    stats.cache_spills = db_status(SQLITE_DBSTATUS_CACHE_SPILL);
+    stats.cache_memory = db_status(SQLITE_DBSTATUS_CACHE_USED);
+    stats.schema_memory = db_status(SQLITE_DBSTATUS_SCHEMA_USED);
+    stats.stmt_memory = db_status(SQLITE_DBSTATUS_STMT_USED);
+    stats.lookaside_used = db_status(SQLITE_DBSTATUS_LOOKASIDE_USED);
+
+    auto status = [](int op, bool highwater = false)
+    {
+        sqlite3_int64 current = 0;
+        sqlite3_int64 max = 0;
+        sqlite3_status64(op, &current, &max, 0);
+        return static_cast<int64_t>(highwater ? max : current);
+    };
+    stats.memory_used = status(SQLITE_STATUS_MEMORY_USED);
+    stats.memory_highwater = status(SQLITE_STATUS_MEMORY_USED, true);
+    stats.malloc_count = status(SQLITE_STATUS_MALLOC_COUNT);
+    stats.pagecache_overflow = status(SQLITE_STATUS_PAGECACHE_OVERFLOW);
 
-template <typename T> struct is_key_codec : std::false_type
-{
-    // Default case, not a key_codec specialization
-};
+    stats.statements = std::move(statements);
+    return stats;
+}
 
-template <typename IN_T, typename OUT_T>
-struct is_key_codec<key_codec<IN_T, OUT_T>> : std::true_type
+// Size in bytes of an encoded key or value as stored in the database
+template <typename T> size_t encoded_size(const T& value)
 {
-    // Specialization for key_codec<IN_T, OUT_T>
-};
+    if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, blob>)
+        return value.size();
+    else
+        return sizeof(T);
+}
 
-struct value_codec_tag
+struct value_cache_stats
 {
+    size_t hits = 0;      // Number of lookups served from the cache
+    size_t misses = 0;    // Number of lookups which had to query the database
+    size_t size = 0;      // Number of cached values
+    size_t num_bytes = 0; // Encoded size of all cached values
 };
 
-template <typename IN_T, typename OUT_T>
-struct value_codec : public codec<IN_T, OUT_T>, public value_codec_tag
+/**
+ * @class value_cache
+ * @brief Least recently used cache of decoded values.
+ *
+ * Values are looked up by their encoded key and kept decoded, so that frequently read values
+ * neither have to be queried nor decoded again. The cache is bounded by a number of entries and
+ * a byte budget, which is measured by the encoded size of the values. Least recently used entries
+ * are evicted first.
+ */
+template <typename K, typename V> class value_cache
 {
-    using codec<IN_T, OUT_T>::codec;
+  public:
+    value_cache(size_t capacity, size_t byte_budget)
+        : _capacity(capacity)
+        , _byte_budget(byte_budget)
+    {
+    }
 
-    value_codec(std::function<OUT_T(const IN_T&)> encode, std::function<IN_T(const OUT_T&)> decode)
-        : codec<IN_T, OUT_T>{encode, decode}
+    std::optional<V> get(const K& key)
     {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _index.find(key);
+        if (it == _index.end())
+        {
+            _misses++;
+            return std::nullopt;
+        }
+
+        _hits++;
+        _entries.splice(_entries.begin(), _entries, it->second);
+        return it->second->value;
     }
-};
 
-template <typename T> struct is_value_codec : std::false_type
-{
-    // Default case, not a value_codec specialization
-};
+    void put(const K& key, const V& value, size_t num_bytes)
+    {
+        if (_capacity == 0 || num_bytes > _byte_budget)
+            return;
 
-template <typename IN_T, typename OUT_T>
-struct is_value_codec<value_codec<IN_T, OUT_T>> : std::true_type
-{
-    // Specialization for value_codec<IN_T, OUT_T>
-};
+        std::lock_guard<std::mutex> lock(_mutex);
+        erase_locked(key);
 
-template <typename T> struct unknown_codec_tag : std::false_type
-{
-    // Define unknown_codec_tag for triggering static assertion
-};
+        _entries.push_front({key, value, num_bytes});
+        _index.emplace(key, _entries.begin());
+        _num_bytes += num_bytes;
 
-template <typename T, typename E, typename D> auto taged_codec_from(E encoder, D decoder)
-{
-    using ea_type = typename details::function_traits<E>::argument_type;
-    using er_type = typename details::function_traits<E>::return_type;
-
-    using da_type = typename details::function_traits<D>::argument_type;
-    using dr_type = typename details::function_traits<D>::return_type;
-
-    // Ensure that decode function's input type matches encode function's output type
-    static_assert(std::is_same_v<std::decay_t<da_type>, std::decay_t<er_type>>,
-                  "Decoder input type must match Encoder output type");
+        while (_entries.size() > _capacity || _num_bytes > _byte_budget)
+            erase_locked(_entries.back().key);
+    }
 
-    // Ensure that decode function's output type matches the original type being encoded
-    static_assert(std::is_same_v<std::decay_t<dr_type>, std::decay_t<ea_type>>,
-                  "Decoder return type must match Encoder input type");
+    void erase(const K& key)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        erase_locked(key);
+    }
 
-    if constexpr (std::is_same_v<T, key_codec_tag>)
+    void clear()
     {
-        return key_codec<std::decay_t<ea_type>, std::decay_t<er_type>>{encoder, decoder};
+        std::lock_guard<std::mutex> lock(_mutex);
+        _entries.clear();
+        _index.clear();
+        _num_bytes = 0;
     }
-    else if constexpr (std::is_same_v<T, value_codec_tag>)
+
+    value_cache_stats stats() const
     {
-        return value_codec<std::decay_t<ea_type>, std::decay_t<er_type>>{encoder, decoder};
+        std::lock_guard<std::mutex> lock(_mutex);
+        return {_hits, _misses, _entries.size(), _num_bytes};
     }
-    else
+
+  private:
+    struct entry
     {
-        static_assert(unknown_codec_tag<T>::value, "Unknown codec tag type");
+        K key;
+        V value;
+        size_t num_bytes;
+    };
+
+    void erase_locked(const K& key)
+    {
+        auto it = _index.find(key);
+        if (it == _index.end())
+            return;
+
+        _num_bytes -= it->second->num_bytes;
+        _entries.erase(it->second);
+        _index.erase(it);
     }
-}
 
-template <typename TAG, typename TYPE> auto taged_codec_from()
-{
-    using namespace codecs;
-    using ED = decltype(&identity<TYPE>);
-    return taged_codec_from<TAG, ED, ED>(identity<TYPE>, identity<TYPE>);
-}
+    size_t _capacity;
+    size_t _byte_budget;
+    size_t _num_bytes = 0;
+    size_t _hits = 0;
+    size_t _misses = 0;
+    std::list<entry> _entries;
+    std::map<K, typename std::list<entry>::iterator> _index;
+    mutable std::mutex _mutex;
+};
 
 /**
- * @class codec_pair
- * @brief Combines key and value codecs for database operations.
- *
- * This template struct pairs a key codec and a value codec, which are used
- * for encoding and decoding database keys and values, respectively.
- *
- * @tparam KC The key codec type.
- * @tparam VC The value codec type.
+ * @class write_buffer
+ * @brief Collects pending writes of encoded keys and values in memory.
  *
- * codec_pair is a fundamental building block of the database management system,
- * providing the necessary codecs for key and value operations.
+ * Each key keeps only its latest pending write, a value to be stored or std::nullopt for a
+ * delete. The buffer tracks the encoded size of all pending writes, so that the owner can decide
+ * when to flush them to the database.
  */
-
-template <typename KC, typename VC> struct codec_pair
+template <typename K, typename V> class write_buffer
 {
-    codec_pair(KC k, VC v)
-        : key_codec(k)
-        , value_codec(v)
+  public:
+    using pending_map = std::map<K, std::optional<V>>;
+
+    void put(const K& key, std::optional<V> value)
     {
-        static_assert(is_key_codec<std::decay_t<KC>>::value,
-                      "KC must be a specialization of key_codec<IN_T, OUT_T>");
+        auto it = _pending.find(key);
+        if (it != _pending.end())
+        {
+            _num_bytes -= entry_size(it->first, it->second);
+            it->second = std::move(value);
+        }
+        else
+        {
+            it = _pending.emplace(key, std::move(value)).first;
+        }
+        _num_bytes += entry_size(it->first, it->second);
+    }
 
-        static_assert(is_value_codec<std::decay_t<VC>>::value,
-                      "VC must be a specialization of value_codec<IN_T, OUT_T>");
+    // Returns nullptr when key has no pending write, otherwise the pending value or std::nullopt
+    // for a pending delete
+    const std::optional<V>* find(const K& key) const
+    {
+        auto it = _pending.find(key);
+        return it != _pending.end() ? &it->second : nullptr;
     }
 
-    using key_in_type = typename KC::in_type;
-    using key_out_type = typename KC::out_type;
-    using value_in_type = typename VC::in_type;
-    using value_out_type = typename VC::out_type;
+    const pending_map& entries() const
+    {
+        return _pending;
+    }
 
-    const KC key_codec;
-    const VC value_codec;
+    void clear()
+    {
+        _pending.clear();
+        _num_bytes = 0;
+    }
+
+    bool empty() const
+    {
+        return _pending.empty();
+    }
+
+    size_t size() const
+    {
+        return _pending.size();
+    }
+
+    size_t num_bytes() const
+    {
+        return _num_bytes;
+    }
+
+  private:
+    static size_t entry_size(const K& key, const std::optional<V>& value)
+    {
+        return encoded_size(key) + (value ? encoded_size(*value) : 0);
+    }
+
+    pending_map _pending;
+    size_t _num_bytes = 0;
 };
 
-template <typename T> struct is_codec_pair : std::false_type
+// Base template for function traits
+template <typename Func> struct function_traits;
+
+// Specialization for function pointers
+template <typename R, typename Arg> struct function_traits<R (*)(Arg)>
 {
-    // Default case, not a codec_pair specialization
+    using return_type = R;
+    using argument_type = Arg;
 };
 
-template <typename KC, typename VC> struct is_codec_pair<codec_pair<KC, VC>> : std::true_type
+// Specialization for lambdas and functors
+template <typename F> struct function_traits : function_traits<decltype(&F::operator())>
 {
 };
 
-} // namespace codecs
+// Specialization for lambdas with const operator()
+template <typename R, typename C, typename Arg> struct function_traits<R (C::*)(Arg) const>
+{
+    using return_type = R;
+    using argument_type = Arg;
+};
 
-template <typename E, typename D> auto key_codec(E encoder, D decoder)
+// Ensure specialization for non-const lambdas
+template <typename R, typename C, typename Arg> struct function_traits<R (C::*)(Arg)>
 {
-    return codecs::taged_codec_from<codecs::key_codec_tag, E, D>(encoder, decoder);
+    using return_type = R;
+    using argument_type = Arg;
+};
+
+// Name of the table which keeps row counts of tables using the row counter option
+constexpr const char* row_counts_table = "_sqlitemap_row_counts";
+
+// Quotes text as sql string literal, e.g. it's => 'it''s'
+inline std::string quote_literal(const std::string& text)
+{
+    std::string quoted = "'";
+    for (char c : text)
+    {
+        quoted += c;
+        if (c == '\'')
+            quoted += c;
+    }
+    return quoted + "'";
 }
 
-// use identity function of type T to define a key codec
-template <typename T> auto key_codec()
+// Quotes text as sql identifier, e.g. my"table => "my""table"
+inline std::string quote_identifier(const std::string& text)
 {
-    static_assert(
-        details::has_native_sqlite_support<T>(),
-        "Type has no native sqlite support which is required when using identity function");
+    std::string quoted = "\"";
+    for (char c : text)
+    {
+        quoted += c;
+        if (c == '"')
+            quoted += c;
+    }
+    return quoted + "\"";
+}
+
+// Generates a unique name for the temporary sqlite database.
+static std::string generate_temp_filename()
+{
+    using namespace std::chrono;
+
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_int_distribution<> dist(10000, 99999);
+    int random_number = dist(gen);
+
+    auto now = system_clock::now();
+    auto timestamp = duration_cast<milliseconds>(now.time_since_epoch()).count();
 
-    return codecs::taged_codec_from<codecs::key_codec_tag, T>();
+    std::string prefix = "sqlitemap";
+    std::string ts = std::to_string(timestamp);
+    std::string rn = std::to_string(random_number);
+    return prefix + "_" + ts + "_" + rn;
 }
 
-inline auto default_key_codec = key_codec<std::string>();
+template <typename T> struct is_tuple_like : std::false_type
+{
+};
 
-template <typename E, typename D> auto value_codec(E encoder, D decoder)
+template <typename... Ts> struct is_tuple_like<std::tuple<Ts...>> : std::true_type
 {
-    return codecs::taged_codec_from<codecs::value_codec_tag, E, D>(encoder, decoder);
-}
+};
 
-// use identity function of type T to define a value codec
-template <typename T> auto value_codec()
+template <typename A, typename B> struct is_tuple_like<std::pair<A, B>> : std::true_type
 {
-    static_assert(
-        details::has_native_sqlite_support<T>(),
-        "Type has no native sqlite support which is required when using identity function");
+};
 
-    return codecs::taged_codec_from<codecs::value_codec_tag, T>();
-}
+// Types having an order preserving encoding, cf. ordered_encode
+template <typename T>
+struct is_ordered_encodable
+    : std::bool_constant<std::is_arithmetic_v<T> || std::is_enum_v<T> ||
+                         std::is_same_v<T, std::string> || std::is_same_v<T, blob>>
+{
+};
 
-inline auto default_value_codec = value_codec<std::string>();
+template <typename... Ts>
+struct is_ordered_encodable<std::tuple<Ts...>>
+    : std::conjunction<is_ordered_encodable<std::decay_t<Ts>>...>
+{
+};
 
-enum class operation_mode
+template <typename A, typename B>
+struct is_ordered_encodable<std::pair<A, B>>
+    : std::conjunction<is_ordered_encodable<A>, is_ordered_encodable<B>>
 {
-    c, // default, open db for read/write, creating table if not exists
-    r, // open db as read-only
-    w, // open db for read/write, but drop table contents first
-    n  // create new database (erasing _all_ existing tables!)
 };
 
-constexpr const char* default_filename = "";
-constexpr const char* default_table = "unnamed";
-constexpr operation_mode default_mode = operation_mode::c;
-constexpr bool default_auto_commit = false;
-constexpr log_level default_log_level = log_level::off;
+// Tuple with decayed element types, e.g. to decode what was encoded from a std::tie
+template <typename T> struct decayed_tuple
+{
+    using type = T;
+};
 
-/**
- * @class configuration
- * @brief Manages database configuration and codec pairs.
- *
- * This template class stores and manages configuration parameters for a database
- * connection, including the codec pair for key and value encoding/decoding.
- *
- * @tparam CODEC_PAIR The codec pair type used for encoding and decoding.
- *
- * configuration is a key component of the database management system, providing
- * a structured way to configure database connections and codec pairs.
- */
+template <typename... Ts> struct decayed_tuple<std::tuple<Ts...>>
+{
+    using type = std::tuple<std::decay_t<Ts>...>;
+};
 
-template <typename CODEC_PAIR> class configuration
+template <typename U> void put_big_endian(blob& out, U bits)
 {
-  public:
-    configuration(CODEC_PAIR codecs)
-        : _codecs(codecs)
-    {
-        static_assert(codecs::is_codec_pair<std::decay_t<CODEC_PAIR>>::value,
-                      "CODEC_PAIR must be a specialization of codec_pair<KC, VC>");
-    }
+    for (size_t i = sizeof(U); i-- > 0;)
+        out.push_back(static_cast<std::byte>((bits >> (8 * i)) & 0xff));
+}
 
-    CODEC_PAIR codecs() const
-    {
-        return _codecs;
-    }
+template <typename U> U get_big_endian(blob_view in, size_t& pos)
+{
+    if (in.size() - pos < sizeof(U))
+        throw sqlitemap_error("Truncated order preserving encoding");
 
-    configuration& filename(std::string filename)
-    {
-        _filename = filename;
-        return *this;
-    }
+    U bits = 0;
+    for (size_t i = 0; i < sizeof(U); i++)
+        bits = static_cast<U>((bits << 8) | static_cast<U>(in[pos++]));
+    return bits;
+}
 
-    std::string filename() const
+// Appends an encoding of value to out whose bytes compare like the values themselves:
+//   integers - big endian with flipped sign bit, so that negative values sort first
+//   floats   - big endian IEEE 754 bits, all bits flipped for negative values, else the sign bit;
+//              -0.0 is encoded as +0.0 and any NaN as positive quiet NaN, which sorts after +inf
+//   strings  - bytes with 0x00 escaped as 0x00 0xff, terminated by 0x00 0x01
+//   tuples   - concatenation of their elements
+template <typename T> void ordered_encode(blob& out, const T& value)
+{
+    if constexpr (std::is_enum_v<T>)
     {
-        return _filename;
+        ordered_encode(out, static_cast<std::underlying_type_t<T>>(value));
     }
-
-    configuration& table(std::string table)
+    else if constexpr (std::is_same_v<T, bool>)
     {
-        _table = table;
-        return *this;
+        out.push_back(static_cast<std::byte>(value ? 1 : 0));
     }
-
-    std::string table() const
+    else if constexpr (std::is_integral_v<T>)
     {
-        return _table;
+        using U = std::make_unsigned_t<T>;
+        auto bits = static_cast<U>(value);
+        if constexpr (std::is_signed_v<T>)
+            bits ^= static_cast<U>(U(1) << (8 * sizeof(U) - 1));
+        put_big_endian(out, bits);
     }
+    else if constexpr (std::is_floating_point_v<T>)
+    {
+        static_assert(sizeof(T) == 4 || sizeof(T) == 8, "Unsupported floating point type");
+        using U = std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>;
+        constexpr U sign = U(1) << (8 * sizeof(U) - 1);
+        bool is_nan = value != value;
 
-    configuration& mode(operation_mode mode)
+        // values comparing equal share one encoding, NaNs differing in sign or payload as well
+        T canonical = is_nan ? std::numeric_limits<T>::quiet_NaN() : value == T(0) ? T(0) : value;
+        U bits;
+        std::memcpy(&bits, &canonical, sizeof(U));
+        if (is_nan)
+            bits &= static_cast<U>(~sign);
+
+        put_big_endian(out, (bits & sign) ? static_cast<U>(~bits) : static_cast<U>(bits | sign));
+    }
+    else if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, blob>)
     {
-        _mode = mode;
-        return *this;
+        for (auto c : value)
+        {
+            out.push_back(static_cast<std::byte>(c));
+            if (static_cast<std::byte>(c) == std::byte{0})
+                out.push_back(std::byte{0xff});
+        }
+        out.push_back(std::byte{0});
+        out.push_back(std::byte{1});
     }
-
-    operation_mode mode() const
+    else if constexpr (is_tuple_like<T>::value)
     {
-        return _mode;
+        std::apply([&out](const auto&... elements) { (ordered_encode(out, elements), ...); },
+                   value);
     }
-
-    configuration& auto_commit(bool auto_commit)
+    else
     {
-        _auto_commit = auto_commit;
-        return *this;
+        static_assert(is_ordered_encodable<T>::value, "Type has no order preserving encoding");
     }
+}
 
-    bool auto_commit() const
+template <typename T> T ordered_decode(blob_view in, size_t& pos);
+
+template <typename T, size_t... I>
+T ordered_decode_tuple(blob_view in, size_t& pos, std::index_sequence<I...>)
+{
+    // elements of braced initializers are evaluated in order
+    return T{ordered_decode<std::tuple_element_t<I, T>>(in, pos)...};
+}
+
+// Decodes a value encoded by ordered_encode starting at pos, which is advanced past it
+template <typename T> T ordered_decode(blob_view in, size_t& pos)
+{
+    if constexpr (std::is_enum_v<T>)
     {
-        return _auto_commit;
+        return static_cast<T>(ordered_decode<std::underlying_type_t<T>>(in, pos));
     }
-
-    configuration& log_level(log_level log_level)
+    else if constexpr (std::is_same_v<T, bool>)
     {
-        _log_level = log_level;
-        return *this;
+        return get_big_endian<uint8_t>(in, pos) != 0;
     }
-
-    bw::sqlitemap::log_level log_level() const
+    else if constexpr (std::is_integral_v<T>)
     {
-        return _log_level;
+        using U = std::make_unsigned_t<T>;
+        auto bits = get_big_endian<U>(in, pos);
+        if constexpr (std::is_signed_v<T>)
+            bits ^= static_cast<U>(U(1) << (8 * sizeof(U) - 1));
+        return static_cast<T>(bits);
     }
-
-    configuration& log_impl(logger::log_function log_impl)
+    else if constexpr (std::is_floating_point_v<T>)
     {
-        _log_impl = log_impl;
-        return *this;
+        using U = std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>;
+        constexpr U sign = U(1) << (8 * sizeof(U) - 1);
+        auto bits = get_big_endian<U>(in, pos);
+        bits = (bits & sign) ? static_cast<U>(bits ^ sign) : static_cast<U>(~bits);
+        T value;
+        std::memcpy(&value, &bits, sizeof(U));
+        return value;
     }
-
-    logger::log_function log_impl() const
+    else if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, blob>)
     {
-        return _log_impl;
-    }
+        T value;
+        while (pos < in.size())
+        {
+            auto b = in[pos++];
+            if (b != std::byte{0})
+            {
+                value.push_back(static_cast<typename T::value_type>(b));
+                continue;
+            }
 
-    configuration& pragma(const std::string& flag, int value)
+            if (pos == in.size())
+                break;
+
+            auto escaped = in[pos++];
+            if (escaped == std::byte{1})
+                return value;
+            if (escaped != std::byte{0xff})
+                throw sqlitemap_error("Invalid escape sequence in order preserving encoding");
+
+            value.push_back(static_cast<typename T::value_type>(0));
+        }
+        throw sqlitemap_error("Truncated order preserving encoding");
+    }
+    else if constexpr (is_tuple_like<T>::value)
     {
-        return pragma(flag, std::to_string(value));
+        return ordered_decode_tuple<T>(in, pos, std::make_index_sequence<std::tuple_size_v<T>>{});
     }
-
-    configuration& pragma(const std::string& flag, const std::string& value)
+    else
     {
-        return pragma("PRAGMA " + flag + " = " + value);
+        static_assert(is_ordered_encodable<T>::value, "Type has no order preserving encoding");
     }
+}
 
-    configuration& pragma(const std::string& statement)
-    {
-        std::string prefix = "PRAGMA ";
-        if (statement.size() < prefix.size() ||
-            !std::equal(prefix.begin(), prefix.end(), statement.begin(),
-                        [](char a, char b) { return std::tolower(a) == std::tolower(b); }))
-        {
-            _pragma_statements.push_back(prefix + statement);
-            return *this;
-        }
+// Decodes a value encoded by ordered_encode, which has to span all of in
+template <typename T> T ordered_decode(blob_view in)
+{
+    size_t pos = 0;
+    T value = ordered_decode<T>(in, pos);
+    if (pos != in.size())
+        throw sqlitemap_error("Trailing bytes after order preserving encoding");
+    return value;
+}
 
-        _pragma_statements.push_back(statement);
-        return *this;
-    }
+} // namespace details
 
-    const std::vector<std::string>& pragmas() const
-    {
-        return _pragma_statements;
-    }
+namespace codecs
+{
 
-  private:
-    CODEC_PAIR _codecs;
-    std::string _filename = default_filename;
-    std::string _table = default_table;
-    operation_mode _mode = default_mode;
-    bool _auto_commit = default_auto_commit;
-    bw::sqlitemap::log_level _log_level = default_log_level;
-    logger::log_function _log_impl;
-    std::vector<std::string> _pragma_statements;
+enum class sqlite_storage_class
+{
+    INTEGER,
+    REAL,
+    TEXT,
+    BLOB
 };
 
-template <typename CODEC_PAIR> auto config(CODEC_PAIR codec)
+template <typename T> constexpr sqlite_storage_class sqlite_storage_class_from_type()
 {
-    if constexpr (codecs::is_codec_pair<std::decay_t<CODEC_PAIR>>::value)
+    if constexpr (std::is_integral_v<T>)
     {
-        return configuration(codec);
+        return sqlite_storage_class::INTEGER;
     }
-    else if constexpr (codecs::is_key_codec<std::decay_t<CODEC_PAIR>>::value)
+    else if constexpr (std::is_floating_point_v<T>)
     {
-        return configuration(codecs::codec_pair(codec, default_value_codec));
+        return sqlite_storage_class::REAL;
     }
-    else if constexpr (codecs::is_value_codec<std::decay_t<CODEC_PAIR>>::value)
+    else if constexpr (std::is_same_v<T, std::string>)
     {
-        return configuration(codecs::codec_pair(default_key_codec, codec));
+        return sqlite_storage_class::TEXT;
     }
-    else
+    else if constexpr (std::is_same_v<T, const char*>)
     {
-        static_assert(codecs::unknown_codec_tag<CODEC_PAIR>::value, "Unknown CODEC_PAIR type");
+        return sqlite_storage_class::TEXT;
+    }
+    else if constexpr (std::is_same_v<T, blob>)
+    {
+        return sqlite_storage_class::BLOB;
     }
 }
 
-template <typename KC, typename VC> auto config(KC key_codec, VC value_codec)
+inline std::string to_string(sqlite_storage_class sc)
 {
-    return config(codecs::codec_pair(key_codec, value_codec));
+    switch (sc)
+    {
+    case sqlite_storage_class::INTEGER:
+        return "INTEGER";
+    case sqlite_storage_class::REAL:
+        return "REAL";
+    case sqlite_storage_class::TEXT:
+        return "TEXT";
+    case sqlite_storage_class::BLOB:
+        return "BLOB";
+    default:
+        return "UNKOWN";
+    }
 }
 
-// Uses key type K and value type V to create configuration from
-// both corresponding identity functions
-template <typename K, typename V> inline auto config()
+// identity function, just returns the input
+template <typename T> T identity(const T& input)
 {
-    return config(key_codec<K>(), value_codec<V>());
+    return input;
 }
 
-inline auto config()
+// identity function object, passes the input through without copying it and can be inlined
+// completely, so identity codecs of native types come without any overhead
+template <typename T> struct identity_function
 {
-    return config(default_key_codec, default_value_codec);
-}
+    const T& operator()(const T& input) const
+    {
+        return input;
+    }
+};
 
-enum class column_option
+// function objects for the order preserving blob encoding of T, cf. details::ordered_encode
+template <typename T> struct ordered_encoder
 {
-    key,
-    value,
-    key_value,
+    blob operator()(const T& value) const
+    {
+        blob encoded;
+        details::ordered_encode(encoded, value);
+        return encoded;
+    }
+};
+
+template <typename T> struct ordered_decoder
+{
+    T operator()(const blob& encoded) const
+    {
+        return details::ordered_decode<T>(encoded);
+    }
 };
 
 /**
- * @class lazy_result
- * @brief Provides lazy evaluation and caching of SQL query results.
+ * @class codec
+ * @brief Base class for encoding and decoding operations.
  *
- * This template class manages the deferred (lazy) evaluation of results from
- * SQL queries executed on a SQLite database. It decodes keys and values using
- * a provided codec pair and supports different column retrieval modes via the
- * column_option template parameter.
+ * This template struct provides a common interface for encoding and decoding
+ * operations, which are used for converting between different data types.
  *
- * The class internally manages the SQLite statement lifecycle and caches results
- * as they are accessed, allowing efficient repeated access to previously evaluated rows.
+ * @tparam IN_T The input type for encoding.
+ * @tparam OUT_T The output type for decoding.
+ * @tparam ENC The encoder type, type erased std::function by default.
+ * @tparam DEC The decoder type, type erased std::function by default.
  *
- * @tparam CODEC_PAIR The codec pair type used for encoding and decoding.
- * @tparam KV The key-value type for the result set.
- * @tparam COL_OPT The column option type (key, value, or key_value).
+ * Codecs created by the key_codec and value_codec factories keep the exact types of the given
+ * encoder and decoder, which allows the compiler to inline them. The type erased form is useful
+ * when the codec type has to be spelled out, any codec converts into it.
  *
- * lazy_result is designed for single-pass or sequential access patterns, but it caches
- * all evaluated rows for efficient repeated access. It is not thread-safe.
+ * codec is a fundamental building block of the database management system,
+ * providing the necessary functionality for encoding and decoding operations.
  */
 
-template <typename CODEC_PAIR, typename KV, column_option COL_OPT> class lazy_result
+template <typename IN_T, typename OUT_T, typename ENC = std::function<OUT_T(const IN_T&)>,
+          typename DEC = std::function<IN_T(const OUT_T&)>>
+struct codec
 {
-  public:
-    using value_type = KV;
-    using size_type = size_t;
-    using db_key_type = typename CODEC_PAIR::key_out_type;
-    using db_mapped_type = typename CODEC_PAIR::value_out_type;
+    using in_type = IN_T;
+    using out_type = OUT_T;
+    using encoder_type = ENC;
+    using decoder_type = DEC;
 
-    lazy_result(sqlite3* db, const std::string& query, const configuration<CODEC_PAIR>* config)
-        : _db(db)
-        , _query(query)
-        , _config(config)
-        , _stmt(nullptr)
-        , _stmt_completed(false)
-        , _num_rows(0)
-    {
-        details::prepare_checked(_db, query, &_stmt);
-    }
+    const ENC encode;
+    const DEC decode;
+};
 
-    lazy_result(value_type&& row, const configuration<CODEC_PAIR>* config)
-        : _db(nullptr)
-        , _query("")
-        , _config(config)
-        , _stmt(nullptr)
-        , _stmt_completed(true)
-        , _num_rows(0)
-    {
-        cache_item(std::move(row));
-    }
+struct key_codec_tag
+{
+};
 
-    ~lazy_result()
-    {
-        finalize_stmt();
-    }
+template <typename IN_T, typename OUT_T, typename ENC = std::function<OUT_T(const IN_T&)>,
+          typename DEC = std::function<IN_T(const OUT_T&)>>
+struct key_codec : public codec<IN_T, OUT_T, ENC, DEC>, public key_codec_tag
+{
+    using codec<IN_T, OUT_T, ENC, DEC>::codec;
 
-    const value_type& operator[](size_type index) const
+    key_codec(ENC encode, DEC decode)
+        : codec<IN_T, OUT_T, ENC, DEC>{std::move(encode), std::move(decode)}
     {
-        load_data(index);
-        return _data[index];
     }
 
-    size_type evaluated_num_rows() const
+    // converts a key codec with other encoder and decoder types, e.g. into the type erased form
+    template <typename E, typename D>
+    key_codec(const key_codec<IN_T, OUT_T, E, D>& other)
+        : codec<IN_T, OUT_T, ENC, DEC>{other.encode, other.decode}
     {
-        return _num_rows;
     }
+};
 
-    bool result_completed() const
+template <typename T> struct is_key_codec : std::false_type
+{
+    // Default case, not a key_codec specialization
+};
+
+template <typename IN_T, typename OUT_T, typename ENC, typename DEC>
+struct is_key_codec<key_codec<IN_T, OUT_T, ENC, DEC>> : std::true_type
+{
+    // Specialization for key_codec<IN_T, OUT_T, ENC, DEC>
+};
+
+struct value_codec_tag
+{
+};
+
+template <typename IN_T, typename OUT_T, typename ENC = std::function<OUT_T(const IN_T&)>,
+          typename DEC = std::function<IN_T(const OUT_T&)>>
+struct value_codec : public codec<IN_T, OUT_T, ENC, DEC>, public value_codec_tag
+{
+    using codec<IN_T, OUT_T, ENC, DEC>::codec;
+
+    value_codec(ENC encode, DEC decode)
+        : codec<IN_T, OUT_T, ENC, DEC>{std::move(encode), std::move(decode)}
     {
-        return _stmt_completed;
     }
 
-    void advance() const
+    // converts a value codec with other encoder and decoder types, e.g. into the type erased form
+    template <typename E, typename D>
+    value_codec(const value_codec<IN_T, OUT_T, E, D>& other)
+        : codec<IN_T, OUT_T, ENC, DEC>{other.encode, other.decode}
     {
-        cache_next();
     }
+};
 
-  private:
-    void load_data(size_type to_index) const
-    {
-        if (_stmt_completed && to_index < _data.size())
-            return;
+template <typename T> struct is_value_codec : std::false_type
+{
+    // Default case, not a value_codec specialization
+};
 
-        if (_stmt_completed && to_index >= _num_rows)
-            throw std::range_error("Tried to iterate over max num of rows");
+template <typename IN_T, typename OUT_T, typename ENC, typename DEC>
+struct is_value_codec<value_codec<IN_T, OUT_T, ENC, DEC>> : std::true_type
+{
+    // Specialization for value_codec<IN_T, OUT_T, ENC, DEC>
+};
 
-        auto need_iteration = [&](size_type i)
-        {
-            if (i <= to_index)
-                return true;
+template <typename T> struct is_identity_value_codec : std::false_type
+{
+    // Default case, value codec transforms values
+};
 
-            return !_stmt_completed && i == to_index + 1;
-        };
+template <typename T>
+struct is_identity_value_codec<value_codec<T, T, identity_function<T>, identity_function<T>>>
+    : std::true_type
+{
+    // Specialization for value codecs created by value_codec<T>(), which store values as they are
+};
 
-        for (int i = _data.size(); need_iteration(i); i++)
-        {
-            cache_next();
-        }
-    }
+template <typename T> struct unknown_codec_tag : std::false_type
+{
+    // Define unknown_codec_tag for triggering static assertion
+};
 
-    //  returns next item, or empty when no item is left
-    std::optional<value_type> eval_next() const
-    {
-        int rc = sqlite3_step(_stmt);
-        if (rc == SQLITE_ROW)
-        {
-            if constexpr (COL_OPT == column_option::key_value)
-            {
-                auto key = details::column_value<db_key_type>(_stmt, 0);
-                auto decoded_key = _config->codecs().key_codec.decode(key);
+template <typename T, typename E, typename D> auto taged_codec_from(E encoder, D decoder)
+{
+    using ea_type = typename details::function_traits<E>::argument_type;
+    using er_type = typename details::function_traits<E>::return_type;
 
-                auto value = details::column_value<db_mapped_type>(_stmt, 1);
-                auto decoded_value = _config->codecs().value_codec.decode(value);
+    using da_type = typename details::function_traits<D>::argument_type;
+    using dr_type = typename details::function_traits<D>::return_type;
 
-                return value_type{decoded_key, decoded_value};
-            }
-            else if constexpr (COL_OPT == column_option::key)
-            {
-                auto key = details::column_value<db_key_type>(_stmt, 0);
-                auto decoded_key = _config->codecs().key_codec.decode(key);
-                return decoded_key;
-            }
-            else if constexpr (COL_OPT == column_option::value)
-            {
+    // Ensure that decode function's input type matches encode function's output type
+    static_assert(std::is_same_v<std::decay_t<da_type>, std::decay_t<er_type>>,
+                  "Decoder input type must match Encoder output type");
+
+    // Ensure that decode function's output type matches the original type being encoded
+    static_assert(std::is_same_v<std::decay_t<dr_type>, std::decay_t<ea_type>>,
+                  "Decoder return type must match Encoder input type");
+
+    // encoder and decoder keep their types, so that calls to them can be inlined
+    using in_type = std::decay_t<ea_type>;
+    using out_type = std::decay_t<er_type>;
+
+    if constexpr (std::is_same_v<T, key_codec_tag>)
+    {
+        return key_codec<in_type, out_type, E, D>{encoder, decoder};
+    }
+    else if constexpr (std::is_same_v<T, value_codec_tag>)
+    {
+        return value_codec<in_type, out_type, E, D>{encoder, decoder};
+    }
+    else
+    {
+        static_assert(unknown_codec_tag<T>::value, "Unknown codec tag type");
+    }
+}
+
+template <typename TAG, typename TYPE> auto taged_codec_from()
+{
+    using ED = identity_function<TYPE>;
+    return taged_codec_from<TAG, ED, ED>(ED{}, ED{});
+}
+
+/**
+ * @class codec_pair
+ * @brief Combines key and value codecs for database operations.
+ *
+ * This template struct pairs a key codec and a value codec, which are used
+ * for encoding and decoding database keys and values, respectively.
+ *
+ * @tparam KC The key codec type.
+ * @tparam VC The value codec type.
+ *
+ * codec_pair is a fundamental building block of the database management system,
+ * providing the necessary codecs for key and value operations.
+ */
+
+template <typename KC, typename VC> struct codec_pair
+{
+    codec_pair(KC k, VC v)
+        : key_codec(k)
+        , value_codec(v)
+    {
+        static_assert(is_key_codec<std::decay_t<KC>>::value,
+                      "KC must be a specialization of key_codec<IN_T, OUT_T>");
+
+        static_assert(is_value_codec<std::decay_t<VC>>::value,
+                      "VC must be a specialization of value_codec<IN_T, OUT_T>");
+    }
+
+    // converts a codec pair with other encoder and decoder types, e.g. into the type erased form
+    template <typename OTHER_KC, typename OTHER_VC>
+    codec_pair(const codec_pair<OTHER_KC, OTHER_VC>& other)
+        : codec_pair(KC(other.key_codec), VC(other.value_codec))
+    {
+    }
+
+    using key_in_type = typename KC::in_type;
+    using key_out_type = typename KC::out_type;
+    using value_in_type = typename VC::in_type;
+    using value_out_type = typename VC::out_type;
+    using value_codec_type = VC;
+
+    const KC key_codec;
+    const VC value_codec;
+};
+
+template <typename T> struct is_codec_pair : std::false_type
+{
+    // Default case, not a codec_pair specialization
+};
+
+template <typename KC, typename VC> struct is_codec_pair<codec_pair<KC, VC>> : std::true_type
+{
+};
+
+} // namespace codecs
+
+template <typename E, typename D> auto key_codec(E encoder, D decoder)
+{
+    return codecs::taged_codec_from<codecs::key_codec_tag, E, D>(encoder, decoder);
+}
+
+// Key codec storing keys of type T as blobs, which sort in the same order as the keys
+// themselves. Supports integers, floats, enums, strings, blobs and tuples or pairs of those.
+template <typename T> auto ordered_key_codec()
+{
+    static_assert(details::is_ordered_encodable<T>::value, "Type has no order preserving encoding");
+
+    using E = codecs::ordered_encoder<T>;
+    using D = codecs::ordered_decoder<T>;
+    return codecs::taged_codec_from<codecs::key_codec_tag, E, D>(E{}, D{});
+}
+
+// Order preserving key codec for other types, e.g. structs, which are mapped to and from tuples
+// of supported types, e.g. to_tuple = [](const tile& t) { return std::tie(t.zoom, t.col); }
+template <typename TO, typename FROM> auto ordered_key_codec(TO to_tuple, FROM from_tuple)
+{
+    using key_type = std::decay_t<typename details::function_traits<TO>::argument_type>;
+    using tuple_type = typename details::decayed_tuple<
+        std::decay_t<typename details::function_traits<TO>::return_type>>::type;
+
+    return codecs::taged_codec_from<codecs::key_codec_tag>(
+        [to_tuple](const key_type& key)
+        {
+            blob encoded;
+            details::ordered_encode(encoded, to_tuple(key));
+            return encoded;
+        },
+        [from_tuple](const blob& encoded) -> key_type
+        { return from_tuple(details::ordered_decode<tuple_type>(encoded)); });
+}
+
+// use identity function of type T to define a key codec, tuples and pairs without native sqlite
+// support use the order preserving encoding
+template <typename T> auto key_codec()
+{
+    if constexpr (details::is_tuple_like<T>::value)
+    {
+        return ordered_key_codec<T>();
+    }
+    else
+    {
+        static_assert(
+            details::has_native_sqlite_support<T>(),
+            "Type has no native sqlite support which is required when using identity function");
+
+        return codecs::taged_codec_from<codecs::key_codec_tag, T>();
+    }
+}
+
+inline auto default_key_codec = key_codec<std::string>();
+
+template <typename E, typename D> auto value_codec(E encoder, D decoder)
+{
+    return codecs::taged_codec_from<codecs::value_codec_tag, E, D>(encoder, decoder);
+}
+
+// use identity function of type T to define a value codec
+template <typename T> auto value_codec()
+{
+    static_assert(
+        details::has_native_sqlite_support<T>(),
+        "Type has no native sqlite support which is required when using identity function");
+
+    return codecs::taged_codec_from<codecs::value_codec_tag, T>();
+}
+
+inline auto default_value_codec = value_codec<std::string>();
+
+enum class operation_mode
+{
+    c, // default, open db for read/write, creating table if not exists
+    r, // open db as read-only
+    w, // open db for read/write, but drop table contents first
+    n  // create new database (erasing _all_ existing tables!)
+};
+
+enum class iteration_mode
+{
+    cached,   // default, keeps all evaluated rows, iterator copies can be used independently
+    streaming // keeps only current and next row, supports single-pass iteration only
+};
+
+enum class iteration_order
+{
+    insertion, // default, begin() follows the physical rowid order, rbegin() the reverse one
+    key        // ascending order of the encoded keys for begin(), descending for rbegin()
+};
+
+enum class table_layout
+{
+    rowid,        // default, rowid table with a separate primary key index
+    without_rowid // WITHOUT ROWID table clustered by key, does not support blob handles
+};
+
+inline std::string to_string(table_layout layout)
+{
+    return layout == table_layout::without_rowid ? "without_rowid" : "rowid";
+}
+
+enum class performance_profile
+{
+    none,       // default, only explicitly configured pragmas are applied
+    durable,    // WAL, every commit is synced to disk
+    balanced,   // WAL, synced on checkpoints only, larger page cache and memory mapped I/O
+    bulk_load,  // WAL, no syncing at all, large page cache, recent commits may be lost on crash
+    read_mostly // WAL, synced on checkpoints only, large memory mapped I/O for read heavy loads
+};
+
+inline std::string to_string(performance_profile profile)
+{
+    switch (profile)
+    {
+    case performance_profile::durable:
+        return "durable";
+    case performance_profile::balanced:
+        return "balanced";
+    case performance_profile::bulk_load:
+        return "bulk_load";
+    case performance_profile::read_mostly:
+        return "read_mostly";
+    default:
+        return "none";
+    }
+}
+
+namespace details {
+
+// Pragma flags and values of a performance profile. Values are given in the form SQLite reports
+// them when the pragma is queried, so that they can be validated after being applied.
+inline std::vector<std::pair<std::string, std::string>> profile_pragmas(
+    performance_profile profile)
+{
+    const std::string synchronous_off = "0";
+    const std::string synchronous_normal = "1";
+    const std::string synchronous_full = "2";
+    const std::string temp_store_memory = "2";
+
+    switch (profile)
+    {
+    case performance_profile::durable:
+        return {{"journal_mode", "wal"}, {"synchronous", synchronous_full}};
+    case performance_profile::balanced:
+        return {{"journal_mode", "wal"},
+                {"synchronous", synchronous_normal},
+                {"cache_size", "-65536"},   // 64 MiB
+                {"mmap_size", "268435456"}, // 256 MiB
+                {"temp_store", temp_store_memory}};
+    case performance_profile::bulk_load:
+        return {{"journal_mode", "wal"},
+                {"synchronous", synchronous_off},
+                {"cache_size", "-262144"}, // 256 MiB
+                {"temp_store", temp_store_memory}};
+    case performance_profile::read_mostly:
+        return {{"journal_mode", "wal"},
+                {"synchronous", synchronous_normal},
+                {"cache_size", "-65536"},    // 64 MiB
+                {"mmap_size", "1073741824"}, // 1 GiB
+                {"temp_store", temp_store_memory}};
+    default:
+        return {};
+    }
+}
+
+} // namespace details
+
+enum class metric_operation
+{
+    set,
+    get,
+    del,
+    count,
+    size,
+    iterate, // one step of an iterator, i.e. fetching and decoding one row
+    commit,
+    rollback
+};
+
+constexpr size_t num_metric_operations = 8;
+
+inline std::string to_string(metric_operation operation)
+{
+    switch (operation)
+    {
+    case metric_operation::set:
+        return "set";
+    case metric_operation::get:
+        return "get";
+    case metric_operation::del:
+        return "del";
+    case metric_operation::count:
+        return "count";
+    case metric_operation::size:
+        return "size";
+    case metric_operation::iterate:
+        return "iterate";
+    case metric_operation::commit:
+        return "commit";
+    default:
+        return "rollback";
+    }
+}
+
+enum class metric_phase
+{
+    total,   // whole operation
+    prepare, // acquiring the prepared statement and binding its parameters
+    step,    // executing the statement via sqlite3_step
+    encode,  // encoding keys and values by the codecs
+    decode   // decoding keys and values by the codecs
+};
+
+constexpr size_t num_metric_phases = 5;
+
+/**
+ * @struct latency_histogram
+ * @brief Distribution of latencies in buckets of powers of two nanoseconds.
+ *
+ * Bucket 0 counts latencies of 0 ns, bucket i counts latencies within [2^(i-1), 2^i) ns.
+ */
+struct latency_histogram
+{
+    static constexpr size_t num_buckets = 64;
+
+    std::array<uint64_t, num_buckets> buckets{};
+    uint64_t count = 0;  // Number of recorded latencies
+    uint64_t sum_ns = 0; // Sum of all recorded latencies
+
+    // Upper bound of the bucket containing the quantile q within [0, 1], e.g. 0.99 for p99
+    std::chrono::nanoseconds percentile(double q) const
+    {
+        if (count == 0)
+            return std::chrono::nanoseconds(0);
+
+        auto rank = static_cast<uint64_t>(std::clamp(q, 0.0, 1.0) * static_cast<double>(count));
+        uint64_t seen = 0;
+        size_t i = 0;
+        for (; i < num_buckets - 1; i++)
+        {
+            seen += buckets[i];
+            if (seen > rank || seen == count)
+                break;
+        }
+        // 2^i - 1 without overflowing for the last bucket
+        return std::chrono::nanoseconds(std::numeric_limits<int64_t>::max() >> (63 - i));
+    }
+
+    std::chrono::nanoseconds mean() const
+    {
+        return std::chrono::nanoseconds(count == 0 ? 0 : sum_ns / count);
+    }
+};
+
+struct operation_metrics
+{
+    uint64_t calls = 0;  // Number of calls, including failed ones
+    uint64_t errors = 0; // Number of calls which threw an exception
+    std::array<latency_histogram, num_metric_phases> latencies;
+
+    const latency_histogram& latency(metric_phase phase = metric_phase::total) const
+    {
+        return latencies[static_cast<size_t>(phase)];
+    }
+};
+
+struct metrics_snapshot
+{
+    std::array<operation_metrics, num_metric_operations> operations;
+
+    const operation_metrics& operator[](metric_operation operation) const
+    {
+        return operations[static_cast<size_t>(operation)];
+    }
+};
+
+namespace details {
+
+/**
+ * @class metrics_registry
+ * @brief Lock free counters and latency histograms of all metered operations.
+ *
+ * All counters are relaxed atomics, so const operations of a sqlitemap may record concurrently.
+ * Snapshots are not taken atomically as a whole, counters of concurrent calls may be included
+ * partially.
+ */
+class metrics_registry
+{
+  public:
+    void record(metric_operation operation, metric_phase phase,
+                std::chrono::steady_clock::duration duration)
+    {
+        auto ns = static_cast<uint64_t>(
+            std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::nanoseconds>(duration)
+                                     .count()));
+        size_t bucket = 0;
+        for (auto rest = ns; rest != 0; rest >>= 1)
+            bucket++;
+
+        auto& histogram = _operations[index(operation)].latencies[static_cast<size_t>(phase)];
+        histogram.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        histogram.count.fetch_add(1, std::memory_order_relaxed);
+        histogram.sum_ns.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    void record_call(metric_operation operation, std::chrono::steady_clock::duration duration,
+                     bool failed)
+    {
+        auto& counters = _operations[index(operation)];
+        counters.calls.fetch_add(1, std::memory_order_relaxed);
+        if (failed)
+            counters.errors.fetch_add(1, std::memory_order_relaxed);
+        record(operation, metric_phase::total, duration);
+    }
+
+    metrics_snapshot snapshot() const
+    {
+        metrics_snapshot result;
+        for (size_t op = 0; op < num_metric_operations; op++)
+        {
+            auto& counters = _operations[op];
+            auto& metrics = result.operations[op];
+            metrics.calls = counters.calls.load(std::memory_order_relaxed);
+            metrics.errors = counters.errors.load(std::memory_order_relaxed);
+            for (size_t phase = 0; phase < num_metric_phases; phase++)
+            {
+                auto& from = counters.latencies[phase];
+                auto& to = metrics.latencies[phase];
+                for (size_t i = 0; i < latency_histogram::num_buckets; i++)
+                    to.buckets[i] = from.buckets[i].load(std::memory_order_relaxed);
+                to.count = from.count.load(std::memory_order_relaxed);
+                to.sum_ns = from.sum_ns.load(std::memory_order_relaxed);
+            }
+        }
+        return result;
+    }
+
+    void reset()
+    {
+        for (auto& counters : _operations)
+        {
+            counters.calls.store(0, std::memory_order_relaxed);
+            counters.errors.store(0, std::memory_order_relaxed);
+            for (auto& histogram : counters.latencies)
+            {
+                for (auto& bucket : histogram.buckets)
+                    bucket.store(0, std::memory_order_relaxed);
+                histogram.count.store(0, std::memory_order_relaxed);
+                histogram.sum_ns.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+  private:
+    struct histogram_counters
+    {
+        std::array<std::atomic<uint64_t>, latency_histogram::num_buckets> buckets{};
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> sum_ns{0};
+    };
+
+    struct operation_counters
+    {
+        std::atomic<uint64_t> calls{0};
+        std::atomic<uint64_t> errors{0};
+        std::array<histogram_counters, num_metric_phases> latencies;
+    };
+
+    static size_t index(metric_operation operation)
+    {
+        return static_cast<size_t>(operation);
+    }
+
+    std::array<operation_counters, num_metric_operations> _operations;
+};
+
+/**
+ * @class metered_scope
+ * @brief Measures one call of an operation, does nothing when metrics are disabled.
+ *
+ * The call is recorded on destruction and counted as error when it is left by an exception.
+ * Phases are measured by laps, each lap attributes the time since the previous lap to a phase.
+ */
+class metered_scope
+{
+  public:
+    metered_scope(metrics_registry* metrics, metric_operation operation)
+        : _metrics(metrics)
+        , _operation(operation)
+    {
+        if (!_metrics)
+            return;
+
+        _num_exceptions = std::uncaught_exceptions();
+        _start = _lap = std::chrono::steady_clock::now();
+    }
+
+    metered_scope(const metered_scope&) = delete;
+    metered_scope& operator=(const metered_scope&) = delete;
+
+    ~metered_scope()
+    {
+        if (!_metrics)
+            return;
+
+        bool failed = std::uncaught_exceptions() > _num_exceptions;
+        _metrics->record_call(_operation, std::chrono::steady_clock::now() - _start, failed);
+    }
+
+    void lap(metric_phase phase)
+    {
+        if (!_metrics)
+            return;
+
+        auto now = std::chrono::steady_clock::now();
+        _metrics->record(_operation, phase, now - _lap);
+        _lap = now;
+    }
+
+  private:
+    metrics_registry* _metrics;
+    metric_operation _operation;
+    int _num_exceptions = 0;
+    std::chrono::steady_clock::time_point _start;
+    std::chrono::steady_clock::time_point _lap;
+};
+
+/**
+ * @class statement_tracer
+ * @brief Logs slow statements of a connection reported by sqlite3_trace_v2.
+ *
+ * SQLite reports the run time of every statement once it completes or is reset, statements
+ * taking at least the threshold are logged with their expanded sql as warnings. Sampling drops
+ * a share of the slow statements before their sql gets expanded. The tracer has to stay at its
+ * address until the connection is closed. It shares the logger of its sqlitemap, so that later
+ * changes of log level or log implementation apply to slow statements as well.
+ */
+class statement_tracer
+{
+  public:
+    statement_tracer(std::shared_ptr<const logger> log, std::string filename,
+                     std::chrono::nanoseconds threshold, double sample_rate)
+        : _log(std::move(log))
+        , _filename(std::move(filename))
+        , _threshold(threshold)
+        , _sample_rate(sample_rate)
+    {
+    }
+
+    statement_tracer(const statement_tracer&) = delete;
+    statement_tracer& operator=(const statement_tracer&) = delete;
+
+    void register_on(sqlite3* db)
+    {
+        int rc = sqlite3_trace_v2(db, SQLITE_TRACE_PROFILE, &statement_tracer::on_trace, this);
+        check_ok(rc, "Failed to register statement tracing", db);
+    }
+
+  private:
+    static int on_trace(unsigned type, void* context, void* stmt, void* duration)
+    {
+        if (type == SQLITE_TRACE_PROFILE)
+        {
+            auto ns = std::chrono::nanoseconds(*static_cast<sqlite3_int64*>(duration));
+            static_cast<statement_tracer*>(context)->profile(static_cast<sqlite3_stmt*>(stmt),
+                                                             ns);
+        }
+        return 0;
+    }
+
+    void profile(sqlite3_stmt* stmt, std::chrono::nanoseconds duration) const
+    {
+        if (duration < _threshold || !sampled())
+            return;
+
+        std::string sql;
+        if (char* expanded = sqlite3_expanded_sql(stmt))
+        {
+            sql = expanded;
+            sqlite3_free(expanded);
+        }
+        else
+        {
+            sql = sqlite3_sql(stmt); // expanding failed, e.g. out of memory
+        }
+
+        _log->warn("Slow statement on '" + _filename + "' took " +
+                   std::to_string(duration.count()) + " ns: " + sql);
+    }
+
+    bool sampled() const
+    {
+        if (_sample_rate >= 1.0)
+            return true;
+
+        thread_local std::mt19937 generator(std::random_device{}());
+        return std::uniform_real_distribution<double>(0.0, 1.0)(generator) < _sample_rate;
+    }
+
+    std::shared_ptr<const logger> _log;
+    std::string _filename;
+    std::chrono::nanoseconds _threshold;
+    double _sample_rate;
+};
+
+} // namespace details
+
+constexpr const char* default_filename = "";
+constexpr const char* default_table = "unnamed";
+constexpr operation_mode default_mode = operation_mode::c;
+constexpr bool default_auto_commit = false;
+constexpr log_level default_log_level = log_level::off;
+constexpr iteration_mode default_iteration_mode = iteration_mode::cached;
+constexpr iteration_order default_iteration_order = iteration_order::insertion;
+constexpr table_layout default_table_layout = table_layout::rowid;
+constexpr bool default_row_counter = false;
+constexpr performance_profile default_profile = performance_profile::none;
+constexpr bool default_metrics = false;
+constexpr bool default_trace = false;
+constexpr std::chrono::nanoseconds default_slow_query_threshold{100'000'000}; // 100 ms
+constexpr double default_trace_sample_rate = 1.0;
+constexpr size_t default_statement_cache_size = 16;
+constexpr size_t default_value_cache_size = 0;                  // value cache disabled
+constexpr size_t default_value_cache_bytes = 64 * 1024 * 1024; // 64 MiB
+constexpr size_t default_write_behind_rows = 0;                 // write-behind disabled
+constexpr size_t default_write_behind_bytes = 4 * 1024 * 1024;  // 4 MiB
+constexpr size_t max_keys_per_lookup = 256; // max number of bound keys in one get_many statement
+
+/**
+ * @class configuration
+ * @brief Manages database configuration and codec pairs.
+ *
+ * This template class stores and manages configuration parameters for a database
+ * connection, including the codec pair for key and value encoding/decoding.
+ *
+ * @tparam CODEC_PAIR The codec pair type used for encoding and decoding.
+ *
+ * configuration is a key component of the database management system, providing
+ * a structured way to configure database connections and codec pairs.
+ */
+
+template <typename CODEC_PAIR> class configuration
+{
+  public:
+    configuration(CODEC_PAIR codecs)
+        : _codecs(codecs)
+    {
+        static_assert(codecs::is_codec_pair<std::decay_t<CODEC_PAIR>>::value,
+                      "CODEC_PAIR must be a specialization of codec_pair<KC, VC>");
+    }
+
+    // converts a configuration with other codecs, e.g. into the type erased form, keeping all
+    // other settings
+    template <typename OTHER_CODEC_PAIR>
+    configuration(const configuration<OTHER_CODEC_PAIR>& other)
+        : _codecs(other._codecs)
+        , _filename(other._filename)
+        , _table(other._table)
+        , _mode(other._mode)
+        , _auto_commit(other._auto_commit)
+        , _log_level(other._log_level)
+        , _log_impl(other._log_impl)
+        , _pragma_statements(other._pragma_statements)
+        , _statement_cache_size(other._statement_cache_size)
+        , _iteration_mode(other._iteration_mode)
+        , _iteration_order(other._iteration_order)
+        , _table_layout(other._table_layout)
+        , _row_counter(other._row_counter)
+        , _profile(other._profile)
+        , _value_cache_size(other._value_cache_size)
+        , _value_cache_bytes(other._value_cache_bytes)
+        , _write_behind_rows(other._write_behind_rows)
+        , _write_behind_bytes(other._write_behind_bytes)
+        , _metrics(other._metrics)
+        , _trace(other._trace)
+        , _slow_query_threshold(other._slow_query_threshold)
+        , _trace_sample_rate(other._trace_sample_rate)
+    {
+    }
+
+    CODEC_PAIR codecs() const
+    {
+        return _codecs;
+    }
+
+    // access to codecs without copying them, as used for encoding and decoding on every operation
+    const CODEC_PAIR& codecs_ref() const
+    {
+        return _codecs;
+    }
+
+    configuration& filename(std::string filename)
+    {
+        _filename = filename;
+        return *this;
+    }
+
+    std::string filename() const
+    {
+        return _filename;
+    }
+
+    configuration& table(std::string table)
+    {
+        _table = table;
+        return *this;
+    }
+
+    std::string table() const
+    {
+        return _table;
+    }
+
+    configuration& mode(operation_mode mode)
+    {
+        _mode = mode;
+        return *this;
+    }
+
+    operation_mode mode() const
+    {
+        return _mode;
+    }
+
+    configuration& auto_commit(bool auto_commit)
+    {
+        _auto_commit = auto_commit;
+        return *this;
+    }
+
+    bool auto_commit() const
+    {
+        return _auto_commit;
+    }
+
+    configuration& log_level(log_level log_level)
+    {
+        _log_level = log_level;
+        return *this;
+    }
+
+    bw::sqlitemap::log_level log_level() const
+    {
+        return _log_level;
+    }
+
+    configuration& log_impl(logger::log_function log_impl)
+    {
+        _log_impl = log_impl;
+        return *this;
+    }
+
+    logger::log_function log_impl() const
+    {
+        return _log_impl;
+    }
+
+    configuration& pragma(const std::string& flag, int value)
+    {
+        return pragma(flag, std::to_string(value));
+    }
+
+    configuration& pragma(const std::string& flag, const std::string& value)
+    {
+        return pragma("PRAGMA " + flag + " = " + value);
+    }
+
+    configuration& pragma(const std::string& statement)
+    {
+        std::string prefix = "PRAGMA ";
+        if (statement.size() < prefix.size() ||
+            !std::equal(prefix.begin(), prefix.end(), statement.begin(),
+                        [](char a, char b) { return std::tolower(a) == std::tolower(b); }))
+        {
+            _pragma_statements.push_back(prefix + statement);
+            return *this;
+        }
+
+        _pragma_statements.push_back(statement);
+        return *this;
+    }
+
+    const std::vector<std::string>& pragmas() const
+    {
+        return _pragma_statements;
+    }
+
+    // Max number of idle prepared statements kept per connection, 0 disables statement caching
+    configuration& statement_cache_size(size_t statement_cache_size)
+    {
+        _statement_cache_size = statement_cache_size;
+        return *this;
+    }
+
+    size_t statement_cache_size() const
+    {
+        return _statement_cache_size;
+    }
+
+    configuration& iteration_mode(iteration_mode iteration_mode)
+    {
+        _iteration_mode = iteration_mode;
+        return *this;
+    }
+
+    bw::sqlitemap::iteration_mode iteration_mode() const
+    {
+        return _iteration_mode;
+    }
+
+    // Order of begin(), rbegin() and the key and value iterators. Key order walks the primary key
+    // index, so it needs no sort step and two maps can be merged or compared in one linear pass.
+    // It is the SQLite order of the encoded keys, which matches the order of the keys themselves
+    // only for order preserving codecs, cf. ordered_key_codec.
+    configuration& iteration_order(iteration_order iteration_order)
+    {
+        _iteration_order = iteration_order;
+        return *this;
+    }
+
+    bw::sqlitemap::iteration_order iteration_order() const
+    {
+        return _iteration_order;
+    }
+
+    // Layout of newly created tables. WITHOUT ROWID tables store rows in the primary key b-tree,
+    // so lookups descend one b-tree instead of two and keys are not stored twice. Existing tables
+    // keep their layout.
+    configuration& table_layout(table_layout table_layout)
+    {
+        _table_layout = table_layout;
+        return *this;
+    }
+
+    bw::sqlitemap::table_layout table_layout() const
+    {
+        return _table_layout;
+    }
+
+    // Maintains the number of rows by triggers, so that size() does not need to count all rows
+    configuration& row_counter(bool row_counter)
+    {
+        _row_counter = row_counter;
+        return *this;
+    }
+
+    bool row_counter() const
+    {
+        return _row_counter;
+    }
+
+    // Max number of decoded values kept in a least recently used cache in front of try_get, get
+    // and operator[], 0 disables the value cache. Only writes of the same sqlitemap object
+    // invalidate cached values, so it should not be used when others write to the table.
+    configuration& value_cache_size(size_t value_cache_size)
+    {
+        _value_cache_size = value_cache_size;
+        return *this;
+    }
+
+    size_t value_cache_size() const
+    {
+        return _value_cache_size;
+    }
+
+    // Max encoded size of all values kept in the value cache
+    configuration& value_cache_bytes(size_t value_cache_bytes)
+    {
+        _value_cache_bytes = value_cache_bytes;
+        return *this;
+    }
+
+    size_t value_cache_bytes() const
+    {
+        return _value_cache_bytes;
+    }
+
+    // Max number of keys with pending writes collected by set() and del() before they are flushed
+    // to the database within one transaction, 0 disables write-behind buffering
+    configuration& write_behind_rows(size_t write_behind_rows)
+    {
+        _write_behind_rows = write_behind_rows;
+        return *this;
+    }
+
+    size_t write_behind_rows() const
+    {
+        return _write_behind_rows;
+    }
+
+    // Max encoded size of all pending writes before they are flushed
+    configuration& write_behind_bytes(size_t write_behind_bytes)
+    {
+        _write_behind_bytes = write_behind_bytes;
+        return *this;
+    }
+
+    size_t write_behind_bytes() const
+    {
+        return _write_behind_bytes;
+    }
+
+    // Applies a vetted set of pragmas before the explicitly configured pragmas
+    configuration& profile(performance_profile profile)
+    {
+        _profile = profile;
+        return *this;
+    }
+
+    performance_profile profile() const
+    {
+        return _profile;
+    }
+
+    // Records call counts, error counts and latency histograms of all operations, cf.
+    // sqlitemap::metrics. Disabled metrics cost one branch per measuring point.
+    configuration& metrics(bool metrics)
+    {
+        _metrics = metrics;
+        return *this;
+    }
+
+    bool metrics() const
+    {
+        return _metrics;
+    }
+
+    // Logs statements taking at least slow_query_threshold as warnings with their expanded sql,
+    // which includes the bound keys and values, via sqlite3_trace_v2 and the configured logger
+    configuration& trace(bool trace)
+    {
+        _trace = trace;
+        return *this;
+    }
+
+    bool trace() const
+    {
+        return _trace;
+    }
+
+    // Durations are measured by SQLite, whose clock usually has a resolution of milliseconds
+    configuration& slow_query_threshold(std::chrono::nanoseconds slow_query_threshold)
+    {
+        _slow_query_threshold = slow_query_threshold;
+        return *this;
+    }
+
+    std::chrono::nanoseconds slow_query_threshold() const
+    {
+        return _slow_query_threshold;
+    }
+
+    // Share of slow statements getting logged, within [0, 1]
+    configuration& trace_sample_rate(double trace_sample_rate)
+    {
+        _trace_sample_rate = trace_sample_rate;
+        return *this;
+    }
+
+    double trace_sample_rate() const
+    {
+        return _trace_sample_rate;
+    }
+
+  private:
+    template <typename OTHER_CODEC_PAIR> friend class configuration;
+
+    CODEC_PAIR _codecs;
+    std::string _filename = default_filename;
+    std::string _table = default_table;
+    operation_mode _mode = default_mode;
+    bool _auto_commit = default_auto_commit;
+    bw::sqlitemap::log_level _log_level = default_log_level;
+    logger::log_function _log_impl;
+    std::vector<std::string> _pragma_statements;
+    size_t _statement_cache_size = default_statement_cache_size;
+    bw::sqlitemap::iteration_mode _iteration_mode = default_iteration_mode;
+    bw::sqlitemap::iteration_order _iteration_order = default_iteration_order;
+    bw::sqlitemap::table_layout _table_layout = default_table_layout;
+    bool _row_counter = default_row_counter;
+    performance_profile _profile = default_profile;
+    size_t _value_cache_size = default_value_cache_size;
+    size_t _value_cache_bytes = default_value_cache_bytes;
+    size_t _write_behind_rows = default_write_behind_rows;
+    size_t _write_behind_bytes = default_write_behind_bytes;
+    bool _metrics = default_metrics;
+    bool _trace = default_trace;
+    std::chrono::nanoseconds _slow_query_threshold = default_slow_query_threshold;
+    double _trace_sample_rate = default_trace_sample_rate;
+};
+
+template <typename CODEC_PAIR> auto config(CODEC_PAIR codec)
+{
+    if constexpr (codecs::is_codec_pair<std::decay_t<CODEC_PAIR>>::value)
+    {
+        return configuration(codec);
+    }
+    else if constexpr (codecs::is_key_codec<std::decay_t<CODEC_PAIR>>::value)
+    {
+        return configuration(codecs::codec_pair(codec, default_value_codec));
+    }
+    else if constexpr (codecs::is_value_codec<std::decay_t<CODEC_PAIR>>::value)
+    {
+        return configuration(codecs::codec_pair(default_key_codec, codec));
+    }
+    else
+    {
+        static_assert(codecs::unknown_codec_tag<CODEC_PAIR>::value, "Unknown CODEC_PAIR type");
+    }
+}
+
+template <typename KC, typename VC> auto config(KC key_codec, VC value_codec)
+{
+    return config(codecs::codec_pair(key_codec, value_codec));
+}
+
+// Uses key type K and value type V to create configuration from
+// both corresponding identity functions
+template <typename K, typename V> inline auto config()
+{
+    return config(key_codec<K>(), value_codec<V>());
+}
+
+inline auto config()
+{
+    return config(default_key_codec, default_value_codec);
+}
+
+enum class column_option
+{
+    key,
+    value,
+    key_value,
+};
+
+/**
+ * @class lazy_result
+ * @brief Provides lazy evaluation and caching of SQL query results.
+ *
+ * This template class manages the deferred (lazy) evaluation of results from
+ * SQL queries executed on a SQLite database. It decodes keys and values using
+ * a provided codec pair and supports different column retrieval modes via the
+ * column_option template parameter.
+ *
+ * The class internally manages the SQLite statement lifecycle and caches results
+ * as they are accessed, allowing efficient repeated access to previously evaluated rows.
+ * In iteration_mode::streaming only the current and the next row are kept, so that scans
+ * over large tables run in constant memory. Accessing an already released row throws.
+ *
+ * @tparam CODEC_PAIR The codec pair type used for encoding and decoding.
+ * @tparam KV The key-value type for the result set.
+ * @tparam COL_OPT The column option type (key, value, or key_value).
+ *
+ * lazy_result is designed for single-pass or sequential access patterns, but in cached mode it
+ * caches all evaluated rows for efficient repeated access. It is not thread-safe.
+ */
+
+template <typename CODEC_PAIR, typename KV, column_option COL_OPT> class lazy_result
+{
+  public:
+    using value_type = KV;
+    using size_type = size_t;
+    using db_key_type = typename CODEC_PAIR::key_out_type;
+    using db_mapped_type = typename CODEC_PAIR::value_out_type;
+
+    // Prepares query and binds params, which are encoded keys, to its parameters in order.
+    // Preparing and stepping are recorded into metrics unless it is nullptr.
+    lazy_result(sqlite3* db, const std::string& query, const configuration<CODEC_PAIR>* config,
+                details::metrics_registry* metrics = nullptr,
+                std::vector<db_key_type> params = {},
+                std::optional<iteration_mode> mode = std::nullopt)
+        : _db(db)
+        , _query(query)
+        , _config(config)
+        , _metrics(metrics)
+        , _params(std::move(params))
+        , _mode(mode.value_or(config->iteration_mode()))
+        , _stmt(nullptr)
+        , _stmt_completed(false)
+        , _num_rows(0)
+        , _num_released_rows(0)
+    {
+        auto start = _metrics ? std::chrono::steady_clock::now()
+                              : std::chrono::steady_clock::time_point();
+        details::prepare_checked(_db, query, &_stmt);
+
+        try
+        {
+            for (size_t i = 0; i < _params.size(); i++)
+                details::bind_param_checked(_stmt, i + 1, _params[i], "Failed to bind key", _db,
+                                            SQLITE_STATIC); // _params outlive _stmt
+        }
+        catch (const std::exception& e)
+        {
+            sqlite3_finalize(_stmt);
+            throw;
+        }
+
+        if (_metrics)
+            _metrics->record(metric_operation::iterate, metric_phase::prepare,
+                             std::chrono::steady_clock::now() - start);
+    }
+
+    lazy_result(value_type&& row, const configuration<CODEC_PAIR>* config)
+        : _db(nullptr)
+        , _query("")
+        , _config(config)
+        , _metrics(nullptr)
+        , _mode(iteration_mode::cached)
+        , _stmt(nullptr)
+        , _stmt_completed(true)
+        , _num_rows(0)
+        , _num_released_rows(0)
+    {
+        cache_item(std::move(row));
+    }
+
+    ~lazy_result()
+    {
+        finalize_stmt();
+    }
+
+    const value_type& operator[](size_type index) const
+    {
+        load_data(index);
+
+        if (index < _num_released_rows)
+            throw std::out_of_range("Row " + std::to_string(index) +
+                                    " was already released, streaming supports single-pass only");
+
+        return _data[index - _num_released_rows];
+    }
+
+    size_type evaluated_num_rows() const
+    {
+        return _num_rows;
+    }
+
+    // number of rows currently held in memory
+    size_type cached_num_rows() const
+    {
+        return _data.size();
+    }
+
+    iteration_mode mode() const
+    {
+        return _mode;
+    }
+
+    bool result_completed() const
+    {
+        return _stmt_completed;
+    }
+
+    void advance() const
+    {
+        cache_next();
+    }
+
+  private:
+    void load_data(size_type to_index) const
+    {
+        if (_stmt_completed && to_index < _num_rows)
+            return;
+
+        if (_stmt_completed && to_index >= _num_rows)
+            throw std::range_error("Tried to iterate over max num of rows");
+
+        auto need_iteration = [&](size_type i)
+        {
+            if (i <= to_index)
+                return true;
+
+            return !_stmt_completed && i == to_index + 1;
+        };
+
+        for (size_type i = _num_rows; need_iteration(i); i++)
+        {
+            cache_next();
+        }
+    }
+
+    //  returns next item, or empty when no item is left
+    std::optional<value_type> eval_next() const
+    {
+        details::metered_scope meter(_metrics, metric_operation::iterate);
+        int rc = sqlite3_step(_stmt);
+        meter.lap(metric_phase::step);
+        if (rc == SQLITE_ROW)
+        {
+            if constexpr (COL_OPT == column_option::key_value)
+            {
+                auto key = details::column_value<db_key_type>(_stmt, 0);
+                auto decoded_key = _config->codecs_ref().key_codec.decode(key);
+
+                auto value = details::column_value<db_mapped_type>(_stmt, 1);
+                auto decoded_value = _config->codecs_ref().value_codec.decode(value);
+                meter.lap(metric_phase::decode);
+
+                return value_type{decoded_key, decoded_value};
+            }
+            else if constexpr (COL_OPT == column_option::key)
+            {
+                auto key = details::column_value<db_key_type>(_stmt, 0);
+                auto decoded_key = _config->codecs_ref().key_codec.decode(key);
+                meter.lap(metric_phase::decode);
+                return decoded_key;
+            }
+            else if constexpr (COL_OPT == column_option::value)
+            {
                 auto value = details::column_value<db_mapped_type>(_stmt, 0);
-                auto decoded_value = _config->codecs().value_codec.decode(value);
+                auto decoded_value = _config->codecs_ref().value_codec.decode(value);
+                meter.lap(metric_phase::decode);
                 return decoded_value;
             }
-            else
+            else
+            {
+                static_assert(COL_OPT == column_option::key || COL_OPT == column_option::value ||
+                                  COL_OPT == column_option::key_value,
+                              "Unsupported column option");
+                throw sqlitemap_error("Unsopported column option");
+            }
+        }
+        else if (rc == SQLITE_DONE)
+        {
+            finalize_stmt();
+        }
+        else
+        {
+            // Finalize the statement in case of error and throw an exception
+            auto msg = "Error during SQLite iteration: " + std::string(sqlite3_errmsg(_db));
+            finalize_stmt();
+            throw sqlitemap_error(msg);
+        }
+        return std::nullopt;
+    }
+
+    void cache_item(value_type&& item) const
+    {
+        // iterators look one row ahead, so the current row has to be kept as well
+        if (_mode == iteration_mode::streaming && _data.size() >= 2)
+        {
+            _data.erase(_data.begin());
+            _num_released_rows++;
+        }
+
+        _num_rows++;
+        _data.push_back(std::move(item));
+    }
+
+    void cache_next() const
+    {
+        auto row = eval_next();
+        if (row.has_value())
+        {
+            cache_item(std::move(*row));
+        }
+    }
+
+    void finalize_stmt() const
+    {
+        if (!_stmt || _stmt_completed)
+            return;
+
+        sqlite3_finalize(_stmt);
+        _stmt_completed = true;
+    }
+
+    sqlite3* _db;
+    std::string _query;
+    const configuration<CODEC_PAIR>* _config;
+    details::metrics_registry* _metrics; // nullptr when metrics are disabled
+    std::vector<db_key_type> _params;
+    iteration_mode _mode;
+    sqlite3_stmt* _stmt;
+    mutable bool _stmt_completed;
+    mutable size_type _num_rows;
+    mutable size_type _num_released_rows;
+    mutable std::vector<value_type> _data;
+};
+
+/**
+ * @class sqlitemap_iterator
+ * @brief An input iterator for iterating over SQL query results.
+ *
+ * This template class provides an iterator interface for traversing
+ * the results of an SQL query executed on a SQLite database. It supports
+ * standard input iterator operations such as incrementing and dereferencing.
+ *
+ * @tparam CODEC_PAIR The codec pair type used for encoding and decoding.
+ * @tparam KV The key-value type for the iterator.
+ * @tparam COL_OPT The column option type.
+ *
+ * The iterator is constructed either from a database query or directly
+ * from a row. It uses a lazy evaluation strategy to fetch results as needed.
+ * The iterator ensures that it does not advance past the end of the result set.
+ *
+ * @note This iterator is limited to input operations only, meaning it can
+ * only be used for single-pass algorithms that process elements sequentially.
+ * It does not support operations such as bidirectional traversal or random access.
+ * In iteration_mode::streaming copies of an iterator share one cursor and rows behind
+ * the current position are released, dereferencing them throws std::out_of_range.
+ */
+template <typename CODEC_PAIR, typename KV, column_option COL_OPT> class sqlitemap_iterator
+{
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = KV;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const value_type*;
+    using reference = const value_type&;
+
+    using size_type = size_t;
+
+    using result_type = lazy_result<CODEC_PAIR, value_type, COL_OPT>;
+    using db_key_type = typename result_type::db_key_type;
+
+    sqlitemap_iterator(sqlite3* db, const std::string& query,
+                       const configuration<CODEC_PAIR>* config,
+                       details::metrics_registry* metrics = nullptr,
+                       std::vector<db_key_type> params = {},
+                       std::optional<iteration_mode> mode = std::nullopt)
+        : _lazy_result(std::make_shared<result_type>(db, query, config, metrics,
+                                                     std::move(params), mode))
+        , _is_end(false)
+    {
+        advance();
+    }
+
+    sqlitemap_iterator(value_type&& row, const configuration<CODEC_PAIR>* config)
+        : _lazy_result(std::make_shared<result_type>(std::move(row), config))
+        , _is_end(false)
+    {
+        advance();
+    }
+
+    sqlitemap_iterator()
+        : _is_end(true)
+    {
+    }
+
+    sqlitemap_iterator& operator++()
+    {
+        if (_is_end)
+        {
+            throw std::out_of_range("Incrementing the iterator past the end is not allowed.");
+        }
+        advance();
+        return *this;
+    }
+
+    sqlitemap_iterator operator++(int)
+    {
+        sqlitemap_iterator temp = *this;
+        ++temp;
+        return temp;
+    }
+
+    sqlitemap_iterator operator+(difference_type n) const
+    {
+        sqlitemap_iterator temp = *this;
+        for (int i = 0; i < n; i++)
+            ++temp;
+        return temp;
+    }
+
+    bool operator==(const sqlitemap_iterator& other) const
+    {
+        if (_is_end && other._is_end)
+            return true;
+
+        return _is_end == other._is_end &&               //
+               _current_index == other._current_index && //
+               _lazy_result == other._lazy_result;
+    }
+
+    bool operator!=(const sqlitemap_iterator& other) const
+    {
+        return !(*this == other);
+    }
+
+    reference operator*() const
+    {
+        return (*_lazy_result)[*_current_index];
+    }
+
+    pointer operator->() const
+    {
+        return &(**this);
+    }
+
+  private:
+    void advance()
+    {
+        if (check_for_end())
+            return;
+
+        if (!_lazy_result->result_completed())
+        {
+            _lazy_result->advance();
+        }
+
+        if (check_for_end())
+        {
+            _current_index = std::nullopt;
+        }
+        else
+        {
+            _current_index = _current_index ? ++(*_current_index) : 0;
+        }
+    }
+
+    bool check_for_end()
+    {
+        if (!_lazy_result)
+        {
+            _is_end = true;
+        }
+        else if (_lazy_result->result_completed())
+        {
+            bool is_empty = _lazy_result->evaluated_num_rows() == 0;
+            bool reached_last_index = _current_index >= _lazy_result->evaluated_num_rows() - 1;
+            if (is_empty || reached_last_index)
+                _is_end = true;
+        }
+        return _is_end;
+    }
+
+    std::optional<size_type> _current_index;
+    std::shared_ptr<result_type> _lazy_result;
+    bool _is_end;
+};
+/**
+ * @class const_sqlitemap_iterator
+ * @brief Const iterator for iterating over database rows.
+ *
+ * This template class provides a const iterator for iterating over database rows,
+ * which is the const version of sqlitemap_iterator.
+ *
+ * @tparam CODEC_PAIR The codec pair type used for encoding and decoding.
+ * @tparam KV The key-value type used for database operations.
+ * @tparam COL_OPT The column option used for database operations.
+ *
+ * const_sqlitemap_iterator is the const version of sqlitemap_iterator and follows the same
+ * principles.
+ */
+template <typename CODEC_PAIR, typename KV, column_option COL_OPT> class const_sqlitemap_iterator
+{
+  public:
+    using base_iterator = sqlitemap_iterator<CODEC_PAIR, KV, COL_OPT>;
+    using iterator_category = typename base_iterator::iterator_category;
+    using value_type = typename base_iterator::value_type;
+    using difference_type = typename base_iterator::difference_type;
+    using pointer = const value_type*;   // Pointer to const value
+    using reference = const value_type&; // Reference to const value
+    using db_key_type = typename base_iterator::db_key_type;
+
+    const_sqlitemap_iterator(sqlite3* db, const std::string& query,
+                             const configuration<CODEC_PAIR>* config,
+                             details::metrics_registry* metrics = nullptr,
+                             std::vector<db_key_type> params = {},
+                             std::optional<iteration_mode> mode = std::nullopt)
+        : base_iter_(db, query, config, metrics, std::move(params), mode)
+    {
+    }
+
+    const_sqlitemap_iterator(value_type&& row, const configuration<CODEC_PAIR>* config)
+        : base_iter_(std::move(row), config)
+    {
+    }
+
+    const_sqlitemap_iterator() = default;
+
+    reference operator*() const
+    {
+        return base_iter_.operator*();
+    }
+    pointer operator->() const
+    {
+        return &(operator*());
+    }
+    const_sqlitemap_iterator& operator++()
+    {
+        ++base_iter_;
+        return *this;
+    }
+
+    const_sqlitemap_iterator operator+(difference_type n)
+    {
+        for (int i = 0; i < n; i++)
+            ++base_iter_;
+        return *this;
+    }
+
+    bool operator==(const const_sqlitemap_iterator& other) const
+    {
+        return base_iter_ == other.base_iter_;
+    }
+
+    bool operator!=(const const_sqlitemap_iterator& other) const
+    {
+        return base_iter_ != other.base_iter_;
+    }
+
+  private:
+    base_iterator base_iter_;
+};
+
+inline std::vector<std::string> get_tablenames(const std::string& filename)
+{
+    if (!std::filesystem::exists(filename))
+        throw sqlitemap_error("File " + filename + " does not exist");
+
+    sqlite3* db;
+    int rc = sqlite3_open(filename.c_str(), &db);
+    details::check_ok(rc, "Cannot open database at " + filename, db);
+
+    sqlite3_stmt* stmt = nullptr;
+    auto sql = std::string(R"(SELECT name FROM sqlite_master WHERE type="table" AND name != )") +
+               details::quote_literal(details::row_counts_table);
+    details::prepare_checked(db, sql, &stmt);
+
+    std::vector<std::string> tables;
+
+    try
+    {
+        int rc = sqlite3_step(stmt);
+        while (rc == SQLITE_ROW)
+        {
+            auto table = details::column_value<std::string>(stmt, 0);
+            tables.push_back(table);
+
+            rc = sqlite3_step(stmt);
+        }
+
+        details::check_done(rc);
+    }
+    catch (const std::exception& e)
+    {
+        sqlite3_finalize(stmt);
+        throw;
+    }
+
+    sqlite3_finalize(stmt);
+    return tables;
+}
+
+template <typename K, typename V> struct sqlitemap_node_type
+{
+    using value_type = std::optional<std::pair<K, V>>;
+    sqlitemap_node_type()
+    {
+    }
+
+    sqlitemap_node_type(K key, V&& value)
+        : kv({key, value})
+    {
+    }
+
+    K& key()
+    {
+        return kv->first;
+    }
+
+    V& mapped()
+    {
+        return kv->second;
+    }
+
+    operator bool() const
+    {
+        return kv.operator bool();
+    }
+
+  private:
+    value_type kv;
+};
+
+/**
+ * @class blob_handle
+ * @brief Streams the blob value of a single entry using SQLite incremental BLOB I/O.
+ *
+ * A blob_handle reads and writes chunks of a stored blob at arbitrary offsets without
+ * materializing the whole value, so memory usage is bounded by the chunk size. The size of the
+ * blob can not be changed by a handle, cf. sqlitemap::write_blob for preallocating a blob.
+ *
+ * A handle expires when its entry is modified by other means, further reads and writes fail
+ * afterwards. Handles must be destroyed before the sqlitemap they were opened from is closed.
+ *
+ * Writable handles call on_write after each write and when they are closed, which lets the owner
+ * invalidate values of the entry it cached meanwhile.
+ */
+class blob_handle
+{
+  public:
+    blob_handle(sqlite3* db, sqlite3_blob* blob, std::function<void()> on_write = {})
+        : _db(db)
+        , _blob(blob)
+        , _on_write(std::move(on_write))
+    {
+    }
+
+    blob_handle(const blob_handle&) = delete;
+    blob_handle& operator=(const blob_handle&) = delete;
+
+    blob_handle(blob_handle&& other) noexcept
+        : _db(other._db)
+        , _blob(std::exchange(other._blob, nullptr))
+        , _on_write(std::exchange(other._on_write, nullptr))
+    {
+    }
+
+    ~blob_handle()
+    {
+        close();
+    }
+
+    size_t size() const
+    {
+        return static_cast<size_t>(sqlite3_blob_bytes(_blob));
+    }
+
+    // Reads up to n bytes starting at offset into buffer, returns number of bytes read
+    size_t read(size_t offset, std::byte* buffer, size_t n) const
+    {
+        auto num_bytes = offset < size() ? std::min(n, size() - offset) : 0;
+        if (num_bytes == 0)
+            return 0;
+
+        int rc = sqlite3_blob_read(_blob, buffer, static_cast<int>(num_bytes),
+                                   static_cast<int>(offset));
+        details::check_ok(rc, "Failed to read blob", _db);
+        return num_bytes;
+    }
+
+    // Reads a chunk of up to n bytes starting at offset
+    blob read(size_t offset, size_t n) const
+    {
+        blob chunk(offset < size() ? std::min(n, size() - offset) : 0);
+        read(offset, chunk.data(), chunk.size());
+        return chunk;
+    }
+
+    // Overwrites bytes starting at offset, writing beyond the size of the blob fails
+    void write(size_t offset, blob_view data)
+    {
+        if (offset + data.size() > size())
+            throw sqlitemap_error("Writing " + std::to_string(data.size()) + " bytes at offset " +
+                                  std::to_string(offset) + " exceeds blob size " +
+                                  std::to_string(size()));
+
+        int rc = sqlite3_blob_write(_blob, data.data(), static_cast<int>(data.size()),
+                                    static_cast<int>(offset));
+        details::check_ok(rc, "Failed to write blob", _db);
+
+        if (_on_write)
+            _on_write();
+    }
+
+    void close()
+    {
+        if (_blob)
+        {
+            sqlite3_blob_close(std::exchange(_blob, nullptr));
+            if (_on_write)
+                _on_write();
+        }
+    }
+
+  private:
+    sqlite3* _db;
+    sqlite3_blob* _blob;
+    std::function<void()> _on_write;
+};
+
+/**
+ * @class sqlitemap
+ * @brief High-level C++ interface for SQLite-based key-value maps with codec support.
+ *
+ * This template class provides a flexible, type-safe, and efficient interface for managing
+ * key-value data in a SQLite database. It supports custom codecs for encoding/decoding keys
+ * and values, allowing seamless integration with a variety of C++ types and database schemas.
+ *
+ * The class exposes STL-like map operations, including insertion, lookup, deletion, and iteration.
+ * It supports both mutable and const iterators for traversing key-value pairs, keys, or values.
+ *
+ * Key features:
+ *   - Customizable key/value codecs via the CODEC_PAIR template parameter
+ *   - STL-style interface (find, insert, erase, begin/end iterators, etc.)
+ *   - Efficient lazy evaluation and caching of query results
+ *   - Strong type safety for all operations
+ *   - Integration with custom configuration objects
+ *
+ * @tparam CODEC_PAIR The codec pair type used for encoding and decoding keys and values.
+ * Defaults to the codec pair from the global config().
+ *
+ *
+ * @note Only single-pass iteration is supported to enable lazy evaluation and caching of query
+ * results. As a result, iterators returned by STL-like operations are intended solely for data
+ * access; advancing or reusing them in multiple passes is not supported.
+ */
+template <typename CODEC_PAIR = decltype(config().codecs())> class sqlitemap
+{
+  public:
+    using key_type = typename CODEC_PAIR::key_in_type;
+    using mapped_type = typename CODEC_PAIR::value_in_type; // type that corresponds to value in db
+    using value_type = std::pair<key_type, mapped_type>;    // important!  tuple of (key,value)
+    using node_type = sqlitemap_node_type<key_type, mapped_type>;
+    using db_key_type = typename CODEC_PAIR::key_out_type;
+    using db_mapped_type = typename CODEC_PAIR::value_out_type;
+    using size_type = size_t;
+
+    // Blob handles read and write the stored bytes directly, which is only sound when values are
+    // blobs stored as they are. Any other value codec, e.g. a compressing one, is bypassed by them.
+    static constexpr bool supports_blob_handles =
+        codecs::is_identity_value_codec<typename CODEC_PAIR::value_codec_type>::value &&
+        std::is_same_v<mapped_type, blob>;
+
+    using iterator = sqlitemap_iterator<CODEC_PAIR, value_type, column_option::key_value>;
+    using const_iterator =
+        const_sqlitemap_iterator<CODEC_PAIR, value_type, column_option::key_value>;
+
+    using key_iterator = sqlitemap_iterator<CODEC_PAIR, key_type, column_option::key>;
+    using const_key_iterator = const_sqlitemap_iterator<CODEC_PAIR, key_type, column_option::key>;
+
+    using value_iterator = sqlitemap_iterator<CODEC_PAIR, mapped_type, column_option::value>;
+    using const_value_iterator =
+        const_sqlitemap_iterator<CODEC_PAIR, mapped_type, column_option::value>;
+
+    struct sqlitemap_insert_return_type
+    {
+        iterator position; // Iterator to the inserted element or the existing one
+        bool inserted;     // True if insertion happened, false if key already exists
+        node_type node;    // The node, if insertion didn't happen (ownership is returned)
+    };
+    using insert_return_type = sqlitemap_insert_return_type;
+
+    struct sqlitemap_bulk_result
+    {
+        size_type inserted = 0; // Number of keys that did not exist before
+        size_type replaced = 0; // Number of keys whose value got overwritten
+    };
+    using bulk_result = sqlitemap_bulk_result;
+
+    using value_cache_stats = details::value_cache_stats;
+    using statement_stats = details::statement_stats;
+    using sqlite_stats = details::sqlite_stats;
+
+    template <typename K = key_type, typename V = mapped_type> class value_ref
+    {
+      public:
+        value_ref(sqlitemap<CODEC_PAIR>* map, const K& key, V value)
+            : _map(map)
+            , _key(key)
+            , _val(value)
+        {
+        }
+
+        value_ref& operator=(const value_ref& other) = delete;
+
+        value_ref& operator=(V value)
+        {
+            _map->set(_key, value);
+            _val = value;
+            return *this;
+        }
+
+        operator V() const
+        {
+            return _val;
+        }
+
+        bool operator==(const V& other_value)
+        {
+            return _val == other_value;
+        }
+
+      private:
+        sqlitemap<CODEC_PAIR>* _map;
+        K _key;
+        V _val;
+
+        friend std::ostream& operator<<(std::ostream& os, const value_ref& ref)
+        {
+            os << ref._val;
+            return os;
+        }
+    };
+
+    sqlitemap(std::string filename = default_filename, std::string table = default_table,
+              operation_mode mode = default_mode, bool auto_commit = default_auto_commit,
+              log_level log_level = default_log_level)
+        : sqlitemap(bw::sqlitemap::config() // use default configuration
+                        .filename(filename)
+                        .table(table)
+                        .mode(mode)
+                        .auto_commit(auto_commit)
+                        .log_level(log_level))
+    {
+    }
+
+    sqlitemap(configuration<CODEC_PAIR> config)
+        : _config(std::move(config))
+        , _statements(std::make_unique<details::statement_cache>(_config.statement_cache_size()))
+        , _values(_config.value_cache_size() > 0
+                      ? std::make_unique<value_cache>(_config.value_cache_size(),
+                                                      _config.value_cache_bytes())
+                      : nullptr)
+        , _pending(_config.write_behind_rows() > 0 ? std::make_unique<write_buffer>() : nullptr)
+        , _metrics(_config.metrics() ? std::make_unique<details::metrics_registry>() : nullptr)
+    {
+        log().set_level(_config.log_level());
+        if (_config.log_impl())
+            log().register_log_impl(_config.log_impl());
+
+        namespace fs = std::filesystem;
+        try
+        {
+            if (_config.filename().empty())
+            {
+                auto dir = fs::temp_directory_path();
+                auto file = details::generate_temp_filename();
+                _config.filename((dir / file).string());
+                _in_temp = true;
+            }
+
+            if (_config.mode() == operation_mode::n && fs::exists(_config.filename()))
+                fs::remove(_config.filename());
+        }
+        catch (std::exception& ex)
+        {
+            throw sqlitemap_error(ex.what());
+        }
+
+        auto dir = fs::path(_config.filename()).parent_path();
+        if (dir.is_relative())
+            dir = fs::current_path() / dir;
+
+        if (!in_memory() && !fs::exists(dir))
+            throw sqlitemap_error("The directory does not exist: " + dir.string());
+
+        log().debug("sqlitemap - file: '" + _config.filename() + "' table: '" + _config.table() +
+                    "' sqlite3_libversion: " + sqlite3_libversion());
+
+        connect();
+    }
+
+    sqlitemap(sqlitemap&& other) noexcept
+        : db(std::exchange(other.db, nullptr))
+        , _config(std::move(other._config))
+        , _in_temp(std::exchange(other._in_temp, false))
+        , _row_counter_active(other._row_counter_active)
+        , _layout(other._layout)
+        , _logger(other._logger) // shared, so that the moved from map can still log
+        , _statements(std::move(other._statements))
+        , _values(std::move(other._values))
+        , _pending(std::move(other._pending))
+        , _tracer(std::move(other._tracer))
+        , _metrics(std::move(other._metrics))
+    {
+    }
+
+    ~sqlitemap()
+    {
+        try
+        {
+            close();
+        }
+        catch (std::exception& ex)
+        {
+            log().error(std::string("Descruction of sqlitemap failed. Error: ") + ex.what());
+        }
+    }
+
+    void open_database(const std::string& file)
+    {
+        try
+        {
+            int rc = SQLITE_ERROR;
+            if (is_read_only())
+            {
+                // open database but do not create one if missing
+                rc = sqlite3_open_v2(file.c_str(), &db, SQLITE_OPEN_READONLY, nullptr);
+            }
+            else
+            {
+                // open or create the database
+                rc = sqlite3_open(file.c_str(), &db);
+            }
+
+            details::check_ok(rc, "Cannot open database", db);
+            log().debug("Database '" + config().filename() + "' opened successfully!");
+        }
+        catch (const std::exception& e)
+        {
+            sqlite3_close(db);
+            db = nullptr;
+            throw;
+        }
+    }
+
+    // Connects to the underlying database and initializes the table if required. Throws exception
+    // in error cases.
+    void connect()
+    {
+        using namespace codecs;
+
+        try
+        {
+            open_database(config().filename());
+
+            if (config().trace())
+            {
+                _tracer = std::make_unique<details::statement_tracer>(
+                    _logger, config().filename(), config().slow_query_threshold(),
+                    config().trace_sample_rate());
+                _tracer->register_on(db);
+            }
+
+            if (is_read_only())
+            {
+                std::vector<std::string> tables = get_tablenames(config().filename());
+                if (std::find(tables.begin(), tables.end(), config().table()) == tables.end())
+                {
+                    std::string error_message = "Refusing to create a new table '" +
+                                                config().table() + "' in read-only DB mode";
+                    throw sqlitemap_error(error_message);
+                }
+            }
+
+            if (config().profile() != performance_profile::none)
+                apply_profile(config().profile());
+
+            // execute pragma statements
+            for (const auto& pragma_statement : config().pragmas())
+            {
+                details::exec_checked(db, pragma_statement);
+            }
+
+            // create table if missing
+            auto key_type = codecs::to_string(sqlite_storage_class_from_type<db_key_type>());
+            auto value_type = codecs::to_string(sqlite_storage_class_from_type<db_mapped_type>());
+            auto create_table_sql = sql("CREATE TABLE IF NOT EXISTS :table (key " + key_type +
+                                        " PRIMARY KEY, value " + value_type + ")");
+            if (config().table_layout() == table_layout::without_rowid)
+                create_table_sql += " WITHOUT ROWID";
+
+            details::exec_checked(db, create_table_sql);
+            // not metered like commit(), metrics only record calls of the user
+            sqlite3_exec(db, "COMMIT", nullptr, nullptr, nullptr);
+            log().debug("Table '" + config().table() + "' created successfully");
+
+            _layout = detect_layout();
+            if (_layout != config().table_layout())
+                log().warn("Table '" + config().table() + "' keeps its " +
+                           bw::sqlitemap::to_string(_layout) + " layout instead of the " +
+                           bw::sqlitemap::to_string(config().table_layout()) + " layout");
+
+            if (config().row_counter())
+                init_row_counter();
+
+            if (config().mode() == operation_mode::w)
+            {
+                clear();
+            }
+        }
+        catch (const std::exception& e)
+        {
+            _statements->clear();
+            sqlite3_close(db);
+            db = nullptr;
+            throw;
+        }
+    }
+
+    // Get the underlying SQLite connection object, this is used for advanced users
+    // who want to use the connection directly to execute custom queries
+    sqlite3* get_connection() const
+    {
+        return db;
+    }
+
+    void set(const key_type& key, const mapped_type& value)
+    {
+        auto meter = metered(metric_operation::set);
+        if (is_read_only())
+            throw sqlitemap_error("Refusing to write to read-only sqlitemap");
+
+        decltype(auto) encoded_key = _config.codecs_ref().key_codec.encode(key);
+        decltype(auto) encoded_value = _config.codecs_ref().value_codec.encode(value);
+        meter.lap(metric_phase::encode);
+        invalidate(encoded_key);
+
+        if (_pending)
+            return buffer_write(encoded_key, std::move(encoded_value));
+
+        // encoded key and value outlive the statement handle, which clears bindings on release
+        auto stmt = statement("REPLACE INTO :table (key, value) VALUES (?,?)");
+        details::bind_param_checked(stmt.get(), 1, encoded_key, "Failed to bind key", db,
+                                    SQLITE_STATIC);
+        details::bind_param_checked(stmt.get(), 2, encoded_value, "Failed to bind value", db,
+                                    SQLITE_STATIC);
+        meter.lap(metric_phase::prepare);
+
+        // sqlite auto commits changes when _no_ transactions was started by user
+        if (!config().auto_commit() && !in_transaction())
+            begin_transaction();
+
+        details::check_done(sqlite3_step(stmt.get()), db);
+        meter.lap(metric_phase::step);
+    }
+
+    // get value associated with key. Throws a sqliteman_error when key does not exist
+    // also cf. try_get for a not throwing alternative
+    mapped_type get(const key_type& key) const
+    {
+        try
+        {
+            return try_get(key).value();
+        }
+        catch (const std::bad_optional_access& e)
+        {
+            throw sqlitemap_error("Key '" + details::as_string_or(key) + "' not found in database");
+        }
+    }
+
+    // get optional value associated with key.
+    std::optional<mapped_type> try_get(const key_type& key) const
+    {
+        auto meter = metered(metric_operation::get);
+        decltype(auto) encoded_key = _config.codecs_ref().key_codec.encode(key);
+        meter.lap(metric_phase::encode);
+        if (auto pending_value = find_pending(encoded_key))
+        {
+            if (!*pending_value)
+                return std::nullopt;
+
+            return _config.codecs_ref().value_codec.decode(**pending_value);
+        }
+
+        if (_values)
+        {
+            if (auto cached_value = _values->get(encoded_key))
+                return cached_value;
+        }
+
+        std::optional<db_mapped_type> value;
+        {
+            auto stmt = statement("SELECT value FROM :table WHERE key = ?");
+            details::bind_param_checked(stmt.get(), 1, encoded_key, "Failed to bind key", db,
+                                        SQLITE_STATIC);
+            meter.lap(metric_phase::prepare);
+
+            int rc = sqlite3_step(stmt.get());
+            if (rc == SQLITE_DONE)
+                return std::nullopt;
+
+            details::require_return_code(rc, SQLITE_ROW, "Failed to execute statement", db);
+            value = details::column_value<db_mapped_type>(stmt.get(), 0);
+            meter.lap(metric_phase::step);
+        } // release statement before decoding
+
+        auto decoded_value = _config.codecs_ref().value_codec.decode(*value);
+        meter.lap(metric_phase::decode);
+        if (_values)
+            _values->put(encoded_key, decoded_value, details::encoded_size(*value));
+
+        return decoded_value;
+    }
+
+    // Calls visitor with a view on the stored, still encoded value of key, i.e. std::string_view
+    // for text, blob_view for blobs or the value itself for numeric types. Views borrow the data of
+    // the current SQLite row and are only valid during the call. Returns false for missing keys.
+    template <typename Visitor> bool visit(const key_type& key, Visitor&& visitor) const
+    {
+        decltype(auto) encoded_key = _config.codecs_ref().key_codec.encode(key);
+        if (auto pending_value = find_pending(encoded_key))
+        {
+            if (!*pending_value)
+                return false;
+
+            visitor(details::as_view(**pending_value));
+            return true;
+        }
+
+        auto stmt = statement("SELECT value FROM :table WHERE key = ?");
+        details::bind_param_checked(stmt.get(), 1, encoded_key, "Failed to bind key", db,
+                                    SQLITE_STATIC);
+
+        int rc = sqlite3_step(stmt.get());
+        if (rc == SQLITE_DONE)
+            return false;
+
+        details::require_return_code(rc, SQLITE_ROW, "Failed to execute statement", db);
+        visitor(details::column_view<db_mapped_type>(stmt.get(), 0));
+        return true;
+    }
+
+    // Calls visitor for each entry with the decoded key and a view on the stored value like
+    // visit(key, visitor) does. Returns number of visited entries.
+    template <typename Visitor> size_type visit_all(Visitor&& visitor) const
+    {
+        auto stmt = statement("SELECT key, value FROM :table");
+        size_type num_visited = 0;
+
+        int rc = SQLITE_ROW;
+        while ((rc = sqlite3_step(stmt.get())) == SQLITE_ROW)
+        {
+            auto key = _config.codecs_ref().key_codec.decode(
+                details::column_value<db_key_type>(stmt.get(), 0));
+            visitor(key, details::column_view<db_mapped_type>(stmt.get(), 1));
+            num_visited++;
+        }
+
+        details::check_done(rc, "Failed to execute statement", db);
+        return num_visited;
+    }
+
+    // Opens a read-only handle streaming the blob value of key. Throws when key does not exist.
+    blob_handle read_blob(const key_type& key) const
+    {
+        require_rowid_layout();
+        return open_blob(key, false);
+    }
+
+    // Stores a zero filled blob of the given size for key and opens a handle to write its content
+    // chunk by chunk, so that large values never have to be kept in memory as a whole.
+    blob_handle write_blob(const key_type& key, size_t size)
+    {
+        if (is_read_only())
+            throw sqlitemap_error("Refusing to write to read-only sqlitemap");
+
+        require_rowid_layout();
+        flush();
+
+        decltype(auto) encoded_key = _config.codecs_ref().key_codec.encode(key);
+        invalidate(encoded_key);
+
+        auto stmt = statement("REPLACE INTO :table (key, value) VALUES (?, zeroblob(?))");
+        details::bind_param_checked(stmt.get(), 1, encoded_key, "Failed to bind key", db,
+                                    SQLITE_STATIC);
+        details::bind_param_checked(stmt.get(), 2, static_cast<sqlite3_int64>(size),
+                                    "Failed to bind size", db);
+
+        // sqlite auto commits changes when _no_ transactions was started by user
+        if (!config().auto_commit() && !in_transaction())
+            begin_transaction();
+
+        details::check_done(sqlite3_step(stmt.get()), db);
+        return open_blob(key, true);
+    }
+
+    // Opens a handle to overwrite parts of the existing blob value of key in place. Throws when
+    // key does not exist.
+    blob_handle update_blob(const key_type& key)
+    {
+        if (is_read_only())
+            throw sqlitemap_error("Refusing to write to read-only sqlitemap");
+
+        require_rowid_layout();
+        flush();
+        invalidate(encode_key(key));
+
+        if (!config().auto_commit() && !in_transaction())
+            begin_transaction();
+
+        return open_blob(key, true);
+    }
+
+    // get optional values associated with keys. Results are returned in the order of the given
+    // keys. Keys are resolved by a small number of 'WHERE key IN (...)' statements instead of
+    // querying each key on its own.
+    template <typename Range>
+    std::vector<std::optional<mapped_type>> get_many(const Range& keys) const
+    {
+        // collect positions of distinct encoded keys, duplicates share the same lookup
+        std::map<db_key_type, std::vector<size_t>> positions;
+        size_t num_keys = 0;
+        for (const auto& key : keys)
+            positions[_config.codecs_ref().key_codec.encode(key)].push_back(num_keys++);
+
+        std::vector<std::optional<mapped_type>> result(num_keys);
+
+        auto it = positions.begin();
+        size_t num_remaining = positions.size();
+        while (num_remaining > 0)
+        {
+            size_t chunk_size = std::min(num_remaining, max_keys_per_lookup);
+            num_remaining -= chunk_size;
+
+            // round the number of parameters up to the next power of two so that only a few
+            // statement shapes exist, unused parameters repeat the last key of the chunk
+            size_t num_params = 1;
+            while (num_params < chunk_size)
+                num_params *= 2;
+
+            std::string shape = "SELECT key, value FROM :table WHERE key IN (?";
+            for (size_t i = 1; i < num_params; i++)
+                shape += ",?";
+            shape += ")";
+
+            auto stmt = statement(shape);
+            for (size_t i = 1; i <= num_params; i++)
+            {
+                details::bind_param_checked(stmt.get(), i, it->first, "Failed to bind key", db,
+                                            SQLITE_STATIC); // positions outlive stmt
+                if (i < chunk_size)
+                    ++it;
+            }
+            ++it;
+
+            int rc = sqlite3_step(stmt.get());
+            while (rc == SQLITE_ROW)
             {
-                static_assert(COL_OPT == column_option::key || COL_OPT == column_option::value ||
-                                  COL_OPT == column_option::key_value,
-                              "Unsupported column option");
-                throw sqlitemap_error("Unsopported column option");
+                auto key = details::column_value<db_key_type>(stmt.get(), 0);
+                auto found = positions.find(key);
+                if (found != positions.end())
+                {
+                    auto value = details::column_value<db_mapped_type>(stmt.get(), 1);
+                    auto decoded_value = _config.codecs_ref().value_codec.decode(value);
+                    for (auto pos : found->second)
+                        result[pos] = decoded_value;
+                }
+                rc = sqlite3_step(stmt.get());
             }
+            details::check_done(rc, "Failed to execute statement", db);
         }
-        else if (rc == SQLITE_DONE)
+
+        // pending writes take precedence over stored values
+        for (const auto& [encoded_key, key_positions] : positions)
         {
-            finalize_stmt();
+            if (auto pending_value = find_pending(encoded_key))
+            {
+                std::optional<mapped_type> value;
+                if (*pending_value)
+                    value = _config.codecs_ref().value_codec.decode(**pending_value);
+
+                for (auto pos : key_positions)
+                    result[pos] = value;
+            }
         }
-        else
+
+        return result;
+    }
+
+    std::vector<std::optional<mapped_type>> get_many(std::initializer_list<key_type> keys) const
+    {
+        return get_many<std::initializer_list<key_type>>(keys);
+    }
+
+    value_ref<key_type, mapped_type> at(const key_type& key)
+    {
+        return value_ref(this, key, get(key));
+    }
+
+    value_ref<key_type, mapped_type> operator[](const key_type& key)
+    {
+        try
         {
-            // Finalize the statement in case of error and throw an exception
-            auto msg = "Error during SQLite iteration: " + std::string(sqlite3_errmsg(_db));
-            finalize_stmt();
-            throw sqlitemap_error(msg);
+            return at(key);
         }
-        return std::nullopt;
+        catch (std::exception& ex)
+        {
+            auto default_value = mapped_type();
+            set(key, default_value);
+            return value_ref(this, key, default_value);
+        }
+    }
+
+    void del(const key_type& key)
+    {
+        auto meter = metered(metric_operation::del);
+        if (is_read_only())
+            throw sqlitemap_error("Refusing to delete from read-only sqlitemap");
+
+        decltype(auto) encoded_key = _config.codecs_ref().key_codec.encode(key);
+        meter.lap(metric_phase::encode);
+        invalidate(encoded_key);
+
+        if (_pending)
+            return buffer_write(encoded_key, std::nullopt);
+
+        auto stmt = statement("DELETE FROM :table WHERE key = ?");
+        details::bind_param_checked(stmt.get(), 1, encoded_key, "Failed to bind key", db,
+                                    SQLITE_STATIC);
+        meter.lap(metric_phase::prepare);
+
+        // sqlite auto commits changes when _no_ transactions was started by user
+        if (!config().auto_commit() && !in_transaction())
+            begin_transaction();
+
+        details::check_done(sqlite3_step(stmt.get()), db);
+        meter.lap(metric_phase::step);
+    }
+
+    size_t size() const
+    {
+        auto meter = metered(metric_operation::size);
+
+        if (_row_counter_active)
+        {
+            auto shape = "SELECT num_rows FROM " + std::string(details::row_counts_table) +
+                         " WHERE tbl = ?";
+            auto stmt = statement(shape);
+            details::bind_param_checked(stmt.get(), 1, config().table(), "", db);
+            meter.lap(metric_phase::prepare);
+
+            int rc = sqlite3_step(stmt.get());
+            meter.lap(metric_phase::step);
+            details::require_return_code(rc, SQLITE_ROW, "Failed to execute statement", db);
+
+            return details::column_value<size_t>(stmt.get(), 0);
+        }
+
+        // `select count (*)` walks the whole table, cf. configuration::row_counter
+        auto stmt = statement("SELECT COUNT(*) FROM :table");
+        meter.lap(metric_phase::prepare);
+
+        int rc = sqlite3_step(stmt.get());
+        meter.lap(metric_phase::step);
+        details::require_return_code(rc, SQLITE_ROW, "Failed to execute statement", db);
+
+        return details::column_value<size_t>(stmt.get(), 0);
+    }
+
+    bool empty() const
+    {
+        auto stmt = statement("SELECT 1 FROM :table LIMIT 1");
+
+        int rc = sqlite3_step(stmt.get());
+        if (rc == SQLITE_ROW)
+            return false;
+
+        details::check_done(rc, "Failed to execute statement", db);
+        return true;
+    }
+
+    std::pair<iterator, bool> insert(const value_type& kv)
+    {
+        if (is_read_only())
+            throw sqlitemap_error("Refusing to insert into read-only sqlitemap");
+
+        auto mapped = try_get(kv.first);
+        if (mapped)
+            return {find(kv.first), false};
+
+        set(kv.first, kv.second);
+        return {find(kv.first), true};
+    }
+
+    std::pair<iterator, bool> insert(value_type&& kv)
+    {
+        return insert(kv);
+    }
+
+    insert_return_type insert(node_type&& node)
+    {
+        if (is_read_only())
+            throw sqlitemap_error("Refusing to insert into read-only sqlitemap");
+
+        if (!node)
+            return {end(), false, std::move(node)};
+
+        auto result = insert({node.key(), node.mapped()});
+        return {result.first, result.second, result.second ? node_type() : std::move(node)};
+    }
+
+    void insert(std::initializer_list<std::pair<const key_type, mapped_type>> list)
+    {
+        insert(list.begin(), list.end());
+    }
+
+    template <typename _InputIterator> void insert(_InputIterator __first, _InputIterator __last)
+    {
+        if (is_read_only())
+            throw sqlitemap_error("Refusing to insert into read-only sqlitemap");
+
+        write_many(__first, __last, false);
+    }
+
+    // Inserts all key-value pairs of range whose keys do not exist yet. All pairs are written
+    // within one transaction using a single prepared statement. Returns number of inserted pairs.
+    template <typename Range> size_type insert_range(const Range& range)
+    {
+        if (is_read_only())
+            throw sqlitemap_error("Refusing to insert into read-only sqlitemap");
+
+        return write_many(std::begin(range), std::end(range), false).inserted;
+    }
+
+    // Sets all key-value pairs of range, existing keys will be overwritten. All pairs are written
+    // within one transaction reusing prepared statements. Reports the number of inserted and
+    // replaced pairs.
+    template <typename Range> bulk_result set_many(const Range& range)
+    {
+        return set_many(std::begin(range), std::end(range));
+    }
+
+    bulk_result set_many(std::initializer_list<std::pair<const key_type, mapped_type>> list)
+    {
+        return set_many(list.begin(), list.end());
+    }
+
+    template <typename _InputIterator>
+    bulk_result set_many(_InputIterator __first, _InputIterator __last)
+    {
+        if (is_read_only())
+            throw sqlitemap_error("Refusing to write to read-only sqlitemap");
+
+        return write_many(__first, __last, true);
+    }
+
+    template <typename Object>
+    std::pair<iterator, bool> insert_or_assign(const key_type& key, Object&& value)
+    {
+        if (is_read_only())
+            throw sqlitemap_error("Refusing to write to read-only sqlitemap");
+
+        auto result = try_emplace(key, std::forward<Object>(value));
+        if (result.second)
+            return result;
+
+        set(key, std::forward<Object>(value));
+        return {find(key), false};
+    }
+
+    template <typename Object>
+    std::pair<iterator, bool> insert_or_assign(key_type&& key, Object&& value)
+    {
+        if (is_read_only())
+            throw sqlitemap_error("Refusing to write to read-only sqlitemap");
+
+        auto result = try_emplace(std::move(key), std::forward<Object>(value));
+        if (result.second)
+            return result;
+
+        set(std::move(key), std::forward<Object>(value));
+        return {find(key), false};
     }
 
-    void cache_item(value_type&& item) const
+    template <typename... Args> std::pair<iterator, bool> emplace(Args&&... args)
     {
-        _num_rows++;
-        _data.push_back(std::move(item));
-    }
+        if (is_read_only())
+            throw sqlitemap_error("Refusing to write to read-only sqlitemap");
 
-    void cache_next() const
-    {
-        auto row = eval_next();
-        if (row.has_value())
-        {
-            cache_item(std::move(*row));
-        }
+        return insert(std::move(value_type(std::forward<Args>(args)...)));
     }
 
-    void finalize_stmt() const
+    // As sqlitemap has unordered keys, the hint will be ignored so that this methods behavior is
+    // equal to calling emplace method directly.
+    template <typename... Args> iterator emplace_hint(const_iterator hint, Args&&... args)
     {
-        if (!_stmt || _stmt_completed)
-            return;
+        if (is_read_only())
+            throw sqlitemap_error("Refusing to write to read-only sqlitemap");
 
-        sqlite3_finalize(_stmt);
-        _stmt_completed = true;
+        return emplace(std::forward<Args>(args)...).first;
     }
 
-    sqlite3* _db;
-    std::string _query;
-    const configuration<CODEC_PAIR>* _config;
-    sqlite3_stmt* _stmt;
-    mutable bool _stmt_completed;
-    mutable size_type _num_rows;
-    mutable std::vector<value_type> _data;
-};
-
-/**
- * @class sqlitemap_iterator
- * @brief An input iterator for iterating over SQL query results.
- *
- * This template class provides an iterator interface for traversing
- * the results of an SQL query executed on a SQLite database. It supports
- * standard input iterator operations such as incrementing and dereferencing.
- *
- * @tparam CODEC_PAIR The codec pair type used for encoding and decoding.
- * @tparam KV The key-value type for the iterator.
- * @tparam COL_OPT The column option type.
- *
- * The iterator is constructed either from a database query or directly
- * from a row. It uses a lazy evaluation strategy to fetch results as needed.
- * The iterator ensures that it does not advance past the end of the result set.
- *
- * @note This iterator is limited to input operations only, meaning it can
- * only be used for single-pass algorithms that process elements sequentially.
- * It does not support operations such as bidirectional traversal or random access.
- */
-template <typename CODEC_PAIR, typename KV, column_option COL_OPT> class sqlitemap_iterator
-{
-  public:
-    using iterator_category = std::input_iterator_tag;
-    using value_type = KV;
-    using difference_type = std::ptrdiff_t;
-    using pointer = const value_type*;
-    using reference = const value_type&;
-
-    using size_type = size_t;
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(const key_type& key, Args&&... args)
+    {
+        if (is_read_only())
+            throw sqlitemap_error("Refusing to write to read-only sqlitemap");
 
-    using result_type = lazy_result<CODEC_PAIR, value_type, COL_OPT>;
+        if (contains(key))
+            return {find(key), false};
 
-    sqlitemap_iterator(sqlite3* db, const std::string& query,
-                       const configuration<CODEC_PAIR>* config)
-        : _lazy_result(std::make_shared<result_type>(db, query, config))
-        , _is_end(false)
-    {
-        advance();
+        return emplace(std::piecewise_construct,
+                       std::forward_as_tuple(key), //
+                       std::forward_as_tuple(std::forward<Args>(args)...));
     }
 
-    sqlitemap_iterator(value_type&& row, const configuration<CODEC_PAIR>* config)
-        : _lazy_result(std::make_shared<result_type>(std::move(row), config))
-        , _is_end(false)
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(key_type&& key, Args&&... args)
     {
-        advance();
+        if (is_read_only())
+            throw sqlitemap_error("Refusing to write to read-only sqlitemap");
+
+        if (contains(key))
+            return {find(key), false};
+
+        return emplace(std::piecewise_construct,
+                       std::forward_as_tuple(std::move(key)), //
+                       std::forward_as_tuple(std::forward<Args>(args)...));
     }
 
-    sqlitemap_iterator()
-        : _is_end(true)
+    template <typename... Args>
+    iterator try_emplace(const_iterator hint, const key_type& key, Args&&... args)
     {
+        if (is_read_only())
+            throw sqlitemap_error("Refusing to write to read-only sqlitemap");
+
+        if (contains(key))
+            return find(key);
+
+        return emplace_hint(hint, std::piecewise_construct,
+                            std::forward_as_tuple(key), //
+                            std::forward_as_tuple(std::forward<Args>(args)...));
     }
 
-    sqlitemap_iterator& operator++()
+    template <typename... Args>
+    iterator try_emplace(const_iterator hint, key_type&& key, Args&&... args)
     {
-        if (_is_end)
-        {
-            throw std::out_of_range("Incrementing the iterator past the end is not allowed.");
-        }
-        advance();
-        return *this;
+        if (is_read_only())
+            throw sqlitemap_error("Refusing to write to read-only sqlitemap");
+
+        if (contains(key))
+            return find(key);
+
+        return emplace_hint(hint, std::piecewise_construct,
+                            std::forward_as_tuple(std::move(key)), //
+                            std::forward_as_tuple(std::forward<Args>(args)...));
     }
 
-    sqlitemap_iterator operator++(int)
+    iterator find(const key_type& key)
     {
-        sqlitemap_iterator temp = *this;
-        ++temp;
-        return temp;
+        auto value = try_get(key);
+        if (value)
+            return iterator(std::make_pair(key, std::move(*value)), &_config);
+
+        return end();
     }
 
-    sqlitemap_iterator operator+(difference_type n) const
+    const_iterator find(const key_type& key) const
     {
-        sqlitemap_iterator temp = *this;
-        for (int i = 0; i < n; i++)
-            ++temp;
-        return temp;
+        auto value = try_get(key);
+        if (value)
+            return const_iterator(std::make_pair(key, std::move(*value)), &_config);
+
+        return cend();
     }
 
-    bool operator==(const sqlitemap_iterator& other) const
+    size_type count(const key_type& key) const
     {
-        if (_is_end && other._is_end)
-            return true;
+        auto meter = metered(metric_operation::count);
+        decltype(auto) encoded_key = _config.codecs_ref().key_codec.encode(key);
+        meter.lap(metric_phase::encode);
+        if (auto pending_value = find_pending(encoded_key))
+            return pending_value->has_value() ? 1 : 0;
 
-        return _is_end == other._is_end &&               //
-               _current_index == other._current_index && //
-               _lazy_result == other._lazy_result;
+        auto stmt = statement("SELECT EXISTS(SELECT 1 FROM :table WHERE key = ?)");
+        details::bind_param_checked(stmt.get(), 1, encoded_key, "Failed to bind key", db,
+                                    SQLITE_STATIC);
+        meter.lap(metric_phase::prepare);
+
+        int rc = sqlite3_step(stmt.get());
+        meter.lap(metric_phase::step);
+        details::require_return_code(rc, SQLITE_ROW, "Failed to execute statement", db);
+
+        return details::column_value<int>(stmt.get(), 0);
     }
 
-    bool operator!=(const sqlitemap_iterator& other) const
+    bool contains(const key_type& key) const
     {
-        return !(*this == other);
+        return count(key);
     }
 
-    reference operator*() const
+    void clear()
     {
-        return (*_lazy_result)[*_current_index];
+        if (is_read_only())
+            throw sqlitemap_error("Refusing to clear read-only sqlitemap");
+
+        commit();
+
+        invalidate_all();
+        auto clear_sql = sql("DELETE FROM :table");
+        details::exec_checked(db, clear_sql);
+        commit();
     }
 
-    pointer operator->() const
+    // Erases entry for a given key. Returns 0 when key does not exists, 1 otherwise
+    size_type erase(const key_type& key)
     {
-        return &(**this);
+        if (is_read_only())
+            throw sqlitemap_error("Refusing to erase from read-only sqlitemap");
+
+        if (!contains(key))
+            return 0;
+
+        del(key);
+        return 1;
     }
 
-  private:
-    void advance()
+    // Erases entry when applies Predicate is true. Returns number of erased entries. Matching keys
+    // are collected in one streaming pass and deleted afterwards within a single savepoint.
+    template <typename Predicate> size_type erase_if(Predicate predicate)
     {
-        if (check_for_end())
-            return;
+        if (is_read_only())
+            throw sqlitemap_error("Refusing to erase from read-only sqlitemap");
 
-        if (!_lazy_result->result_completed())
-        {
-            _lazy_result->advance();
-        }
+        flush();
 
-        if (check_for_end())
-        {
-            _current_index = std::nullopt;
-        }
-        else
+        std::vector<db_key_type> matching_keys;
         {
-            _current_index = _current_index ? ++(*_current_index) : 0;
+            auto query = sql("SELECT key, value FROM :table");
+            iterator it(db, query, &_config, _metrics.get(), {}, iteration_mode::streaming);
+            for (; it != end(); ++it)
+            {
+                if (predicate(*it))
+                    matching_keys.push_back(encode_key(it->first));
+            }
         }
+
+        size_t num_erased_elements = 0;
+        if (matching_keys.empty())
+            return num_erased_elements;
+
+        in_savepoint(
+            [&]
+            {
+                auto stmt = statement("DELETE FROM :table WHERE key = ?");
+                for (const auto& encoded_key : matching_keys)
+                {
+                    invalidate(encoded_key);
+                    details::bind_param_checked(stmt.get(), 1, encoded_key, "Failed to bind key",
+                                                db, SQLITE_STATIC); // matching_keys outlive stmt
+                    details::check_done(sqlite3_step(stmt.get()), db);
+                    sqlite3_reset(stmt.get());
+                    num_erased_elements += sqlite3_changes(db);
+                }
+            });
+
+        return num_erased_elements;
     }
 
-    bool check_for_end()
+    // Erases all entries matching a SQL condition over the columns key and value within a single
+    // DELETE statement, e.g. erase_where("key LIKE ?", "tmp_%"). Params are bound in order to the
+    // ? placeholders of the condition. Returns number of erased entries
+    template <typename... Params>
+    size_type erase_where(const std::string& condition, const Params&... params)
     {
-        if (!_lazy_result)
-        {
-            _is_end = true;
-        }
-        else if (_lazy_result->result_completed())
+        if (is_read_only())
+            throw sqlitemap_error("Refusing to erase from read-only sqlitemap");
+
+        flush();
+
+        // conditions are arbitrary, so the statement is not kept in the statement cache
+        sqlite3_stmt* raw_stmt = nullptr;
+        details::prepare_checked(db, sql("DELETE FROM :table WHERE " + condition), &raw_stmt);
+        std::unique_ptr<sqlite3_stmt, decltype(&sqlite3_finalize)> stmt(raw_stmt,
+                                                                        &sqlite3_finalize);
+
+        if constexpr (sizeof...(Params) > 0)
         {
-            bool is_empty = _lazy_result->evaluated_num_rows() == 0;
-            bool reached_last_index = _current_index >= _lazy_result->evaluated_num_rows() - 1;
-            if (is_empty || reached_last_index)
-                _is_end = true;
+            int index = 1;
+            auto bind = [&](const auto& param)
+            {
+                using P = std::decay_t<decltype(param)>;
+                if constexpr (std::is_same_v<P, const char*> || std::is_same_v<P, char*>)
+                    details::bind_param_checked(stmt.get(), index++, std::string(param),
+                                                "Failed to bind parameter", db);
+                else
+                    details::bind_param_checked(stmt.get(), index++, param,
+                                                "Failed to bind parameter", db);
+            };
+            (bind(params), ...);
         }
-        return _is_end;
-    }
 
-    std::optional<size_type> _current_index;
-    std::shared_ptr<result_type> _lazy_result;
-    bool _is_end;
-};
-/**
- * @class const_sqlitemap_iterator
- * @brief Const iterator for iterating over database rows.
- *
- * This template class provides a const iterator for iterating over database rows,
- * which is the const version of sqlitemap_iterator.
- *
- * @tparam CODEC_PAIR The codec pair type used for encoding and decoding.
- * @tparam KV The key-value type used for database operations.
- * @tparam COL_OPT The column option used for database operations.
- *
- * const_sqlitemap_iterator is the const version of sqlitemap_iterator and follows the same
- * principles.
- */
-template <typename CODEC_PAIR, typename KV, column_option COL_OPT> class const_sqlitemap_iterator
-{
-  public:
-    using base_iterator = sqlitemap_iterator<CODEC_PAIR, KV, COL_OPT>;
-    using iterator_category = typename base_iterator::iterator_category;
-    using value_type = typename base_iterator::value_type;
-    using difference_type = typename base_iterator::difference_type;
-    using pointer = const value_type*;   // Pointer to const value
-    using reference = const value_type&; // Reference to const value
+        invalidate_all(); // matching keys are not known in advance
+        return execute_delete(stmt.get());
+    }
 
-    const_sqlitemap_iterator(sqlite3* db, const std::string& query,
-                             const configuration<CODEC_PAIR>* config)
-        : base_iter_(db, query, config)
+    // Erases all entries with keys in the half-open interval [from, to). Returns number of erased
+    // entries
+    size_type erase_range(const key_type& from, const key_type& to)
     {
+        if (is_read_only())
+            throw sqlitemap_error("Refusing to erase from read-only sqlitemap");
+
+        flush();
+
+        auto stmt = statement("DELETE FROM :table WHERE key >= ? AND key < ?");
+        details::bind_param_checked(stmt.get(), 1, encode_key(from), "Failed to bind key", db);
+        details::bind_param_checked(stmt.get(), 2, encode_key(to), "Failed to bind key", db);
+
+        invalidate_all(); // matching keys are not known in advance
+        return execute_delete(stmt.get());
     }
 
-    const_sqlitemap_iterator(value_type&& row, const configuration<CODEC_PAIR>* config)
-        : base_iter_(std::move(row), config)
+    node_type extract(const key_type& key)
     {
-    }
+        if (is_read_only())
+            throw sqlitemap_error("Refusing to extract from read-only sqlitemap");
 
-    const_sqlitemap_iterator() = default;
+        auto value = try_get(key);
+        if (value)
+        {
+            del(key);
+            return node_type(key, std::move(*value));
+        }
 
-    reference operator*() const
-    {
-        return base_iter_.operator*();
+        return node_type();
     }
-    pointer operator->() const
+
+    node_type extract(const_iterator position)
     {
-        return &(operator*());
+        if (is_read_only())
+            throw sqlitemap_error("Refusing to extract from read-only sqlitemap");
+
+        if (position != cend())
+        {
+            return extract(position->first);
+        }
+
+        return node_type();
     }
-    const_sqlitemap_iterator& operator++()
+
+    // Keys are ordered the way SQLite orders their encoded representation, i.e. numerically for
+    // INTEGER and REAL, by bytes for TEXT and BLOB. Range lookups are index seeks on the primary
+    // key. All of them return iterators in ascending key order that end at end().
+
+    // Returns iterator starting at the first key that is not less than key
+    iterator lower_bound(const key_type& key)
     {
-        ++base_iter_;
-        return *this;
+        return ordered_range<iterator>("key >= ?", {encode_key(key)});
     }
 
-    const_sqlitemap_iterator operator+(difference_type n)
+    const_iterator lower_bound(const key_type& key) const
     {
-        for (int i = 0; i < n; i++)
-            ++base_iter_;
-        return *this;
+        return ordered_range<const_iterator>("key >= ?", {encode_key(key)});
     }
 
-    bool operator==(const const_sqlitemap_iterator& other) const
+    // Returns iterator starting at the first key that is greater than key
+    iterator upper_bound(const key_type& key)
     {
-        return base_iter_ == other.base_iter_;
+        return ordered_range<iterator>("key > ?", {encode_key(key)});
     }
 
-    bool operator!=(const const_sqlitemap_iterator& other) const
+    const_iterator upper_bound(const key_type& key) const
     {
-        return base_iter_ != other.base_iter_;
+        return ordered_range<const_iterator>("key > ?", {encode_key(key)});
     }
 
-  private:
-    base_iterator base_iter_;
-};
-
-inline std::vector<std::string> get_tablenames(const std::string& filename)
-{
-    if (!std::filesystem::exists(filename))
-        throw sqlitemap_error("File " + filename + " does not exist");
-
-    sqlite3* db;
-    int rc = sqlite3_open(filename.c_str(), &db);
-    details::check_ok(rc, "Cannot open database at " + filename, db);
-
-    sqlite3_stmt* stmt = nullptr;
-    auto sql = R"(SELECT name FROM sqlite_master WHERE type="table")";
-    details::prepare_checked(db, sql, &stmt);
-
-    std::vector<std::string> tables;
-
-    try
+    // Returns range of all keys within [from, to)
+    std::pair<iterator, iterator> range(const key_type& from, const key_type& to)
     {
-        int rc = sqlite3_step(stmt);
-        while (rc == SQLITE_ROW)
-        {
-            auto table = details::column_value<std::string>(stmt, 0);
-            tables.push_back(table);
-
-            rc = sqlite3_step(stmt);
-        }
-
-        details::check_done(rc);
+        auto condition = "key >= ? AND key < ?";
+        return {ordered_range<iterator>(condition, {encode_key(from), encode_key(to)}), end()};
     }
-    catch (const std::exception& e)
+
+    std::pair<const_iterator, const_iterator> range(const key_type& from,
+                                                    const key_type& to) const
     {
-        sqlite3_finalize(stmt);
-        throw;
+        auto condition = "key >= ? AND key < ?";
+        return {ordered_range<const_iterator>(condition, {encode_key(from), encode_key(to)}),
+                end()};
     }
 
-    sqlite3_finalize(stmt);
-    return tables;
-}
-
-template <typename K, typename V> struct sqlitemap_node_type
-{
-    using value_type = std::optional<std::pair<K, V>>;
-    sqlitemap_node_type()
+    // Returns range of all entries matching key, which is at most one as keys are unique
+    std::pair<iterator, iterator> equal_range(const key_type& key)
     {
+        return {ordered_range<iterator>("key = ?", {encode_key(key)}), end()};
     }
 
-    sqlitemap_node_type(K key, V&& value)
-        : kv({key, value})
+    std::pair<const_iterator, const_iterator> equal_range(const key_type& key) const
     {
+        return {ordered_range<const_iterator>("key = ?", {encode_key(key)}), end()};
     }
 
-    K& key()
+    // Returns true when a transaction is currently open on the connection
+    bool in_transaction() const
     {
-        return kv->first;
+        return db && sqlite3_get_autocommit(db) == 0;
     }
 
-    V& mapped()
+    // Writes all pending writes of the write-behind buffer within one savepoint, which is a
+    // transaction on its own when auto_commit is enabled. Pending writes are kept when flushing
+    // fails, so that a later flush(), commit() or close() can write them again.
+    void flush()
     {
-        return kv->second;
+        if (!_pending || _pending->empty())
+            return;
+
+        const auto& pending = _pending->entries();
+        in_savepoint(
+            [&]
+            {
+                auto replace_stmt = statement("REPLACE INTO :table (key, value) VALUES (?,?)");
+                auto delete_stmt = statement("DELETE FROM :table WHERE key = ?");
+
+                for (const auto& [encoded_key, encoded_value] : pending)
+                {
+                    auto stmt = encoded_value ? replace_stmt.get() : delete_stmt.get();
+                    // pending writes outlive both statements
+                    details::bind_param_checked(stmt, 1, encoded_key, "Failed to bind key", db,
+                                                SQLITE_STATIC);
+                    if (encoded_value)
+                        details::bind_param_checked(stmt, 2, *encoded_value,
+                                                    "Failed to bind value", db, SQLITE_STATIC);
+
+                    details::check_done(sqlite3_step(stmt), db);
+                    sqlite3_reset(stmt);
+                }
+            });
+        log().trace("Flushed " + std::to_string(pending.size()) + " pending writes");
+        _pending->clear();
     }
 
-    operator bool() const
+    void begin_transaction()
     {
-        return kv.operator bool();
+        flush();
+        if (!in_transaction())
+            begin_transaction_impl();
     }
 
-  private:
-    value_type kv;
-};
+    void commit()
+    {
+        auto meter = metered(metric_operation::commit);
+        flush();
 
-/**
- * @class sqlitemap
- * @brief High-level C++ interface for SQLite-based key-value maps with codec support.
- *
- * This template class provides a flexible, type-safe, and efficient interface for managing
- * key-value data in a SQLite database. It supports custom codecs for encoding/decoding keys
- * and values, allowing seamless integration with a variety of C++ types and database schemas.
- *
- * The class exposes STL-like map operations, including insertion, lookup, deletion, and iteration.
- * It supports both mutable and const iterators for traversing key-value pairs, keys, or values.
- *
- * Key features:
- *   - Customizable key/value codecs via the CODEC_PAIR template parameter
- *   - STL-style interface (find, insert, erase, begin/end iterators, etc.)
- *   - Efficient lazy evaluation and caching of query results
- *   - Strong type safety for all operations
- *   - Integration with custom configuration objects
- *
- * @tparam CODEC_PAIR The codec pair type used for encoding and decoding keys and values.
- * Defaults to the codec pair from the global config().
- *
- *
- * @note Only single-pass iteration is supported to enable lazy evaluation and caching of query
- * results. As a result, iterators returned by STL-like operations are intended solely for data
- * access; advancing or reusing them in multiple passes is not supported.
- */
-template <typename CODEC_PAIR = decltype(config().codecs())> class sqlitemap
-{
-  public:
-    using key_type = typename CODEC_PAIR::key_in_type;
-    using mapped_type = typename CODEC_PAIR::value_in_type; // type that corresponds to value in db
-    using value_type = std::pair<key_type, mapped_type>;    // important!  tuple of (key,value)
-    using node_type = sqlitemap_node_type<key_type, mapped_type>;
-    using db_key_type = typename CODEC_PAIR::key_out_type;
-    using db_mapped_type = typename CODEC_PAIR::value_out_type;
-    using size_type = size_t;
+        // details::exec_checked(db, "COMMIT");
+        int rc = sqlite3_exec(db, "COMMIT", nullptr, nullptr, nullptr);
+    }
 
-    using iterator = sqlitemap_iterator<CODEC_PAIR, value_type, column_option::key_value>;
-    using const_iterator =
-        const_sqlitemap_iterator<CODEC_PAIR, value_type, column_option::key_value>;
+    void rollback()
+    {
+        auto meter = metered(metric_operation::rollback);
+        // with auto_commit every write counts as committed, so pending writes are not discarded
+        if (config().auto_commit())
+            flush();
+        else if (_pending)
+            _pending->clear();
 
-    using key_iterator = sqlitemap_iterator<CODEC_PAIR, key_type, column_option::key>;
-    using const_key_iterator = const_sqlitemap_iterator<CODEC_PAIR, key_type, column_option::key>;
+        // cached values might have been written or read within the discarded transaction
+        invalidate_all();
 
-    using value_iterator = sqlitemap_iterator<CODEC_PAIR, mapped_type, column_option::value>;
-    using const_value_iterator =
-        const_sqlitemap_iterator<CODEC_PAIR, mapped_type, column_option::value>;
+        // details::exec_checked(db, "ROLLBACK");
+        int rc = sqlite3_exec(db, "ROLLBACK", nullptr, nullptr, nullptr);
+    }
 
-    struct sqlitemap_insert_return_type
+    void close()
     {
-        iterator position; // Iterator to the inserted element or the existing one
-        bool inserted;     // True if insertion happened, false if key already exists
-        node_type node;    // The node, if insertion didn't happen (ownership is returned)
-    };
-    using insert_return_type = sqlitemap_insert_return_type;
+        if (!db)
+            return;
 
-    template <typename K = key_type, typename V = mapped_type> class value_ref
-    {
-      public:
-        value_ref(sqlitemap<CODEC_PAIR>* map, const K& key, V value)
-            : _map(map)
-            , _key(key)
-            , _val(value)
-        {
-        }
+        flush();
+        if (config().auto_commit())
+            commit();
 
-        value_ref& operator=(const value_ref& other) = delete;
+        // Prepared statements must be finalized before the connection can be closed
+        _statements->clear();
+        invalidate_all();
 
-        value_ref& operator=(V value)
+        // Close the database connection
+        sqlite3_close(db);
+        db = nullptr;
+        log().debug("Database closed");
+
+        if (in_temp())
         {
-            _map->set(_key, value);
-            _val = value;
-            return *this;
+            try
+            {
+                std::filesystem::remove(_config.filename());
+                log().debug("Database file '" + config().filename() + "' removed");
+            }
+            catch (std::exception& ex)
+            {
+                /**/
+            }
         }
+    }
 
-        operator V() const
+    // Delete the underlying database file. Use with care.
+    void terminate()
+    {
+        if (is_read_only())
+            throw sqlitemap_error("Refusing to terminate read-only sqlitemap");
+
+        close();
+
+        if (config().filename() == ":memory:")
+            return;
+
+        log().debug("Deleting " + config().filename());
+
+        try
         {
-            return _val;
+            std::string file = _config.filename();
+            if (std::filesystem::exists(file))
+                std::filesystem::remove(file);
         }
-
-        bool operator==(const V& other_value)
+        catch (const std::exception& e)
         {
-            return _val == other_value;
+            log().error("Failed to delete " + config().filename());
         }
+    }
 
-      private:
-        sqlitemap<CODEC_PAIR>* _map;
-        K _key;
-        V _val;
+    // Hit/miss counters and current usage of the value cache, cf. configuration::value_cache_size
+    value_cache_stats cache_stats() const
+    {
+        return _values ? _values->stats() : value_cache_stats{};
+    }
 
-        friend std::ostream& operator<<(std::ostream& os, const value_ref& ref)
-        {
-            os << ref._val;
-            return os;
-        }
-    };
+    // Page cache and memory usage reported by SQLite, as well as the work done by each statement
+    // shape of the statement cache, e.g. to tune cache_size and mmap_size or to spot full scans
+    sqlite_stats stats() const
+    {
+        return details::collect_stats(db, _statements->stats());
+    }
 
-    sqlitemap(std::string filename = default_filename, std::string table = default_table,
-              operation_mode mode = default_mode, bool auto_commit = default_auto_commit,
-              log_level log_level = default_log_level)
-        : sqlitemap(bw::sqlitemap::config() // use default configuration
-                        .filename(filename)
-                        .table(table)
-                        .mode(mode)
-                        .auto_commit(auto_commit)
-                        .log_level(log_level))
+    // Snapshot of call counts, error counts and latency histograms of all operations, which are
+    // all zero when metrics are disabled, cf. configuration::metrics
+    metrics_snapshot metrics() const
+    {
+        return _metrics ? _metrics->snapshot() : metrics_snapshot{};
+    }
+
+    void reset_metrics()
     {
+        if (_metrics)
+            _metrics->reset();
     }
 
-    sqlitemap(configuration<CODEC_PAIR> config)
-        : _config(std::move(config))
+    const configuration<CODEC_PAIR>& config() const
     {
-        log().set_level(_config.log_level());
-        if (_config.log_impl())
-            log().register_log_impl(_config.log_impl());
+        return _config;
+    }
 
-        namespace fs = std::filesystem;
-        try
-        {
-            if (_config.filename().empty())
-            {
-                auto dir = fs::temp_directory_path();
-                auto file = details::generate_temp_filename();
-                _config.filename((dir / file).string());
-                _in_temp = true;
-            }
+    std::string to_string() const
+    {
+        return "sqlitemap(" + _config.filename() + ")";
+    }
 
-            if (_config.mode() == operation_mode::n && fs::exists(_config.filename()))
-                fs::remove(_config.filename());
-        }
-        catch (std::exception& ex)
-        {
-            throw sqlitemap_error(ex.what());
-        }
+    bool in_memory() const
+    {
+        return _config.filename() == ":memory:";
+    }
 
-        auto dir = fs::path(_config.filename()).parent_path();
-        if (dir.is_relative())
-            dir = fs::current_path() / dir;
+    bool in_temp() const
+    {
+        return _in_temp;
+    }
 
-        if (!in_memory() && !fs::exists(dir))
-            throw sqlitemap_error("The directory does not exist: " + dir.string());
+    bool is_read_only() const
+    {
+        return _config.mode() == operation_mode::r;
+    }
 
-        log().debug("sqlitemap - file: '" + _config.filename() + "' table: '" + _config.table() +
-                    "' sqlite3_libversion: " + sqlite3_libversion());
+    iterator begin()
+    {
+        std::string query = iteration_query("key, value", false);
+        return iterator(db, query, &_config, _metrics.get());
+    }
 
-        connect();
+    iterator end()
+    {
+        return iterator();
     }
 
-    ~sqlitemap()
+    const_iterator begin() const
     {
-        try
-        {
-            close();
-        }
-        catch (std::exception& ex)
-        {
-            log().error(std::string("Descruction of sqlitemap failed. Error: ") + ex.what());
-        }
+        std::string query = iteration_query("key, value", false);
+        return const_iterator(db, query, &_config, _metrics.get());
     }
 
-    void open_database(const std::string& file)
+    const_iterator end() const
     {
-        try
-        {
-            int rc = SQLITE_ERROR;
-            if (is_read_only())
-            {
-                // open database but do not create one if missing
-                rc = sqlite3_open_v2(file.c_str(), &db, SQLITE_OPEN_READONLY, nullptr);
-            }
-            else
-            {
-                // open or create the database
-                rc = sqlite3_open(file.c_str(), &db);
-            }
+        return const_iterator();
+    }
 
-            details::check_ok(rc, "Cannot open database", db);
-            log().debug("Database '" + config().filename() + "' opened successfully!");
-        }
-        catch (const std::exception& e)
-        {
-            sqlite3_close(db);
-            throw;
-        }
+    const_iterator cbegin() const
+    {
+        return begin();
     }
 
-    // Connects to the underlying database and initializes the table if required. Throws exception
-    // in error cases.
-    void connect()
+    const_iterator cend() const
     {
-        using namespace codecs;
+        return end();
+    }
 
-        try
-        {
-            open_database(config().filename());
+    iterator rbegin()
+    {
+        std::string query = iteration_query("key, value", true);
+        return iterator(db, query, &_config, _metrics.get());
+    }
 
-            if (is_read_only())
-            {
-                std::vector<std::string> tables = get_tablenames(config().filename());
-                if (std::find(tables.begin(), tables.end(), config().table()) == tables.end())
-                {
-                    std::string error_message = "Refusing to create a new table '" +
-                                                config().table() + "' in read-only DB mode";
-                    throw sqlitemap_error(error_message);
-                }
-            }
+    iterator rend()
+    {
+        return iterator();
+    }
 
-            // execute pragma statements
-            for (const auto& pragma_statement : config().pragmas())
-            {
-                details::exec_checked(db, pragma_statement);
-            }
+    const_iterator rbegin() const
+    {
+        std::string query = iteration_query("key, value", true);
+        return const_iterator(db, query, &_config, _metrics.get());
+    }
 
-            // create table if missing
-            auto key_type = codecs::to_string(sqlite_storage_class_from_type<db_key_type>());
-            auto value_type = codecs::to_string(sqlite_storage_class_from_type<db_mapped_type>());
-            auto create_table_sql = sql("CREATE TABLE IF NOT EXISTS :table (key " + key_type +
-                                        " PRIMARY KEY, value " + value_type + ")");
+    const_iterator rend() const
+    {
+        return const_iterator();
+    }
 
-            details::exec_checked(db, create_table_sql);
-            commit();
-            log().debug("Table '" + config().table() + "' created successfully");
+    const_iterator crbegin() const
+    {
+        return rbegin();
+    }
 
-            if (config().mode() == operation_mode::w)
-            {
-                clear();
-            }
-        }
-        catch (const std::exception& e)
-        {
-            sqlite3_close(db);
-            throw;
-        }
+    const_iterator crend() const
+    {
+        return rend();
     }
 
-    // Get the underlying SQLite connection object, this is used for advanced users
-    // who want to use the connection directly to execute custom queries
-    sqlite3* get_connection() const
+    key_iterator keys_begin()
     {
-        return db;
+        std::string query = iteration_query("key", false);
+        return key_iterator(db, query, &_config, _metrics.get());
     }
 
-    void set(const key_type& key, const mapped_type& value)
+    key_iterator keys_end()
     {
-        if (is_read_only())
-            throw sqlitemap_error("Refusing to write to read-only sqlitemap");
+        return key_iterator();
+    }
 
-        sqlite3_stmt* stmt = nullptr;
-        auto set_sql = sql("REPLACE INTO :table (key, value) VALUES (?,?)");
-        details::prepare_checked(db, set_sql, &stmt);
+    key_iterator keys_rbegin()
+    {
+        std::string query = iteration_query("key", true);
+        return key_iterator(db, query, &_config, _metrics.get());
+    }
 
-        try
-        {
-            auto encoded_key = _config.codecs().key_codec.encode(key);
-            details::bind_param_checked(stmt, 1, encoded_key, "Failed to bind key", db);
+    key_iterator keys_rend()
+    {
+        return key_iterator();
+    }
 
-            auto encoded_value = _config.codecs().value_codec.encode(value);
-            details::bind_param_checked(stmt, 2, encoded_value, "Failed to bind value", db);
+    const_key_iterator keys_cbegin()
+    {
+        std::string query = iteration_query("key", false);
+        return const_key_iterator(db, query, &_config, _metrics.get());
+    }
 
-            // sqlite auto commits changes when _no_ transactions was started by user
-            if (!config().auto_commit())
-                begin_transaction();
+    const_key_iterator keys_cend()
+    {
+        return const_key_iterator();
+    }
 
-            details::check_done(sqlite3_step(stmt), db);
-            sqlite3_finalize(stmt);
-        }
-        catch (const std::exception& e)
-        {
-            // clean up and rethrow the exception
-            sqlite3_finalize(stmt);
-            throw;
-        }
+    const_key_iterator keys_crbegin()
+    {
+        std::string query = iteration_query("key", true);
+        return const_key_iterator(db, query, &_config, _metrics.get());
     }
 
-    // get value associated with key. Throws a sqliteman_error when key does not exist
-    // also cf. try_get for a not throwing alternative
-    mapped_type get(const key_type& key) const
+    const_key_iterator keys_crend()
     {
-        try
-        {
-            return try_get(key).value();
-        }
-        catch (const std::bad_optional_access& e)
-        {
-            throw sqlitemap_error("Key '" + details::as_string_or(key) + "' not found in database");
-        }
+        return const_key_iterator();
+    }
+    value_iterator values_begin()
+    {
+        std::string query = iteration_query("value", false);
+        return value_iterator(db, query, &_config, _metrics.get());
     }
 
-    // get optional value associated with key.
-    std::optional<mapped_type> try_get(const key_type& key) const
+    value_iterator values_end()
     {
-        sqlite3_stmt* stmt = nullptr;
-        auto get_sql = sql("SELECT value FROM :table WHERE key = ?");
-        details::prepare_checked(db, get_sql, &stmt);
+        return value_iterator();
+    }
 
-        try
-        {
-            auto encoded_key = _config.codecs().key_codec.encode(key);
-            details::bind_param_checked(stmt, 1, encoded_key, "Failed to bind key", db);
+    value_iterator values_rbegin()
+    {
+        std::string query = iteration_query("value", true);
+        return value_iterator(db, query, &_config, _metrics.get());
+    }
 
-            int rc = sqlite3_step(stmt);
-            if (rc == SQLITE_DONE)
-            {
-                sqlite3_finalize(stmt);
-                return std::nullopt;
-            }
-            details::require_return_code(rc, SQLITE_ROW, "Failed to execute statement", db);
+    value_iterator values_rend()
+    {
+        return value_iterator();
+    }
 
-            auto value = details::column_value<db_mapped_type>(stmt, 0);
-            sqlite3_finalize(stmt);
+    const_value_iterator values_cbegin()
+    {
+        std::string query = iteration_query("value", false);
+        return const_value_iterator(db, query, &_config, _metrics.get());
+    }
 
-            auto decoded_value = _config.codecs().value_codec.decode(value);
-            return decoded_value;
-        }
-        catch (const std::exception& e)
-        {
-            // clean up and rethrow the exception
-            sqlite3_finalize(stmt);
-            throw;
-        }
+    const_value_iterator values_cend()
+    {
+        return const_value_iterator();
     }
 
-    value_ref<key_type, mapped_type> at(const key_type& key)
+    const_value_iterator values_crbegin()
     {
-        return value_ref(this, key, get(key));
+        std::string query = iteration_query("value", true);
+        return const_value_iterator(db, query, &_config, _metrics.get());
     }
 
-    value_ref<key_type, mapped_type> operator[](const key_type& key)
+    const_value_iterator values_crend()
+    {
+        return const_value_iterator();
+    }
+
+    // configures a sql statement to use correct table by replacing :table with that one from
+    // configuration and put it in double quotes.
+    // e.g. 'select * from :table' => 'select * from "unnamed"'
+    std::string sql(const std::string& sql) const
     {
-        try
-        {
-            return at(key);
-        }
-        catch (std::exception& ex)
+        const std::string placeholder = ":table";
+        const std::string replacement = details::quote_identifier(_config.table());
+        std::string output = sql;
+
+        size_t pos = 0;
+        while ((pos = output.find(placeholder, pos)) != std::string::npos)
         {
-            auto default_value = mapped_type();
-            set(key, default_value);
-            return value_ref(this, key, default_value);
+            output.replace(pos, placeholder.length(), replacement);
+            pos += replacement.length();
         }
+
+        return output;
     }
 
-    void del(const key_type& key)
+    logger& log()
     {
-        if (is_read_only())
-            throw sqlitemap_error("Refusing to delete from read-only sqlitemap");
+        return *_logger;
+    }
 
-        sqlite3_stmt* stmt = nullptr;
-        auto del_sql = sql("DELETE FROM :table WHERE key = ?");
-        details::prepare_checked(db, del_sql, &stmt);
+  private:
+    // async_sqlitemap streams scans through iterators recording into the metrics of its map
+    template <typename> friend class async_sqlitemap;
 
-        try
+    // Applies the pragmas of a performance profile and validates them by reading back the values
+    // SQLite actually uses, e.g. in-memory databases do not support WAL journal mode.
+    void apply_profile(performance_profile profile)
+    {
+        auto name = bw::sqlitemap::to_string(profile);
+        std::string applied;
+        for (const auto& [flag, value] : details::profile_pragmas(profile))
         {
-            auto encoded_key = _config.codecs().key_codec.encode(key);
-            details::bind_param_checked(stmt, 1, encoded_key, "Failed to bind key", db);
+            // failures are not thrown but reported by the validation below
+            auto pragma_sql = "PRAGMA " + flag + " = " + value;
+            sqlite3_exec(db, pragma_sql.c_str(), nullptr, nullptr, nullptr);
 
-            // sqlite auto commits changes when _no_ transactions was started by user
-            if (!config().auto_commit())
-                begin_transaction();
+            auto actual = details::pragma_value(db, flag).value_or("");
+            std::transform(actual.begin(), actual.end(), actual.begin(),
+                           [](unsigned char c) { return std::tolower(c); });
 
-            details::check_done(sqlite3_step(stmt), db);
-            sqlite3_finalize(stmt);
-        }
-        catch (const std::exception& e)
-        {
-            // Clean up and rethrow the exception
-            sqlite3_finalize(stmt);
-            throw;
+            if (actual != value)
+                log().warn("Performance profile '" + name + "' requires " + flag + " = " + value +
+                           ", but SQLite uses '" + actual + "'");
+
+            applied += (applied.empty() ? "" : ", ") + flag + " = " + actual;
         }
+        log().debug("Performance profile '" + name + "' applied: " + applied);
     }
 
-    size_t size() const
+    // Creates triggers which keep the number of rows of the table up to date. Rows replaced by
+    // REPLACE INTO only fire delete triggers when PRAGMA recursive_triggers is enabled, so the
+    // triggers counting inserts depend on the setting of the writing connection. Without it, a
+    // trigger before the insert only counts keys not existing yet, otherwise a trigger after the
+    // insert counts every row actually inserted.
+    void init_row_counter()
     {
-        // `select count (*)` is super slow in sqlite but ok for now?
+        auto counts = std::string(details::row_counts_table);
+        auto table = details::quote_literal(config().table());
+        auto insert_trigger = "_sqlitemap_count_insert_" + config().table();
+        auto recursive_insert_trigger = "_sqlitemap_count_recursive_insert_" + config().table();
+        auto delete_trigger = "_sqlitemap_count_delete_" + config().table();
+
+        auto num_triggers_sql = "SELECT COUNT(*) FROM sqlite_master WHERE type = 'trigger' AND "
+                                "name IN (" +
+                                details::quote_literal(insert_trigger) + ", " +
+                                details::quote_literal(recursive_insert_trigger) + ", " +
+                                details::quote_literal(delete_trigger) + ")";
 
+        int num_triggers = 0;
         auto count_callback = [](void* count_ptr, int argc, char** argv, char** col_name)
         {
-            int* row_count = (int*)count_ptr;
-            *row_count = atoi(argv[0]); // The result of COUNT(*) is in the first column
+            *static_cast<int*>(count_ptr) = std::atoi(argv[0]);
             return 0;
         };
+        details::exec_checked(db, num_triggers_sql, count_callback, &num_triggers);
 
-        int row_count = 0;
-        auto count_sql = sql("SELECT COUNT(*) FROM :table");
-        details::exec_checked(db, count_sql, count_callback, &row_count);
-
-        return row_count;
-    }
+        if (num_triggers < 3 && !is_read_only())
+        {
+            auto ident = sql(":table");
+            auto recursive = std::string("(SELECT recursive_triggers FROM "
+                                         "pragma_recursive_triggers)");
+            auto init_sql =
+                "SAVEPOINT sqlitemap_row_counter;"
+                "CREATE TABLE IF NOT EXISTS " + counts +
+                " (tbl TEXT PRIMARY KEY, num_rows INTEGER NOT NULL);"
+                "REPLACE INTO " + counts + " (tbl, num_rows) SELECT " + table +
+                ", COUNT(*) FROM " + ident + ";"
+                "CREATE TRIGGER IF NOT EXISTS " + details::quote_identifier(insert_trigger) +
+                " BEFORE INSERT ON " + ident + " WHEN NOT " + recursive + " BEGIN UPDATE " +
+                counts + " SET num_rows = num_rows + 1 - EXISTS(SELECT 1 FROM " + ident +
+                " WHERE key = NEW.key) WHERE tbl = " + table + "; END;"
+                "CREATE TRIGGER IF NOT EXISTS " +
+                details::quote_identifier(recursive_insert_trigger) + " AFTER INSERT ON " +
+                ident + " WHEN " + recursive + " BEGIN UPDATE " + counts +
+                " SET num_rows = num_rows + 1 WHERE tbl = " + table + "; END;"
+                "CREATE TRIGGER IF NOT EXISTS " + details::quote_identifier(delete_trigger) +
+                " AFTER DELETE ON " + ident + " BEGIN UPDATE " + counts +
+                " SET num_rows = num_rows - 1 WHERE tbl = " + table + "; END;"
+                "RELEASE sqlitemap_row_counter;";
+
+            details::exec_checked(db, init_sql);
+            num_triggers = 3;
+            log().debug("Row counter for table '" + config().table() + "' initialized");
+        }
 
-    bool empty() const
-    {
-        return size() == 0;
+        _row_counter_active = num_triggers >= 3;
+        if (!_row_counter_active)
+            log().warn("Row counter for table '" + config().table() + "' is not available");
     }
 
-    std::pair<iterator, bool> insert(const value_type& kv)
+    // Buffers a write, a std::nullopt value marks a delete. Pending writes are flushed when one of
+    // the write-behind thresholds is reached.
+    void buffer_write(const db_key_type& encoded_key, std::optional<db_mapped_type> encoded_value)
     {
-        if (is_read_only())
-            throw sqlitemap_error("Refusing to insert into read-only sqlitemap");
-
-        auto mapped = try_get(kv.first);
-        if (mapped)
-            return {find(kv.first), false};
+        _pending->put(encoded_key, std::move(encoded_value));
 
-        set(kv.first, kv.second);
-        return {find(kv.first), true};
+        if (_pending->size() >= config().write_behind_rows() ||
+            _pending->num_bytes() >= config().write_behind_bytes())
+            flush();
     }
 
-    std::pair<iterator, bool> insert(value_type&& kv)
+    // Point reads consult the write-behind buffer, reads never flush it
+    const std::optional<db_mapped_type>* find_pending(const db_key_type& encoded_key) const
     {
-        return insert(kv);
+        return _pending ? _pending->find(encoded_key) : nullptr;
     }
 
-    insert_return_type insert(node_type&& node)
+    // Opens incremental BLOB I/O on the value column of the row of key
+    blob_handle open_blob(const key_type& key, bool writable) const
     {
-        if (is_read_only())
-            throw sqlitemap_error("Refusing to insert into read-only sqlitemap");
+        static_assert(supports_blob_handles,
+                      "Incremental BLOB I/O requires blob values stored by value_codec<blob>()");
 
-        if (!node)
-            return {end(), false, std::move(node)};
+        sqlite3_int64 rowid = 0;
+        {
+            auto stmt = statement("SELECT rowid FROM :table WHERE key = ?");
+            details::bind_param_checked(stmt.get(), 1, encode_key(key), "Failed to bind key", db);
 
-        auto result = insert({node.key(), node.mapped()});
-        return {result.first, result.second, result.second ? node_type() : std::move(node)};
+            int rc = sqlite3_step(stmt.get());
+            if (rc == SQLITE_DONE)
+                throw sqlitemap_error("Key '" + details::as_string_or(key) +
+                                      "' not found in database");
+
+            details::require_return_code(rc, SQLITE_ROW, "Failed to execute statement", db);
+            rowid = sqlite3_column_int64(stmt.get(), 0);
+        }
+
+        sqlite3_blob* handle = nullptr;
+        int rc = sqlite3_blob_open(db, "main", config().table().c_str(), "value", rowid,
+                                   writable ? 1 : 0, &handle);
+        if (rc != SQLITE_OK)
+        {
+            sqlite3_blob_close(handle);
+            details::check_ok(rc, "Failed to open blob", db);
+        }
+
+        // the cache is owned by a unique_ptr, so it stays valid when the map is moved
+        std::function<void()> on_write;
+        if (writable && _values)
+            on_write = [cache = _values.get(), encoded_key = encode_key(key)]
+            { cache->erase(encoded_key); };
+
+        return blob_handle(db, handle, std::move(on_write));
     }
 
-    void insert(std::initializer_list<std::pair<const key_type, mapped_type>> list)
+    // Removes the cached value of a key which is about to be written
+    void invalidate(const db_key_type& encoded_key)
     {
-        return insert(list.begin(), list.end());
+        if (_values)
+            _values->erase(encoded_key);
     }
 
-    template <typename _InputIterator> void insert(_InputIterator __first, _InputIterator __last)
+    void invalidate_all()
     {
-        if (is_read_only())
-            throw sqlitemap_error("Refusing to insert into read-only sqlitemap");
-
-        for (; __first != __last; ++__first)
-        {
-            if (!contains(__first->first))
-                set(__first->first, __first->second);
-        }
+        if (_values)
+            _values->clear();
     }
 
-    template <typename Object>
-    std::pair<iterator, bool> insert_or_assign(const key_type& key, Object&& value)
+    // Executes a bound DELETE statement and returns the number of deleted rows
+    size_type execute_delete(sqlite3_stmt* stmt)
     {
-        if (is_read_only())
-            throw sqlitemap_error("Refusing to write to read-only sqlitemap");
-
-        auto result = try_emplace(key, std::forward<Object>(value));
-        if (result.second)
-            return result;
+        // sqlite auto commits changes when _no_ transactions was started by user
+        if (!config().auto_commit() && !in_transaction())
+            begin_transaction();
 
-        set(key, std::forward<Object>(value));
-        return {find(key), false};
+        details::check_done(sqlite3_step(stmt), db);
+        return sqlite3_changes(db);
     }
 
-    template <typename Object>
-    std::pair<iterator, bool> insert_or_assign(key_type&& key, Object&& value)
+    // Query over all rows selecting columns in the configured iteration order. WITHOUT ROWID
+    // tables are stored in key order, so their insertion order falls back to key order.
+    std::string iteration_query(const std::string& columns, bool reverse) const
     {
-        if (is_read_only())
-            throw sqlitemap_error("Refusing to write to read-only sqlitemap");
-
-        auto result = try_emplace(std::move(key), std::forward<Object>(value));
-        if (result.second)
-            return result;
+        std::string query = "SELECT " + columns + " FROM :table";
+        if (config().iteration_order() == iteration_order::key ||
+            _layout == table_layout::without_rowid)
+            query += reverse ? " ORDER BY key DESC" : " ORDER BY key";
+        else if (reverse)
+            query += " ORDER BY ROWID DESC";
 
-        set(std::move(key), std::forward<Object>(value));
-        return {find(key), false};
+        return sql(query);
     }
 
-    template <typename... Args> std::pair<iterator, bool> emplace(Args&&... args)
+    // Tables created by others may use a layout different from the configured one
+    table_layout detect_layout() const
     {
-        if (is_read_only())
-            throw sqlitemap_error("Refusing to write to read-only sqlitemap");
+        sqlite3_stmt* stmt = nullptr;
+        auto query = sql("SELECT rowid FROM :table LIMIT 0");
+        int rc = sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, nullptr);
+        sqlite3_finalize(stmt);
+        return rc == SQLITE_OK ? table_layout::rowid : table_layout::without_rowid;
+    }
 
-        return insert(std::move(value_type(std::forward<Args>(args)...)));
+    // Incremental blob I/O addresses rows by their rowid
+    void require_rowid_layout() const
+    {
+        if (_layout == table_layout::without_rowid)
+            throw sqlitemap_error("Blob handles are not supported by WITHOUT ROWID tables");
     }
 
-    // As sqlitemap has unordered keys, the hint will be ignored so that this methods behavior is
-    // equal to calling emplace method directly.
-    template <typename... Args> iterator emplace_hint(const_iterator hint, Args&&... args)
+    db_key_type encode_key(const key_type& key) const
     {
-        if (is_read_only())
-            throw sqlitemap_error("Refusing to write to read-only sqlitemap");
+        return _config.codecs_ref().key_codec.encode(key);
+    }
 
-        return emplace(std::forward<Args>(args)...).first;
+    // Creates a key ordered iterator over all entries matching condition
+    template <typename IT>
+    IT ordered_range(const std::string& condition, std::vector<db_key_type> params) const
+    {
+        auto query = sql("SELECT key, value FROM :table WHERE " + condition + " ORDER BY key");
+        return IT(db, query, &_config, _metrics.get(), std::move(params));
     }
 
-    template <typename... Args>
-    std::pair<iterator, bool> try_emplace(const key_type& key, Args&&... args)
+    // Writes key-value pairs within one savepoint, so that either all or none of them get
+    // stored. Existing keys are only overwritten when replace is true.
+    template <typename _InputIterator>
+    bulk_result write_many(_InputIterator first, _InputIterator last, bool replace)
     {
-        if (is_read_only())
-            throw sqlitemap_error("Refusing to write to read-only sqlitemap");
+        flush();
 
-        if (contains(key))
-            return {find(key), false};
+        bulk_result result;
+        in_savepoint(
+            [&]
+            {
+                auto insert_stmt =
+                    statement("INSERT OR IGNORE INTO :table (key, value) VALUES (?,?)");
+                std::optional<details::statement_cache::handle> update_stmt;
 
-        return emplace(std::piecewise_construct,
-                       std::forward_as_tuple(key), //
-                       std::forward_as_tuple(std::forward<Args>(args)...));
+                for (; first != last; ++first)
+                {
+                    const auto& [key, value] = *first;
+                    decltype(auto) encoded_key = _config.codecs_ref().key_codec.encode(key);
+                    decltype(auto) encoded_value = _config.codecs_ref().value_codec.encode(value);
+                    invalidate(encoded_key);
+
+                    // bindings are cleared after each step, before the encoded values go away
+                    auto stmt = insert_stmt.get();
+                    details::bind_param_checked(stmt, 1, encoded_key, "Failed to bind key", db,
+                                                SQLITE_STATIC);
+                    details::bind_param_checked(stmt, 2, encoded_value, "Failed to bind value",
+                                                db, SQLITE_STATIC);
+                    details::check_done(sqlite3_step(stmt), db);
+                    sqlite3_reset(stmt);
+                    sqlite3_clear_bindings(stmt);
+
+                    if (sqlite3_changes(db) > 0)
+                    {
+                        result.inserted++;
+                        continue;
+                    }
+
+                    if (!replace)
+                        continue;
+
+                    if (!update_stmt)
+                        update_stmt.emplace(statement("UPDATE :table SET value = ? WHERE key = ?"));
+
+                    stmt = update_stmt->get();
+                    details::bind_param_checked(stmt, 1, encoded_value, "Failed to bind value",
+                                                db, SQLITE_STATIC);
+                    details::bind_param_checked(stmt, 2, encoded_key, "Failed to bind key", db,
+                                                SQLITE_STATIC);
+                    details::check_done(sqlite3_step(stmt), db);
+                    sqlite3_reset(stmt);
+                    sqlite3_clear_bindings(stmt);
+                    result.replaced++;
+                }
+            });
+        return result;
     }
 
-    template <typename... Args>
-    std::pair<iterator, bool> try_emplace(key_type&& key, Args&&... args)
+    // Runs work within a savepoint which is released on success and rolled back on failure.
+    // When auto_commit is disabled the surrounding transaction stays open like for set().
+    // Begins a transaction without flushing pending writes, which may become part of it
+    void begin_transaction_impl()
     {
-        if (is_read_only())
-            throw sqlitemap_error("Refusing to write to read-only sqlitemap");
+        details::exec_checked(db, "BEGIN TRANSACTION");
+    }
 
-        if (contains(key))
-            return {find(key), false};
+    template <typename Work> void in_savepoint(Work&& work)
+    {
+        if (!config().auto_commit() && !in_transaction())
+            begin_transaction_impl();
 
-        return emplace(std::piecewise_construct,
-                       std::forward_as_tuple(std::move(key)), //
-                       std::forward_as_tuple(std::forward<Args>(args)...));
+        details::exec_checked(db, "SAVEPOINT sqlitemap_bulk");
+        try
+        {
+            work();
+        }
+        catch (const std::exception& e)
+        {
+            sqlite3_exec(db, "ROLLBACK TO sqlitemap_bulk", nullptr, nullptr, nullptr);
+            sqlite3_exec(db, "RELEASE sqlitemap_bulk", nullptr, nullptr, nullptr);
+            throw;
+        }
+        details::exec_checked(db, "RELEASE sqlitemap_bulk");
     }
 
-    template <typename... Args>
-    iterator try_emplace(const_iterator hint, const key_type& key, Args&&... args)
+    // Provides a prepared statement for the given sql template from the statement cache. The
+    // :table placeholder will only be replaced when the statement has to be prepared.
+    details::statement_cache::handle statement(std::string_view shape) const
     {
-        if (is_read_only())
-            throw sqlitemap_error("Refusing to write to read-only sqlitemap");
-
-        if (contains(key))
-            return find(key);
+        return _statements->acquire(db, shape, [&] { return sql(std::string(shape)); });
+    }
 
-        return emplace_hint(hint, std::piecewise_construct,
-                            std::forward_as_tuple(key), //
-                            std::forward_as_tuple(std::forward<Args>(args)...));
+    // Registry of the metrics of this map, nullptr when metrics are disabled
+    details::metrics_registry* metrics_registry() const
+    {
+        return _metrics.get();
     }
 
-    template <typename... Args>
-    iterator try_emplace(const_iterator hint, key_type&& key, Args&&... args)
+    details::metered_scope metered(metric_operation operation) const
     {
-        if (is_read_only())
-            throw sqlitemap_error("Refusing to write to read-only sqlitemap");
+        return details::metered_scope(_metrics.get(), operation);
+    }
 
-        if (contains(key))
-            return find(key);
+    using value_cache = details::value_cache<db_key_type, mapped_type>;
+    using write_buffer = details::write_buffer<db_key_type, db_mapped_type>;
 
-        return emplace_hint(hint, std::piecewise_construct,
-                            std::forward_as_tuple(std::move(key)), //
-                            std::forward_as_tuple(std::forward<Args>(args)...));
-    }
+    sqlite3* db = nullptr;
+    configuration<CODEC_PAIR> _config;
+    bool _in_temp = false;
+    bool _row_counter_active = false;
+    table_layout _layout = default_table_layout; // actual layout of the table
+    std::shared_ptr<logger> _logger = std::make_shared<logger>(); // shared with _tracer
+    std::unique_ptr<details::statement_cache> _statements;
+    std::unique_ptr<value_cache> _values; // nullptr when value cache is disabled
+    std::unique_ptr<write_buffer> _pending; // nullptr when write-behind is disabled
+    std::unique_ptr<details::statement_tracer> _tracer; // nullptr when tracing is disabled
+    std::unique_ptr<details::metrics_registry> _metrics; // nullptr when metrics are disabled
+};
 
-    iterator find(const key_type& key)
+/**
+ * @class sqlitemap_pool
+ * @brief Thread-safe pool of sqlitemap connections to one database file.
+ *
+ * This template class opens one writer connection and a number of read-only connections to the
+ * same database file and table. The database is switched to WAL journal mode, so that readers do
+ * not block each other nor the writer. Readers are handed out exclusively as leases, writes are
+ * serialized through the single writer connection.
+ *
+ * @tparam CODEC_PAIR The codec pair type used for encoding and decoding keys and values.
+ *
+ * Each lease gives access to the full sqlitemap API of its connection. Readers only see committed
+ * changes of the writer, so the writer is usually configured with auto_commit(true).
+ */
+template <typename CODEC_PAIR = decltype(config().codecs())> class sqlitemap_pool
+{
+  public:
+    using map_type = sqlitemap<CODEC_PAIR>;
+    using key_type = typename map_type::key_type;
+    using mapped_type = typename map_type::mapped_type;
+
+    class reader_lease
     {
-        auto value = try_get(key);
-        if (value)
-            return iterator(std::make_pair(key, std::move(*value)), &_config);
+      public:
+        reader_lease(sqlitemap_pool* pool, map_type* map)
+            : _pool(pool)
+            , _map(map)
+        {
+        }
 
-        return end();
-    }
+        reader_lease(const reader_lease&) = delete;
+        reader_lease& operator=(const reader_lease&) = delete;
 
-    const_iterator find(const key_type& key) const
-    {
-        auto value = try_get(key);
-        if (value)
-            return const_iterator(std::make_pair(key, std::move(*value)), &_config);
+        reader_lease(reader_lease&& other) noexcept
+            : _pool(other._pool)
+            , _map(std::exchange(other._map, nullptr))
+        {
+        }
 
-        return cend();
-    }
+        ~reader_lease()
+        {
+            if (_map)
+                _pool->release(_map);
+        }
 
-    size_type count(const key_type& key) const
-    {
-        sqlite3_stmt* stmt = nullptr;
-        auto contains_sql = sql("SELECT EXISTS(SELECT 1 FROM :table WHERE key = ?)");
-        details::prepare_checked(db, contains_sql, &stmt);
+        const map_type& operator*() const
+        {
+            return *_map;
+        }
 
-        try
+        const map_type* operator->() const
         {
-            auto encoded_key = _config.codecs().key_codec.encode(key);
-            details::bind_param_checked(stmt, 1, encoded_key, "Failed to bind key", db);
+            return _map;
+        }
 
-            int rc = sqlite3_step(stmt);
-            details::require_return_code(rc, SQLITE_ROW, "Failed to execute statement", db);
+      private:
+        sqlitemap_pool* _pool;
+        map_type* _map;
+    };
 
-            auto contains = details::column_value<int>(stmt, 0);
-            sqlite3_finalize(stmt);
+    class writer_lease
+    {
+      public:
+        writer_lease(std::mutex& mutex, map_type* map)
+            : _lock(mutex)
+            , _map(map)
+        {
+        }
 
-            return contains;
+        map_type& operator*() const
+        {
+            return *_map;
         }
-        catch (const std::exception& e)
+
+        map_type* operator->() const
         {
-            // clean up and rethrow the exception
-            sqlite3_finalize(stmt);
-            throw;
+            return _map;
         }
-    }
 
-    bool contains(const key_type& key) const
-    {
-        return count(key);
-    }
+      private:
+        std::unique_lock<std::mutex> _lock;
+        map_type* _map;
+    };
 
-    void clear()
+    sqlitemap_pool(configuration<CODEC_PAIR> config,
+                   size_t num_readers = std::max(1u, std::thread::hardware_concurrency()))
     {
-        if (is_read_only())
-            throw sqlitemap_error("Refusing to clear read-only sqlitemap");
+        if (config.filename() == ":memory:")
+            throw sqlitemap_error("sqlitemap_pool requires a database file, not :memory:");
 
-        commit();
+        if (config.filename().empty() && config.mode() == operation_mode::r)
+            throw sqlitemap_error("Read-only sqlitemap_pool requires an existing database file");
 
-        auto clear_sql = sql("DELETE FROM :table");
-        details::exec_checked(db, clear_sql);
-        commit();
-    }
+        if (num_readers == 0)
+            throw sqlitemap_error("sqlitemap_pool requires at least one reader");
 
-    // Erases entry for a given key. Returns 0 when key does not exists, 1 otherwise
-    size_type erase(const key_type& key)
-    {
-        if (is_read_only())
-            throw sqlitemap_error("Refusing to erase from read-only sqlitemap");
+        if (config.mode() != operation_mode::r)
+        {
+            auto writer_config = config;
+            writer_config.pragma("journal_mode", "WAL");
+            _writer = std::make_unique<map_type>(std::move(writer_config));
 
-        if (!contains(key))
-            return 0;
+            // readers have to use the resolved file, e.g. when a temporary file is used
+            config.filename(_writer->config().filename());
+        }
 
-        del(key);
-        return 1;
+        // readers would not notice writes of the writer connection within their value caches
+        config.mode(operation_mode::r).value_cache_size(0);
+        for (size_t i = 0; i < num_readers; i++)
+        {
+            _readers.push_back(std::make_unique<map_type>(config));
+            _idle.push_back(_readers.back().get());
+        }
     }
 
-    // Erases entry when applies Predicate is true. Returns number of erased entries
-    template <typename Predicate> size_type erase_if(Predicate predicate)
+    sqlitemap_pool(const sqlitemap_pool&) = delete;
+    sqlitemap_pool& operator=(const sqlitemap_pool&) = delete;
+
+    ~sqlitemap_pool()
     {
-        if (is_read_only())
-            throw sqlitemap_error("Refusing to erase from read-only sqlitemap");
+        // readers have to be closed before writer, which might remove a temporary database file
+        _idle.clear();
+        _readers.clear();
+    }
 
-        size_t num_erased_elements = 0;
-        for (auto it = begin(); it != end(); ++it)
-        {
-            if (predicate(*it))
-                num_erased_elements += erase(it->first);
-        }
+    // Returns a read-only connection, blocks until one is available
+    reader_lease lease()
+    {
+        std::unique_lock<std::mutex> lock(_readers_mutex);
+        _reader_available.wait(lock, [this] { return !_idle.empty(); });
 
-        return num_erased_elements;
+        map_type* reader = _idle.back();
+        _idle.pop_back();
+        return reader_lease(this, reader);
     }
 
-    node_type extract(const key_type& key)
+    // Returns the writer connection, blocks until no other thread holds it
+    writer_lease writer()
     {
-        if (is_read_only())
-            throw sqlitemap_error("Refusing to extract from read-only sqlitemap");
+        if (!_writer)
+            throw sqlitemap_error("Refusing to write to read-only sqlitemap_pool");
 
-        auto value = try_get(key);
-        if (value)
-        {
-            del(key);
-            return node_type(key, std::move(*value));
-        }
+        return writer_lease(_writer_mutex, _writer.get());
+    }
 
-        return node_type();
+    template <typename F> auto read(F&& func)
+    {
+        auto reader = lease();
+        return func(*reader);
     }
 
-    node_type extract(const_iterator position)
+    template <typename F> auto write(F&& func)
     {
-        if (is_read_only())
-            throw sqlitemap_error("Refusing to extract from read-only sqlitemap");
+        auto w = writer();
+        return func(*w);
+    }
 
-        if (position != cend())
-        {
-            return extract(position->first);
-        }
+    std::optional<mapped_type> try_get(const key_type& key)
+    {
+        return lease()->try_get(key);
+    }
 
-        return node_type();
+    mapped_type get(const key_type& key)
+    {
+        return lease()->get(key);
     }
 
-    std::pair<iterator, iterator> equal_range(const key_type& key)
+    bool contains(const key_type& key)
     {
-        auto it = find(key);
-        return {it, it};
+        return lease()->contains(key);
     }
 
-    std::pair<const_iterator, const_iterator> equal_range(const key_type& key) const
+    void set(const key_type& key, const mapped_type& value)
     {
-        auto it = find(key);
-        return {it, it};
+        writer()->set(key, value);
     }
 
-    void begin_transaction()
+    void del(const key_type& key)
     {
-        // details::exec_checked(db, "BEGIN TRANSACTION");
-        int rc = sqlite3_exec(db, "BEGIN TRANSACTION", nullptr, nullptr, nullptr);
+        writer()->del(key);
     }
 
     void commit()
     {
-        // details::exec_checked(db, "COMMIT");
-        int rc = sqlite3_exec(db, "COMMIT", nullptr, nullptr, nullptr);
+        writer()->commit();
     }
 
-    void rollback()
+    size_t num_readers() const
     {
-        // details::exec_checked(db, "ROLLBACK");
-        int rc = sqlite3_exec(db, "ROLLBACK", nullptr, nullptr, nullptr);
+        return _readers.size();
     }
 
-    void close()
+  private:
+    void release(map_type* reader)
     {
-        if (config().auto_commit())
-            commit();
-
-        // Close the database connection
-        sqlite3_close(db);
-        log().debug("Database closed");
-
-        if (in_temp())
         {
-            try
-            {
-                std::filesystem::remove(_config.filename());
-                log().debug("Database file '" + config().filename() + "' removed");
-            }
-            catch (std::exception& ex)
-            {
-                /**/
-            }
+            std::lock_guard<std::mutex> lock(_readers_mutex);
+            _idle.push_back(reader);
         }
+        _reader_available.notify_one();
     }
 
-    // Delete the underlying database file. Use with care.
-    void terminate()
-    {
-        if (is_read_only())
-            throw sqlitemap_error("Refusing to terminate read-only sqlitemap");
-
-        close();
-
-        if (config().filename() == ":memory:")
-            return;
+    std::unique_ptr<map_type> _writer;
+    std::mutex _writer_mutex;
 
-        log().debug("Deleting " + config().filename());
+    std::vector<std::unique_ptr<map_type>> _readers;
+    std::vector<map_type*> _idle;
+    std::mutex _readers_mutex;
+    std::condition_variable _reader_available;
+};
 
+/**
+ * @class async_sqlitemap
+ * @brief Asynchronous front-end running a sqlitemap on a dedicated worker thread.
+ *
+ * This template class owns a sqlitemap, which is opened, used and closed exclusively by its
+ * worker thread, so callers never block on disk I/O. Operations are queued and either return a
+ * std::future or invoke a completion callback on the worker thread. Callbacks must not wait for
+ * other operations of the same async_sqlitemap, which would deadlock the worker.
+ *
+ * @tparam CODEC_PAIR The codec pair type used for encoding and decoding keys and values.
+ *
+ * The worker executes queued operations in batches of up to max_batch_size. With auto_commit
+ * enabled all writes of a batch are coalesced into one transaction, so a burst of writes costs
+ * one commit. Operations complete once their batch was committed and fail all together when the
+ * commit fails. Without auto_commit, changes have to be committed explicitly via async_commit.
+ * Pending operations are still executed when the async_sqlitemap is destroyed.
+ *
+ * Completion callbacks run on the worker thread unless an executor is given, which then receives
+ * each callback, e.g. to post it to the event loop of the caller. With C++20 coroutines the
+ * operations get, set, erase and commit are awaitable and scan returns a scan_stream, whose
+ * entries are awaited one by one. Awaiting coroutines are resumed through the executor as well.
+ */
+template <typename CODEC_PAIR = decltype(config().codecs())> class async_sqlitemap
+{
+  public:
+    using map_type = sqlitemap<CODEC_PAIR>;
+    using key_type = typename map_type::key_type;
+    using mapped_type = typename map_type::mapped_type;
+    using value_type = typename map_type::value_type;
+    using size_type = typename map_type::size_type;
+
+    // Receives completions ready to run, runs them itself or hands them over to another thread
+    using executor_type = std::function<void(std::function<void()>)>;
+
+    static constexpr size_t default_max_batch_size = 1000;
+    static constexpr size_t default_scan_chunk_size = 100;
+
+    // Opens the sqlitemap on the worker thread, errors while opening are rethrown here
+    async_sqlitemap(configuration<CODEC_PAIR> config,
+                    size_t max_batch_size = default_max_batch_size, executor_type executor = {})
+        : _max_batch_size(std::max<size_t>(1, max_batch_size))
+        , _executor(std::move(executor))
+    {
+        auto opened = std::make_shared<std::promise<void>>();
+        auto ready = opened->get_future();
+        _worker = std::thread([this, config = std::move(config), opened]() mutable
+                              { run(std::move(config), *opened); });
         try
         {
-            std::string file = _config.filename();
-            if (std::filesystem::exists(file))
-                std::filesystem::remove(file);
+            ready.get();
         }
-        catch (const std::exception& e)
+        catch (...)
         {
-            log().error("Failed to delete " + config().filename());
+            _worker.join();
+            throw;
         }
     }
 
-    const configuration<CODEC_PAIR>& config() const
-    {
-        return _config;
-    }
+    async_sqlitemap(const async_sqlitemap&) = delete;
+    async_sqlitemap& operator=(const async_sqlitemap&) = delete;
 
-    std::string to_string() const
+    ~async_sqlitemap()
     {
-        return "sqlitemap(" + _config.filename() + ")";
+        {
+            std::lock_guard<std::mutex> lock(_queue_mutex);
+            _stopping = true;
+        }
+        _queue_changed.notify_one();
+        _worker.join();
     }
 
-    bool in_memory() const
+    std::future<std::optional<mapped_type>> async_get(key_type key)
     {
-        return _config.filename() == ":memory:";
+        return submit_read([key = std::move(key)](const map_type& sm) { return sm.try_get(key); });
     }
 
-    bool in_temp() const
+    // done(std::optional<mapped_type> value, std::exception_ptr error)
+    template <typename Done> void async_get(key_type key, Done done)
     {
-        return _in_temp;
+        enqueue(false, [key = std::move(key)](map_type& sm) { return sm.try_get(key); },
+                callback_completion<std::optional<mapped_type>>(std::move(done)));
     }
 
-    bool is_read_only() const
+    std::future<void> async_set(key_type key, mapped_type value)
     {
-        return _config.mode() == operation_mode::r;
+        return submit([key = std::move(key), value = std::move(value)](map_type& sm)
+                      { sm.set(key, value); });
     }
 
-    iterator begin()
+    // done(std::exception_ptr error)
+    template <typename Done> void async_set(key_type key, mapped_type value, Done done)
     {
-        std::string query = sql("SELECT key, value FROM :table");
-        return iterator(db, query, &_config);
+        enqueue(true, [key = std::move(key), value = std::move(value)](map_type& sm)
+                { sm.set(key, value); },
+                callback_completion<void>(std::move(done)));
     }
 
-    iterator end()
+    // Resolves to the number of erased entries, which is 0 or 1
+    std::future<size_type> async_erase(key_type key)
     {
-        return iterator();
+        return submit([key = std::move(key)](map_type& sm) { return sm.erase(key); });
     }
 
-    const_iterator begin() const
+    // done(size_type num_erased, std::exception_ptr error)
+    template <typename Done> void async_erase(key_type key, Done done)
     {
-        std::string query = sql("SELECT key, value FROM :table");
-        return const_iterator(db, query, &_config);
+        enqueue(true, [key = std::move(key)](map_type& sm) { return sm.erase(key); },
+                callback_completion<size_type>(std::move(done)));
     }
 
-    const_iterator end() const
+    // Collects all entries with keys within [from, to) in ascending key order
+    std::future<std::vector<value_type>> async_scan(key_type from, key_type to)
     {
-        return const_iterator();
+        return submit_read([from = std::move(from), to = std::move(to)](const map_type& sm)
+                           { return scan(sm, from, to); });
     }
 
-    const_iterator cbegin() const
+    // done(std::vector<value_type> entries, std::exception_ptr error)
+    template <typename Done> void async_scan(key_type from, key_type to, Done done)
     {
-        return begin();
+        enqueue(false, [from = std::move(from), to = std::move(to)](map_type& sm)
+                { return scan(sm, from, to); },
+                callback_completion<std::vector<value_type>>(std::move(done)));
     }
 
-    const_iterator cend() const
+    // Collects all entries
+    std::future<std::vector<value_type>> async_scan()
     {
-        return end();
+        return submit_read([](const map_type& sm)
+                           { return std::vector<value_type>(sm.begin(), sm.end()); });
     }
 
-    iterator rbegin()
+    std::future<void> async_commit()
     {
-        std::string query = sql("SELECT key, value FROM :table ORDER BY ROWID DESC");
-        return iterator(db, query, &_config);
+        return submit([](map_type& sm) { sm.commit(); });
     }
 
-    iterator rend()
+    // Runs fn(map_type&) on the worker thread as part of a batch, resolves to its result
+    template <typename F> auto submit(F fn)
     {
-        return iterator();
+        return enqueue_promised(true, std::move(fn));
     }
 
-    const_iterator rbegin() const
+    // Like submit, fn(const map_type&) must not modify the map
+    template <typename F> auto submit_read(F fn)
     {
-        std::string query = sql("SELECT key, value FROM :table ORDER BY ROWID DESC");
-        return const_iterator(db, query, &_config);
+        return enqueue_promised(false, [fn = std::move(fn)](map_type& sm) { return fn(sm); });
     }
 
-    const_iterator rend() const
+    size_t max_batch_size() const
     {
-        return const_iterator();
+        return _max_batch_size;
     }
 
-    const_iterator crbegin() const
+#ifdef __cpp_lib_coroutine
+    /**
+     * @class awaitable
+     * @brief Awaitable result of an operation executed on the worker thread.
+     *
+     * The operation is queued once the awaiting coroutine suspends, which is resumed through the
+     * executor after the batch of the operation is done. Errors are rethrown by co_await.
+     */
+    template <typename R> class awaitable
     {
-        return rbegin();
-    }
+      public:
+        using result_type = R;
 
-    const_iterator crend() const
-    {
-        return rend();
-    }
+        awaitable(async_sqlitemap& owner, bool writes, std::function<R(map_type&)> fn)
+            : _owner(&owner)
+            , _writes(writes)
+            , _fn(std::move(fn))
+        {
+        }
 
-    key_iterator keys_begin()
-    {
-        std::string query = sql("SELECT key FROM :table");
-        return key_iterator(db, query, &_config);
-    }
+        // Creates an awaitable which is ready without suspending
+        template <typename T = R, typename = std::enable_if_t<!std::is_void_v<T>>>
+        explicit awaitable(T result)
+            : _ready(true)
+            , _result(std::move(result))
+        {
+        }
 
-    key_iterator keys_end()
-    {
-        return key_iterator();
-    }
+        bool await_ready() const noexcept
+        {
+            return _ready;
+        }
 
-    key_iterator keys_rbegin()
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            // handle may get resumed by the worker before enqueue returns, *this is not used after
+            _owner->enqueue(_writes, std::move(_fn),
+                            [this, handle](std::exception_ptr error, auto* result)
+                            {
+                                _error = error;
+                                if constexpr (!std::is_void_v<R>)
+                                {
+                                    if (result && !error)
+                                        _result.emplace(std::move(*result));
+                                }
+                                _owner->dispatch(handle);
+                            });
+        }
+
+        R await_resume()
+        {
+            if (_error)
+                std::rethrow_exception(_error);
+            if constexpr (!std::is_void_v<R>)
+                return std::move(*_result);
+        }
+
+      private:
+        async_sqlitemap* _owner = nullptr;
+        bool _writes = false;
+        bool _ready = false;
+        std::function<R(map_type&)> _fn;
+        std::exception_ptr _error;
+        std::optional<std::conditional_t<std::is_void_v<R>, bool, R>> _result;
+    };
+
+    /**
+     * @class scan_stream
+     * @brief Asynchronous generator of entries in ascending key order.
+     *
+     * Entries are read in chunks of chunk_size on the worker thread, each chunk continues after
+     * the last key of the previous one, so no statement is kept open between chunks and other
+     * operations interleave with the scan. C++20 lacks for co_await, entries are awaited by:
+     *
+     *     auto stream = db.scan();
+     *     while (auto entry = co_await stream.next())
+     *         use(entry->first, entry->second);
+     *
+     * The stream must outlive awaiting next() and must only be awaited by one coroutine at once.
+     */
+    class scan_stream
     {
-        std::string query = sql("SELECT key FROM :table ORDER BY ROWID DESC");
-        return key_iterator(db, query, &_config);
-    }
+      public:
+        scan_stream(async_sqlitemap& owner, std::optional<key_type> from,
+                    std::optional<key_type> to, size_t chunk_size)
+            : _owner(owner)
+            , _from(std::move(from))
+            , _to(std::move(to))
+            , _chunk_size(std::max<size_t>(1, chunk_size))
+        {
+        }
 
-    key_iterator keys_rend()
+        scan_stream(const scan_stream&) = delete;
+        scan_stream& operator=(const scan_stream&) = delete;
+
+        // Awaits the next entry, std::nullopt once all entries were visited
+        awaitable<std::optional<value_type>> next()
+        {
+            if (!_chunk.empty() || _exhausted)
+                return awaitable<std::optional<value_type>>(take());
+
+            return awaitable<std::optional<value_type>>(_owner, false,
+                                                        [this](map_type& sm)
+                                                        {
+                                                            fetch(sm);
+                                                            return take();
+                                                        });
+        }
+
+      private:
+        std::optional<value_type> take()
+        {
+            if (_chunk.empty())
+                return std::nullopt;
+
+            std::optional<value_type> entry(std::move(_chunk.front()));
+            _chunk.pop_front();
+            return entry;
+        }
+
+        // Runs on the worker thread while the awaiting coroutine is suspended
+        void fetch(map_type& sm)
+        {
+            const auto& key_codec = sm.config().codecs_ref().key_codec;
+            std::vector<typename map_type::db_key_type> params;
+            std::vector<std::string> conditions;
+            if (_last)
+            {
+                conditions.push_back("key > ?");
+                params.push_back(key_codec.encode(*_last));
+            }
+            else if (_from)
+            {
+                conditions.push_back("key >= ?");
+                params.push_back(key_codec.encode(*_from));
+            }
+            if (_to)
+            {
+                conditions.push_back("key < ?");
+                params.push_back(key_codec.encode(*_to));
+            }
+
+            std::string query = "SELECT key, value FROM :table";
+            for (size_t i = 0; i < conditions.size(); i++)
+                query += (i == 0 ? " WHERE " : " AND ") + conditions[i];
+            query += " ORDER BY key LIMIT " + std::to_string(_chunk_size);
+
+            sm.flush();
+            typename map_type::const_iterator it(sm.get_connection(), sm.sql(query), &sm.config(),
+                                                 sm.metrics_registry(), std::move(params));
+            for (; it != sm.cend(); ++it)
+                _chunk.push_back(*it);
+
+            _exhausted = _chunk.size() < _chunk_size;
+            if (!_chunk.empty())
+                _last = _chunk.back().first;
+        }
+
+        async_sqlitemap& _owner;
+        std::optional<key_type> _from;
+        std::optional<key_type> _to;
+        std::optional<key_type> _last;
+        const size_t _chunk_size;
+        std::deque<value_type> _chunk;
+        bool _exhausted = false;
+    };
+
+    // co_await get(key) resolves to the value of key, std::nullopt when it does not exist
+    awaitable<std::optional<mapped_type>> get(key_type key)
     {
-        return key_iterator();
+        return {*this, false, [key = std::move(key)](map_type& sm) { return sm.try_get(key); }};
     }
 
-    const_key_iterator keys_cbegin()
+    awaitable<void> set(key_type key, mapped_type value)
     {
-        std::string query = sql("SELECT key FROM :table");
-        return const_key_iterator(db, query, &_config);
+        return {*this, true, [key = std::move(key), value = std::move(value)](map_type& sm)
+                { sm.set(key, value); }};
     }
 
-    const_key_iterator keys_cend()
+    // co_await erase(key) resolves to the number of erased entries, which is 0 or 1
+    awaitable<size_type> erase(key_type key)
     {
-        return const_key_iterator();
+        return {*this, true, [key = std::move(key)](map_type& sm) { return sm.erase(key); }};
     }
 
-    const_key_iterator keys_crbegin()
+    awaitable<void> commit()
     {
-        std::string query = sql("SELECT key FROM :table ORDER BY ROWID DESC");
-        return const_key_iterator(db, query, &_config);
+        return {*this, true, [](map_type& sm) { sm.commit(); }};
     }
 
-    const_key_iterator keys_crend()
+    // Streams all entries in ascending key order
+    scan_stream scan(size_t chunk_size = default_scan_chunk_size)
     {
-        return const_key_iterator();
+        return scan_stream(*this, std::nullopt, std::nullopt, chunk_size);
     }
-    value_iterator values_begin()
+
+    // Streams all entries with keys within [from, to) in ascending key order
+    scan_stream scan(key_type from, key_type to, size_t chunk_size = default_scan_chunk_size)
     {
-        std::string query = sql("SELECT value FROM :table");
-        return value_iterator(db, query, &_config);
+        return scan_stream(*this, std::move(from), std::move(to), chunk_size);
     }
+#endif
 
-    value_iterator values_end()
+  private:
+    // Completes an operation once its batch is done, error is set when the batch failed
+    using completion = std::function<void(std::exception_ptr error)>;
+
+    struct operation
     {
-        return value_iterator();
-    }
+        bool writes;
+        std::function<completion(map_type&)> execute;
+        completion fail; // for operations which could not be executed at all
+    };
 
-    value_iterator values_rbegin()
+    static std::vector<value_type> scan(const map_type& sm, const key_type& from,
+                                        const key_type& to)
     {
-        std::string query = sql("SELECT value FROM :table ORDER BY ROWID DESC");
-        return value_iterator(db, query, &_config);
+        auto [first, last] = sm.range(from, to);
+        return std::vector<value_type>(first, last);
     }
 
-    value_iterator values_rend()
+    template <typename R, typename Done> auto callback_completion(Done done)
     {
-        return value_iterator();
+        if constexpr (std::is_void_v<R>)
+            return [this, done](std::exception_ptr error, auto*)
+            { dispatch([done, error]() mutable { done(error); }); };
+        else
+            return [this, done](std::exception_ptr error, R* result)
+            {
+                dispatch([done, error, value = result && !error ? std::move(*result) : R{}]()
+                         mutable { done(std::move(value), error); });
+            };
     }
 
-    const_value_iterator values_cbegin()
+    // Runs fn on the worker thread or hands it over to the executor
+    template <typename F> void dispatch(F&& fn)
     {
-        std::string query = sql("SELECT value FROM :table");
-        return const_value_iterator(db, query, &_config);
+        if (_executor)
+            _executor(std::forward<F>(fn));
+        else
+            fn();
     }
 
-    const_value_iterator values_cend()
+    template <typename F> auto enqueue_promised(bool writes, F fn)
     {
-        return const_value_iterator();
+        using R = std::invoke_result_t<F&, map_type&>;
+        auto promise = std::make_shared<std::promise<R>>();
+        auto future = promise->get_future();
+        enqueue(writes, std::move(fn),
+                [promise](std::exception_ptr error, auto* result)
+                {
+                    if (error)
+                        promise->set_exception(error);
+                    else if constexpr (std::is_void_v<R>)
+                        promise->set_value();
+                    else
+                        promise->set_value(std::move(*result));
+                });
+        return future;
+    }
+
+    // complete(std::exception_ptr error, R* result) is invoked with the result of fn, which is
+    // nullptr when fn failed or R is void
+    template <typename F, typename Complete> void enqueue(bool writes, F fn, Complete complete)
+    {
+        using R = std::invoke_result_t<F&, map_type&>;
+        using result_ptr = std::conditional_t<std::is_void_v<R>, void*, R*>;
+
+        operation op;
+        op.writes = writes;
+        op.fail = [complete](std::exception_ptr error) mutable
+        { complete(error, result_ptr(nullptr)); };
+        op.execute = [fn = std::move(fn), complete](map_type& sm) mutable -> completion
+        {
+            try
+            {
+                if constexpr (std::is_void_v<R>)
+                {
+                    fn(sm);
+                    return [complete](std::exception_ptr error) mutable
+                    { complete(error, result_ptr(nullptr)); };
+                }
+                else
+                {
+                    auto result = std::make_shared<R>(fn(sm));
+                    return [complete, result](std::exception_ptr error) mutable
+                    { complete(error, result.get()); };
+                }
+            }
+            catch (...)
+            {
+                // failing operations do not affect other operations of the batch
+                return [complete, failure = std::current_exception()](std::exception_ptr) mutable
+                { complete(failure, result_ptr(nullptr)); };
+            }
+        };
+
+        {
+            std::lock_guard<std::mutex> lock(_queue_mutex);
+            _queue.push_back(std::move(op));
+        }
+        _queue_changed.notify_one();
     }
 
-    const_value_iterator values_crbegin()
+    void run(configuration<CODEC_PAIR> config, std::promise<void>& opened)
     {
-        std::string query = sql("SELECT value FROM :table ORDER BY ROWID DESC");
-        return const_value_iterator(db, query, &_config);
+        std::unique_ptr<map_type> sm;
+        try
+        {
+            sm = std::make_unique<map_type>(std::move(config));
+        }
+        catch (...)
+        {
+            opened.set_exception(std::current_exception());
+            return;
+        }
+        opened.set_value();
+
+        std::vector<operation> batch;
+        while (next_batch(batch))
+        {
+            execute(*sm, batch);
+            batch.clear();
+        }
     }
 
-    const_value_iterator values_crend()
+    // Waits for queued operations, returns false once stopped and all operations were executed
+    bool next_batch(std::vector<operation>& batch)
     {
-        return const_value_iterator();
+        std::unique_lock<std::mutex> lock(_queue_mutex);
+        _queue_changed.wait(lock, [this] { return !_queue.empty() || _stopping; });
+        if (_queue.empty())
+            return false;
+
+        auto n = std::min(_queue.size(), _max_batch_size);
+        auto last = _queue.begin() + static_cast<std::ptrdiff_t>(n);
+        batch.assign(std::make_move_iterator(_queue.begin()), std::make_move_iterator(last));
+        _queue.erase(_queue.begin(), last);
+        return true;
     }
 
-    // configures a sql statement to use correct table by replacing :table with that one from
-    // configuration and put it in double quotes.
-    // e.g. 'select * from :table' => 'select * from "unnamed"'
-    std::string sql(const std::string& sql) const
+    void execute(map_type& sm, std::vector<operation>& batch)
     {
-        const std::string placeholder = ":table";
-        const std::string replacement = "\"" + _config.table() + "\"";
-        std::string output = sql;
+        bool writes = std::any_of(batch.begin(), batch.end(), [](auto& op) { return op.writes; });
+        bool coalesce = writes && sm.config().auto_commit() && !sm.in_transaction();
 
-        size_t pos = 0;
-        while ((pos = output.find(placeholder, pos)) != std::string::npos)
+        std::vector<completion> completions;
+        completions.reserve(batch.size());
+        std::exception_ptr error;
+        try
         {
-            output.replace(pos, placeholder.length(), replacement);
-            pos += replacement.length();
-        }
+            if (coalesce)
+                details::exec_checked(sm.get_connection(), "BEGIN TRANSACTION");
 
-        return output;
-    }
+            for (auto& op : batch)
+                completions.push_back(op.execute(sm));
 
-    logger& log()
-    {
-        return _logger;
+            if (coalesce)
+            {
+                sm.flush();
+                // operations of the batch may have committed already
+                if (sm.in_transaction())
+                    details::exec_checked(sm.get_connection(), "COMMIT");
+            }
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+            if (coalesce)
+                sm.rollback();
+        }
+
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            try
+            {
+                if (i < completions.size())
+                    completions[i](error);
+                else
+                    batch[i].fail(error);
+            }
+            catch (...)
+            {
+                // exceptions thrown by callbacks must not stop the worker
+            }
+        }
     }
 
-  private:
-    sqlite3* db;
-    configuration<CODEC_PAIR> _config;
-    bool _in_temp = false;
-    logger _logger;
+    const size_t _max_batch_size;
+    const executor_type _executor;
+    std::deque<operation> _queue;
+    std::mutex _queue_mutex;
+    std::condition_variable _queue_changed;
+    bool _stopping = false;
+    std::thread _worker;
 };
 
-} // namespace bw::sqlitemap
\ No newline at end of file
+} // namespace bw::sqlitemap
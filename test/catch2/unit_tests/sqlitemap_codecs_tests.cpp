@@ -3,6 +3,7 @@
 // SPDX-License-Identifier: MIT
 
 #include <catch2/catch_all.hpp>
+#include <cmath>
 
 #include <bw/tempdir/tempdir.hpp>
 
@@ -328,3 +329,219 @@ TEST_CASE("use std::variant to store different types in one table")
     REQUIRE(std::get<std::string>(sm.get("k1")) == "Hello World!");
     REQUIRE(std::get<int>(sm.get("k2")) == 42);
 }
+
+TEST_CASE("Get many entries uses codecs", "[codecs]")
+{
+    using namespace bw::testhelper;
+
+    auto kc = key_codec([](point p) { return point::to_string(p); },
+                        [](std::string s) { return point::from_string(s); });
+
+    auto vc = value_codec([](feature f) { return feature::to_string(f); },
+                          [](std::string s) { return feature::from_string(s); });
+
+    sqlitemap sm(config(kc, vc).filename(":memory:"));
+    sm.set({0, 0, 0}, {"origin", 5});
+    sm.set({1, 0, 0}, {"x-direction", 1});
+
+    auto values = sm.get_many(std::vector<point>{{1, 0, 0}, {0, 1, 0}, {0, 0, 0}});
+    REQUIRE(values.size() == 3);
+    REQUIRE(values[0] == feature{"x-direction", 1});
+    REQUIRE(values[1] == std::nullopt);
+    REQUIRE(values[2] == feature{"origin", 5});
+}
+
+TEST_CASE("codecs keep encoder and decoder types", "[codecs]")
+{
+    using namespace bw::testhelper;
+
+    auto encode = [](const point& p) { return point::to_string(p); };
+    auto decode = [](const std::string& s) { return point::from_string(s); };
+    auto kc = key_codec(encode, decode);
+
+    STATIC_REQUIRE(std::is_same_v<decltype(kc)::encoder_type, decltype(encode)>);
+    STATIC_REQUIRE(std::is_same_v<decltype(kc)::decoder_type, decltype(decode)>);
+    STATIC_REQUIRE(codecs::is_key_codec<decltype(kc)>::value);
+
+    // identity codecs pass values through without copying them
+    auto vc = value_codec<std::string>();
+    STATIC_REQUIRE(std::is_empty_v<decltype(vc)::encoder_type>);
+    std::string value = "value";
+    REQUIRE(&vc.encode(value) == &value);
+    REQUIRE(&vc.decode(value) == &value);
+
+    sqlitemap sm(config(kc, vc));
+    sm.set({1, 2, 3}, "a");
+    REQUIRE(sm.get({1, 2, 3}) == "a");
+}
+
+TEST_CASE("codecs convert into the type erased form", "[codecs]")
+{
+    using namespace bw::testhelper;
+
+    using key_codec_t = codecs::key_codec<point, std::string>;
+    using value_codec_t = codecs::value_codec<std::string, std::string>;
+    STATIC_REQUIRE(std::is_same_v<key_codec_t::encoder_type,
+                                  std::function<std::string(const point&)>>);
+
+    key_codec_t kc = key_codec([](const point& p) { return point::to_string(p); },
+                               [](const std::string& s) { return point::from_string(s); });
+    value_codec_t vc = value_codec<std::string>();
+    REQUIRE(kc.encode({1, 2, 3}) == point::to_string({1, 2, 3}));
+
+    sqlitemap<codecs::codec_pair<key_codec_t, value_codec_t>> sm(config(kc, vc));
+    sm.set({1, 2, 3}, "a");
+    REQUIRE(sm.get({1, 2, 3}) == "a");
+    REQUIRE(sm.begin()->first == point{1, 2, 3});
+}
+
+TEST_CASE("configurations convert into the type erased form", "[codecs]")
+{
+    // spelled out codec types are type erased, as they were before codecs kept their own types
+    sqlitemap<codecs::codec_pair<codecs::key_codec<int, int>,
+                                 codecs::value_codec<std::string, std::string>>>
+        sm(config(key_codec<int>(), value_codec<std::string>()).table("converted"));
+    sm.set(1, "a");
+    REQUIRE(sm.get(1) == "a");
+    REQUIRE(sm.config().table() == "converted");
+}
+
+namespace
+{
+
+template <typename T> blob ordered(const T& value)
+{
+    blob encoded;
+    details::ordered_encode(encoded, value);
+    return encoded;
+}
+
+template <typename T> bool is_nan(const T& value)
+{
+    if constexpr (std::is_floating_point_v<T>)
+        return std::isnan(value);
+    else
+        return false;
+}
+
+// NaN sorts after all other values
+template <typename T> bool ordered_less(const T& a, const T& b)
+{
+    if (is_nan(a) || is_nan(b))
+        return !is_nan(a);
+    return a < b;
+}
+
+template <typename T> void require_order_preserved(const std::vector<T>& values)
+{
+    for (const auto& a : values)
+    {
+        if (is_nan(a))
+            REQUIRE(is_nan(details::ordered_decode<T>(ordered(a))));
+        else
+            REQUIRE(details::ordered_decode<T>(ordered(a)) == a);
+
+        for (const auto& b : values)
+            REQUIRE(ordered_less(a, b) == (ordered(a) < ordered(b)));
+    }
+}
+
+} // namespace
+
+TEST_CASE("ordered encoding sorts like the encoded values", "[codecs]")
+{
+    require_order_preserved<int>({std::numeric_limits<int>::min(), -1000, -1, 0, 1, 255, 256,
+                                  std::numeric_limits<int>::max()});
+    require_order_preserved<int8_t>({-128, -1, 0, 1, 127});
+    require_order_preserved<uint16_t>({0, 1, 255, 256, 65535});
+    require_order_preserved<int64_t>({std::numeric_limits<int64_t>::min(), -1, 0, 1LL << 40});
+    require_order_preserved<bool>({false, true});
+    constexpr auto inf = std::numeric_limits<double>::infinity();
+    constexpr auto nan = std::numeric_limits<double>::quiet_NaN();
+    require_order_preserved<double>(
+        {-inf, -1e300, -2.5, -1e-300, -0.0, 0.0, 1e-300, 2.5, 1e300, inf, nan, -nan});
+    require_order_preserved<float>({-3.5f, -0.25f, -0.0f, 0.0f, 0.25f, 3.5f,
+                                    std::numeric_limits<float>::quiet_NaN()});
+    require_order_preserved<std::string>(
+        {"", std::string("\0", 1), std::string("a\0", 2), "a", "a\xff", "ab", "b", "ba"});
+    require_order_preserved<std::tuple<int, std::string, double>>(
+        {{-1, "z", 0.0}, {0, "", -1.0}, {0, "", 1.0}, {0, "a", -5.0}, {0, "ab", 0.0}, {1, "", 0}});
+    require_order_preserved<std::pair<std::string, int>>({{"a", 2}, {"a", 10}, {"ab", 1}});
+
+    enum class color : int8_t
+    {
+        red = -1,
+        green,
+        blue
+    };
+    require_order_preserved<color>({color::red, color::green, color::blue});
+
+    // values comparing equal share one encoding, all NaNs as well
+    REQUIRE(ordered(-0.0) == ordered(0.0));
+    REQUIRE(ordered(-nan) == ordered(nan));
+    REQUIRE(ordered(std::numeric_limits<double>::signaling_NaN()) == ordered(nan));
+
+    // integers are encoded with their fixed size in big endian order
+    REQUIRE(ordered(1) == blob{std::byte{0x80}, std::byte{0}, std::byte{0}, std::byte{1}});
+    REQUIRE(ordered(std::string("a\0", 2)) == blob{std::byte{'a'}, std::byte{0}, std::byte{0xff},
+                                                     std::byte{0}, std::byte{1}});
+}
+
+TEST_CASE("ordered decoding rejects malformed input", "[codecs]")
+{
+    REQUIRE_THROWS_AS(details::ordered_decode<int>(blob{std::byte{1}}), sqlitemap_error);
+    REQUIRE_THROWS_AS(details::ordered_decode<int>(ordered(int64_t(1))), sqlitemap_error);
+    REQUIRE_THROWS_AS(details::ordered_decode<std::string>(blob{std::byte{'a'}}),
+                      sqlitemap_error);
+    REQUIRE_THROWS_AS(details::ordered_decode<std::string>(blob{std::byte{0}, std::byte{7}}),
+                      sqlitemap_error);
+}
+
+TEST_CASE("tuple keys use order preserving codecs", "[codecs]")
+{
+    using tile = std::tuple<int, int, int>;
+    sqlitemap sm(config(key_codec<tile>(), value_codec<std::string>()));
+
+    sm.set({1, 0, 1}, "1/0/1");
+    sm.set({0, 0, 0}, "0/0/0");
+    sm.set({1, 1, 0}, "1/1/0");
+    sm.set({-1, 5, 5}, "-1/5/5");
+    sm.set({1, 0, 0}, "1/0/0");
+    sm.set({2, 0, 0}, "2/0/0");
+
+    // range lookups iterate in key order
+    constexpr int min = std::numeric_limits<int>::min();
+    std::vector<tile> keys;
+    for (auto it = sm.lower_bound(tile{min, min, min}); it != sm.end(); ++it)
+        keys.push_back(it->first);
+    REQUIRE(keys == std::vector<tile>{{-1, 5, 5}, {0, 0, 0}, {1, 0, 0}, {1, 0, 1}, {1, 1, 0},
+                                      {2, 0, 0}});
+
+    // all tiles of zoom level 1
+    std::vector<std::string> zoom_1;
+    auto [first, last] = sm.range(tile{1, min, min}, tile{2, min, min});
+    for (auto it = first; it != last; ++it)
+        zoom_1.push_back(it->second);
+    REQUIRE(zoom_1 == std::vector<std::string>{"1/0/0", "1/0/1", "1/1/0"});
+    REQUIRE(sm.lower_bound({1, 0, 2})->second == "1/1/0");
+}
+
+TEST_CASE("structs can use order preserving codecs via tuples", "[codecs]")
+{
+    using namespace bw::testhelper;
+
+    auto kc = ordered_key_codec([](const point& p) { return std::tie(p.x, p.y, p.z); },
+                                [](const std::tuple<int, int, int>& t)
+                                { return point{std::get<0>(t), std::get<1>(t), std::get<2>(t)}; });
+
+    sqlitemap sm(config(kc, value_codec<std::string>()));
+    sm.set({2, -1, 0}, "c");
+    sm.set({-2, 3, 0}, "a");
+    sm.set({2, -5, 0}, "b");
+
+    std::string values;
+    for (auto it = sm.lower_bound(point{-10, 0, 0}); it != sm.end(); ++it)
+        values += it->second;
+    REQUIRE(values == "abc");
+    REQUIRE(sm.lower_bound(point{0, 0, 0})->first == point{2, -5, 0});
+}
@@ -0,0 +1,216 @@
+// sqlitemap
+// SPDX-FileCopyrightText: 2024-present Benno Waldhauer
+// SPDX-License-Identifier: MIT
+
+#include <catch2/catch_all.hpp>
+
+#include <bw/tempdir/tempdir.hpp>
+
+#include "custom.hpp"
+#include <bw/sqlitemap/compression.hpp>
+
+using namespace bw::sqlitemap;
+
+using namespace bw::tempdir;
+namespace fs = std::filesystem;
+
+namespace
+{
+
+std::string json_document(int i)
+{
+    return R"({"id":)" + std::to_string(i) + R"(,"type":"feature","properties":{"name":"feature-)" +
+           std::to_string(i) + R"(","rating":)" + std::to_string(i % 5) +
+           R"(,"tags":["road","bridge"]},"geometry":{"type":"Point","coordinates":[)" +
+           std::to_string(i * 7 % 180) + "," + std::to_string(i * 3 % 90) + "]}}";
+}
+
+size_t stored_bytes(sqlite3* db, const std::string& table)
+{
+    sqlite3_stmt* stmt = nullptr;
+    details::prepare_checked(db, "SELECT sum(length(value)) FROM \"" + table + "\"", &stmt);
+    REQUIRE(sqlite3_step(stmt) == SQLITE_ROW);
+    auto num_bytes = details::column_value<size_t>(stmt, 0);
+    sqlite3_finalize(stmt);
+    return num_bytes;
+}
+
+} // namespace
+
+TEST_CASE("compressor writes frames which can be decompressed", "[compression]")
+{
+    compression::compressor zc;
+    REQUIRE(zc.algo() == compression::algorithm::zlib);
+    REQUIRE(compression::to_string(zc.algo()) == "zlib");
+    REQUIRE(zc.min_size() == compression::default_min_size);
+    REQUIRE_FALSE(zc.dictionary_id());
+
+    std::string text(1000, 'x');
+    auto frame = zc.compress(details::as_bytes(text));
+    REQUIRE(static_cast<uint8_t>(frame[0]) == details::zlib_frame);
+    REQUIRE(frame.size() < 100);
+    REQUIRE(zc.decompress<std::string>(frame) == text);
+    REQUIRE(zc.decompress(frame).size() == 1000);
+
+    // small and incompressible values are stored raw
+    std::string small = "tiny";
+    auto small_frame = zc.compress(details::as_bytes(small));
+    REQUIRE(static_cast<uint8_t>(small_frame[0]) == details::raw_frame);
+    REQUIRE(small_frame.size() == small.size() + 1);
+    REQUIRE(zc.decompress<std::string>(small_frame) == small);
+
+    std::mt19937 gen(42);
+    blob noise(1000);
+    for (auto& b : noise)
+        b = static_cast<std::byte>(gen());
+    auto noise_frame = zc.compress(noise);
+    REQUIRE(static_cast<uint8_t>(noise_frame[0]) == details::raw_frame);
+    REQUIRE(zc.decompress(noise_frame) == noise);
+
+    REQUIRE(zc.decompress<std::string>(zc.compress(blob_view())).empty());
+    REQUIRE_THROWS_AS(zc.decompress(blob_view()), sqlitemap_error);
+    REQUIRE_THROWS_WITH(zc.decompress(blob{std::byte{9}, std::byte{0}, std::byte{0},
+                                           std::byte{0}, std::byte{0}, std::byte{0},
+                                           std::byte{0}, std::byte{0}, std::byte{0}}),
+                        Catch::Matchers::ContainsSubstring("Unknown compression frame type 9"));
+}
+
+TEST_CASE("compressor can be configured", "[compression]")
+{
+    compression::compressor zc;
+    zc.level(9).min_size(0);
+    REQUIRE(zc.level() == 9);
+    REQUIRE(zc.min_size() == 0);
+
+    // copies share their settings
+    auto copy = zc;
+    copy.level(1);
+    REQUIRE(zc.level() == 1);
+
+    std::string text = json_document(1) + json_document(2);
+    REQUIRE(zc.decompress<std::string>(zc.compress(details::as_bytes(text))) == text);
+
+#ifndef SM_WITH_ZSTD
+    REQUIRE_THROWS_AS(compression::compressor(compression::algorithm::zstd), sqlitemap_error);
+#endif
+}
+
+TEST_CASE("compressed value codec wraps inner value codecs", "[compression]")
+{
+    using namespace bw::testhelper;
+
+    compression::compressor zc;
+    auto vc = compressed_value_codec(zc);
+    STATIC_REQUIRE(std::is_same_v<decltype(vc)::in_type, std::string>);
+    STATIC_REQUIRE(std::is_same_v<decltype(vc)::out_type, blob>);
+
+    sqlitemap sm(config(vc));
+    std::string doc = json_document(1);
+    sm.set("doc", doc);
+    sm.set("empty", "");
+    REQUIRE(sm.get("doc") == doc);
+    REQUIRE(sm.get("empty") == "");
+
+    auto fc = compressed_value_codec(
+        zc, value_codec([](const feature& f) { return feature::to_string(f); },
+                        [](const std::string& s) { return feature::from_string(s); }));
+    sqlitemap features(config(fc));
+    features.set("f1", feature{std::string(200, 'a'), 5});
+    REQUIRE(features.get("f1") == feature{std::string(200, 'a'), 5});
+}
+
+TEST_CASE("dictionaries improve compression of small similar values", "[compression]")
+{
+    TempDir temp_dir;
+    auto file = (temp_dir.path() / "db.sqlite").string();
+
+    std::vector<std::string> docs;
+    for (int i = 0; i < 500; i++)
+        docs.push_back(json_document(i));
+
+    compression::compressor plain;
+    auto plain_config = config(compressed_value_codec(plain)).filename(file).table("plain");
+    sqlitemap without_dict(plain_config.auto_commit(true));
+    for (int i = 0; i < 500; i++)
+        without_dict.set("doc-" + std::to_string(i), docs[i]);
+
+    compression::compressor zc;
+    sqlitemap sm(config(compressed_value_codec(zc)).filename(file).table("docs").auto_commit(true));
+
+    // values written before training remain readable
+    sm.set("before", docs[0]);
+
+    auto id = zc.train(std::vector<std::string>(docs.begin(), docs.begin() + 100), 4096);
+    REQUIRE(id == 1);
+    REQUIRE(zc.dictionary_id() == 1);
+    REQUIRE(zc.num_dictionaries() == 1);
+
+    for (int i = 0; i < 500; i++)
+        sm.set("doc-" + std::to_string(i), docs[i]);
+
+    auto bytes_plain = stored_bytes(without_dict.get_connection(), "plain");
+    auto bytes_dict = stored_bytes(sm.get_connection(), "docs");
+    REQUIRE(bytes_dict * 2 < bytes_plain);
+
+    // training from stored values adds another dictionary
+    REQUIRE(zc.train_from(sm, 200) == 2);
+    sm.set("after", docs[1]);
+
+    REQUIRE(sm.get("before") == docs[0]);
+    REQUIRE(sm.get("doc-42") == docs[42]);
+    REQUIRE(sm.get("after") == docs[1]);
+
+    zc.save(sm);
+
+    SECTION("dictionaries can be loaded from the database")
+    {
+        compression::compressor loaded;
+        sqlitemap client(config(compressed_value_codec(loaded)).filename(file).table("docs"));
+        REQUIRE_THROWS_WITH(client.get("doc-1"),
+                            Catch::Matchers::ContainsSubstring("Unknown compression dictionary"));
+
+        REQUIRE(loaded.load(client) == 2);
+        REQUIRE(loaded.dictionary_id() == 2);
+        REQUIRE(client.get("before") == docs[0]);
+        REQUIRE(client.get("doc-1") == docs[1]);
+        REQUIRE(client.get("after") == docs[1]);
+
+        // dictionaries are kept per table
+        compression::compressor other;
+        sqlitemap other_table(config(compressed_value_codec(other)).filename(file).table("plain"));
+        REQUIRE(other.load(other_table) == 0);
+        REQUIRE(other_table.get("doc-7") == docs[7]);
+    }
+
+    SECTION("loading without side table finds nothing")
+    {
+        compression::compressor loaded;
+        sqlitemap empty(config(compressed_value_codec(loaded)));
+        REQUIRE(loaded.load(empty) == 0);
+        REQUIRE_FALSE(loaded.dictionary_id());
+    }
+
+    SECTION("loading from a broken side table fails")
+    {
+        details::exec_checked(sm.get_connection(), "DROP TABLE _sqlitemap_dictionaries;"
+                                                    "CREATE TABLE _sqlitemap_dictionaries (id)");
+        compression::compressor loaded;
+        REQUIRE_THROWS_AS(loaded.load(sm), sqlitemap_error);
+        REQUIRE_FALSE(loaded.dictionary_id());
+    }
+}
+
+TEST_CASE("training requires samples", "[compression]")
+{
+    compression::compressor zc;
+    REQUIRE_THROWS_AS(zc.train(std::vector<std::string>{}), sqlitemap_error);
+
+    TempDir temp_dir;
+    auto file = (temp_dir.path() / "db.sqlite").string();
+
+    sqlitemap sm(config(compressed_value_codec(zc)).filename(file));
+    REQUIRE_THROWS_AS(zc.train_from(sm), sqlitemap_error);
+
+    sqlitemap read_only(config(compressed_value_codec(zc)).filename(file).mode(operation_mode::r));
+    REQUIRE_THROWS_AS(zc.save(read_only), sqlitemap_error);
+}
@@ -4,6 +4,8 @@
 
 #include <bw/sqlitemap/sqlitemap.hpp>
 #include <catch2/catch_all.hpp>
+#include <atomic>
+#include <future>
 #include <thread>
 
 #include <bw/tempdir/tempdir.hpp>
@@ -520,6 +522,90 @@ TEST_CASE("Insert data")
     REQUIRE((sm["s1"] == "v1"));
 }
 
+TEST_CASE("Insert range of data")
+{
+    sqlitemap sm(config().filename(":memory:"));
+    sm.set("k1", "v1");
+
+    std::vector<std::pair<std::string, std::string>> entries{
+        {"k1", "u1"}, {"k2", "v2"}, {"k3", "v3"}};
+    REQUIRE(sm.insert_range(entries) == 2);
+    REQUIRE(sm.size() == 3);
+    REQUIRE(sm.get("k1") == "v1");
+    REQUIRE(sm.get("k2") == "v2");
+    REQUIRE(sm.get("k3") == "v3");
+
+    REQUIRE(sm.insert_range(entries) == 0);
+    REQUIRE(sm.insert_range(std::map<std::string, std::string>{}) == 0);
+}
+
+TEST_CASE("Set many entries at once")
+{
+    TempDir temp_dir;
+    auto file = (temp_dir.path() / "db.sqlite").string();
+
+    auto kc = key_codec<int>();
+    auto vc = value_codec<std::string>();
+    using codecs_pair_t = codecs::codec_pair<decltype(kc), decltype(vc)>;
+
+    bool auto_commit = GENERATE(false, true);
+    sqlitemap<codecs_pair_t> sm(config(kc, vc).filename(file).auto_commit(auto_commit));
+    sqlitemap<codecs_pair_t> client(config(kc, vc).filename(file));
+
+    sm.set(1, "a");
+    sm.commit();
+
+    std::map<int, std::string> entries;
+    for (int i = 0; i < 1000; i++)
+        entries[i] = std::to_string(i);
+
+    auto result = sm.set_many(entries);
+    REQUIRE(result.inserted == 999);
+    REQUIRE(result.replaced == 1);
+    REQUIRE(sm.size() == 1000);
+    REQUIRE(sm.get(1) == "1");
+    REQUIRE(sm.get(999) == "999");
+
+    // all entries are written within one transaction, which is committed directly in auto commit
+    // mode, otherwise it has to be committed explicitly like any other write
+    REQUIRE(client.size() == (auto_commit ? 1000 : 1));
+    sm.commit();
+    REQUIRE(client.size() == 1000);
+
+    result = sm.set_many({{1, "x"}, {1000, "y"}, {1001, "z"}});
+    REQUIRE(result.inserted == 2);
+    REQUIRE(result.replaced == 1);
+    REQUIRE(sm.get(1) == "x");
+    REQUIRE(sm.get(1001) == "z");
+}
+
+TEST_CASE("Set many entries is atomic")
+{
+    auto kc = key_codec<int>();
+    auto vc = value_codec(
+        [](const std::string& v)
+        {
+            if (v == "fail")
+                throw std::runtime_error("encoding failed");
+            return v;
+        },
+        [](const std::string& v) { return v; });
+
+    bool auto_commit = GENERATE(false, true);
+    sqlitemap sm(config(kc, vc).filename(":memory:").auto_commit(auto_commit));
+    sm.set(1, "a");
+
+    std::vector<std::pair<int, std::string>> entries{{1, "b"}, {2, "c"}, {3, "fail"}, {4, "d"}};
+    REQUIRE_THROWS_AS(sm.set_many(entries), std::runtime_error);
+
+    REQUIRE(sm.size() == 1);
+    REQUIRE(sm.get(1) == "a");
+
+    // writes before the failed batch are still part of the open transaction
+    sm.commit();
+    REQUIRE(sm.get(1) == "a");
+}
+
 TEST_CASE("Insert or assign data")
 {
     TempDir temp_dir;
@@ -831,10 +917,8 @@ TEST_CASE("Equal range")
     REQUIRE(from != sm.end());
     REQUIRE(from->first == "k1");
     REQUIRE(from->second == "v1");
-
-    REQUIRE(to != sm.end());
-    REQUIRE(to->first == "k1");
-    REQUIRE(to->second == "v1");
+    REQUIRE(to == sm.end());
+    REQUIRE(std::distance(from, to) == 1);
 
     auto nf = sm.equal_range("not-existing-key");
     REQUIRE(nf.first == sm.end());
@@ -846,16 +930,74 @@ TEST_CASE("Equal range")
     REQUIRE(cfrom != csm.end());
     REQUIRE(cfrom->first == "k3");
     REQUIRE(cfrom->second == "v3");
-
-    REQUIRE(cto != csm.end());
-    REQUIRE(cto->first == "k3");
-    REQUIRE(cto->second == "v3");
+    REQUIRE(cto == csm.end());
 
     auto cnf = csm.equal_range("not-existing-key");
     REQUIRE(cnf.first == csm.end());
     REQUIRE(cnf.second == csm.end());
 }
 
+TEST_CASE("Lower and upper bound")
+{
+    sqlitemap sm(config<int, std::string>().filename(":memory:"));
+    for (int i : {50, 10, 40, 20, 30})
+        sm.set(i, "v" + std::to_string(i));
+
+    auto keys_from = [](auto it, auto end)
+    {
+        std::vector<int> keys;
+        for (; it != end; ++it)
+            keys.push_back(it->first);
+        return keys;
+    };
+
+    REQUIRE(keys_from(sm.lower_bound(20), sm.end()) == std::vector<int>{20, 30, 40, 50});
+    REQUIRE(keys_from(sm.lower_bound(21), sm.end()) == std::vector<int>{30, 40, 50});
+    REQUIRE(keys_from(sm.upper_bound(20), sm.end()) == std::vector<int>{30, 40, 50});
+    REQUIRE(keys_from(sm.lower_bound(0), sm.end()) == std::vector<int>{10, 20, 30, 40, 50});
+    REQUIRE(sm.lower_bound(51) == sm.end());
+    REQUIRE(sm.upper_bound(50) == sm.end());
+
+    const auto& csm = sm;
+    REQUIRE(keys_from(csm.lower_bound(40), csm.end()) == std::vector<int>{40, 50});
+    REQUIRE(keys_from(csm.upper_bound(40), csm.end()) == std::vector<int>{50});
+}
+
+TEST_CASE("Range of keys")
+{
+    sqlitemap sm(config().filename(":memory:"));
+    for (auto key : {"2024-03-01", "2024-01-15", "2024-02-01", "2024-01-01", "2024-02-29"})
+        sm.set(key, "x");
+
+    std::vector<std::string> keys;
+    auto [from, to] = sm.range("2024-01-10", "2024-03-01");
+    for (auto it = from; it != to; ++it)
+        keys.push_back(it->first);
+
+    REQUIRE(keys == std::vector<std::string>{"2024-01-15", "2024-02-01", "2024-02-29"});
+
+    const auto& csm = sm;
+    auto [cfrom, cto] = csm.range("2024-02", "2024-03");
+    REQUIRE(std::distance(cfrom, cto) == 2);
+
+    auto empty = sm.range("2025", "2026");
+    REQUIRE(empty.first == empty.second);
+
+    // ranges are index seeks on the primary key without additional sorting
+    std::string plan;
+    auto plan_callback = [](void* result, int argc, char** argv, char** col_name)
+    {
+        *static_cast<std::string*>(result) += std::string(argv[3]) + ";";
+        return 0;
+    };
+    auto explain = "EXPLAIN QUERY PLAN " +
+                   sm.sql("SELECT key, value FROM :table WHERE key >= 'a' AND key < 'b' "
+                          "ORDER BY key");
+    details::exec_checked(sm.get_connection(), explain, plan_callback, &plan);
+    REQUIRE_THAT(plan, Catch::Matchers::ContainsSubstring("USING INDEX"));
+    REQUIRE_THAT(plan, !Catch::Matchers::ContainsSubstring("TEMP B-TREE"));
+}
+
 TEST_CASE("count entries")
 {
     sqlitemap sm;
@@ -1624,3 +1766,1647 @@ TEST_CASE("PRAGMA statements can be used to set SQLite options")
     REQUIRE(sm_custom.size() == 1);
     REQUIRE(sm_custom.get("k1") == "v1");
 }
+
+TEST_CASE("Prepared statements are cached per connection")
+{
+    auto num_prepared = [](sqlite3* db)
+    {
+        int num = 0;
+        for (auto stmt = sqlite3_next_stmt(db, nullptr); stmt; stmt = sqlite3_next_stmt(db, stmt))
+            num++;
+        return num;
+    };
+
+    sqlitemap sm(config().filename(":memory:"));
+    REQUIRE(sm.config().statement_cache_size() == default_statement_cache_size);
+
+    sm.set("k1", "v1");
+    sm.set("k2", "v2");
+    REQUIRE(sm.get("k1") == "v1");
+    REQUIRE(sm.contains("k2"));
+    REQUIRE(sm.size() == 2);
+    sm.del("k2");
+
+    // set, get, contains, size, del
+    REQUIRE(num_prepared(sm.get_connection()) == 5);
+
+    // repeated calls reuse the cached statements
+    for (int i = 0; i < 10; i++)
+    {
+        sm.set("k" + std::to_string(i), "v" + std::to_string(i));
+        REQUIRE(sm.get("k" + std::to_string(i)) == "v" + std::to_string(i));
+    }
+    REQUIRE(num_prepared(sm.get_connection()) == 5);
+
+    // cached statements are invalidated on close and connection can be reestablished
+    sm.close();
+    REQUIRE(sm.get_connection() == nullptr);
+    REQUIRE_NOTHROW(sm.close());
+
+    TempDir temp_dir;
+    sqlitemap sm_file(config().filename((temp_dir.path() / "db.sqlite").string()));
+    sm_file.set("k1", "v1");
+    sm_file.commit();
+    sm_file.close();
+    sm_file.connect();
+    REQUIRE(num_prepared(sm_file.get_connection()) == 0);
+    REQUIRE(sm_file.get("k1") == "v1");
+    REQUIRE(num_prepared(sm_file.get_connection()) == 1);
+}
+
+TEST_CASE("Statement cache can be disabled")
+{
+    sqlitemap sm(config().filename(":memory:").statement_cache_size(0));
+    REQUIRE(sm.config().statement_cache_size() == 0);
+
+    sm.set("k1", "v1");
+    REQUIRE(sm.get("k1") == "v1");
+    REQUIRE(sm.try_get("k2") == std::nullopt);
+    REQUIRE(sm.count("k1") == 1);
+    REQUIRE(sm.size() == 1);
+    sm.del("k1");
+    REQUIRE(sm.empty());
+
+    REQUIRE(sqlite3_next_stmt(sm.get_connection(), nullptr) == nullptr);
+}
+
+TEST_CASE("sqlitemap can be moved")
+{
+    sqlitemap sm(config().filename(":memory:"));
+    sm.set("k1", "v1");
+
+    sqlitemap moved(std::move(sm));
+    REQUIRE(sm.get_connection() == nullptr);
+    REQUIRE(moved.get("k1") == "v1");
+
+    moved.set("k2", "v2");
+    REQUIRE(moved.size() == 2);
+}
+
+TEST_CASE("Get many entries at once")
+{
+    sqlitemap sm(config<int, std::string>().filename(":memory:"));
+    for (int i = 0; i < 1000; i += 2)
+        sm.set(i, "v" + std::to_string(i));
+
+    REQUIRE(sm.get_many(std::vector<int>{}).empty());
+
+    auto values = sm.get_many({4, 1, 2, 4, 999, 998});
+    REQUIRE(values.size() == 6);
+    REQUIRE(values[0] == "v4");
+    REQUIRE(values[1] == std::nullopt);
+    REQUIRE(values[2] == "v2");
+    REQUIRE(values[3] == "v4");
+    REQUIRE(values[4] == std::nullopt);
+    REQUIRE(values[5] == "v998");
+
+    // more keys than fit into one statement are resolved in chunks, keeping input order
+    std::vector<int> keys;
+    for (int i = 999; i >= 0; i--)
+        keys.push_back(i);
+
+    values = sm.get_many(keys);
+    REQUIRE(values.size() == keys.size());
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        if (keys[i] % 2 == 0)
+            REQUIRE(values[i] == "v" + std::to_string(keys[i]));
+        else
+            REQUIRE(values[i] == std::nullopt);
+    }
+}
+
+TEST_CASE("Streaming iteration keeps only current rows in memory")
+{
+    sqlitemap sm(config<int, std::string>()
+                     .filename(":memory:")
+                     .iteration_mode(iteration_mode::streaming));
+    REQUIRE(sm.config().iteration_mode() == iteration_mode::streaming);
+
+    for (int i = 0; i < 100; i++)
+        sm.set(i, "v" + std::to_string(i));
+
+    using result_type = lazy_result<decltype(sm.config().codecs()), std::pair<int, std::string>,
+                                    column_option::key_value>;
+
+    result_type result(sm.get_connection(), sm.sql("SELECT key, value FROM :table"), &sm.config());
+    REQUIRE(result.mode() == iteration_mode::streaming);
+    for (size_t i = 0; i < 100; i++)
+    {
+        REQUIRE(result[i].first == static_cast<int>(i));
+        REQUIRE(result.cached_num_rows() <= 2);
+    }
+    REQUIRE(result.evaluated_num_rows() == 100);
+    REQUIRE_THROWS_AS(result[0], std::out_of_range);
+
+    int sum = 0;
+    int num = 0;
+    for (auto& [k, v] : sm)
+    {
+        REQUIRE(v == "v" + std::to_string(k));
+        sum += k;
+        num++;
+    }
+    REQUIRE(num == 100);
+    REQUIRE(sum == 4950);
+
+    REQUIRE(std::distance(sm.keys_begin(), sm.keys_end()) == 100);
+    REQUIRE(std::distance(sm.values_cbegin(), sm.values_cend()) == 100);
+
+    // copies share the cursor, released rows can not be accessed anymore
+    auto it = sm.begin();
+    auto first = it;
+    std::advance(it, 10);
+    REQUIRE(it->first == 10);
+    REQUIRE_THROWS_AS(*first, std::out_of_range);
+}
+
+TEST_CASE("Cached iteration keeps evaluated rows")
+{
+    sqlitemap sm(config<int, std::string>().filename(":memory:"));
+    REQUIRE(sm.config().iteration_mode() == iteration_mode::cached);
+
+    for (int i = 0; i < 10; i++)
+        sm.set(i, "v" + std::to_string(i));
+
+    auto it = sm.begin();
+    auto first = it;
+    std::advance(it, 5);
+    REQUIRE(it->first == 5);
+    REQUIRE(first->first == 0);
+}
+
+TEST_CASE("Row counter keeps size up to date")
+{
+    TempDir temp_dir;
+    auto file = (temp_dir.path() / "db.sqlite").string();
+    auto table = GENERATE("unnamed", "Näme '42'", "my \"table\"");
+
+    auto counted_rows = [&](sqlite3* db)
+    {
+        std::string count;
+        auto callback = [](void* result, int argc, char** argv, char** col_name)
+        {
+            *static_cast<std::string*>(result) = argv[0];
+            return 0;
+        };
+        auto query = std::string("SELECT num_rows FROM ") + details::row_counts_table +
+                     " WHERE tbl = " + details::quote_literal(table);
+        details::exec_checked(db, query, callback, &count);
+        return std::stoi(count);
+    };
+
+    { // existing rows are counted on initialization
+        sqlitemap sm(config().filename(file).table(table));
+        sm.set("k0", "v0");
+        sm.commit();
+    }
+
+    sqlitemap sm(config().filename(file).table(table).row_counter(true));
+    REQUIRE(sm.config().row_counter());
+    REQUIRE(sm.size() == 1);
+    REQUIRE(counted_rows(sm.get_connection()) == 1);
+
+    sm.set("k1", "v1");
+    sm.set("k1", "v1-updated");
+    sm["k2"] = "v2";
+    REQUIRE(sm.size() == 3);
+
+    sm.del("k2");
+    sm.del("not-existing");
+    REQUIRE(sm.size() == 2);
+
+    REQUIRE(sm.set_many({{"k1", "x"}, {"k3", "v3"}, {"k4", "v4"}}).inserted == 2);
+    REQUIRE(sm.insert_range(std::map<std::string, std::string>{{"k4", "y"}, {"k5", "v5"}}) == 1);
+    REQUIRE(sm.erase("k5") == 1);
+    REQUIRE(sm.size() == 4);
+    REQUIRE(counted_rows(sm.get_connection()) == 4);
+
+    sm.rollback();
+    REQUIRE(sm.size() == 1);
+
+    sm.set("k1", "v1");
+    sm.commit();
+
+    { // writes of connections not using the row counter are counted as well
+        sqlitemap other(config().filename(file).table(table));
+        other.set("k2", "v2");
+        other.del("k0");
+        other.commit();
+    }
+    REQUIRE(sm.size() == 2);
+
+    { // read-only connections use the row counter when it is available
+        sqlitemap read_only(
+            config().filename(file).table(table).mode(operation_mode::r).row_counter(true));
+        REQUIRE(read_only.size() == 2);
+    }
+
+    sm.clear();
+    REQUIRE(sm.size() == 0);
+    REQUIRE(sm.empty());
+    REQUIRE(counted_rows(sm.get_connection()) == 0);
+
+    // helper table is not listed as sqlitemap table
+    auto tables = get_tablenames(file);
+    REQUIRE(std::find(tables.begin(), tables.end(), details::row_counts_table) == tables.end());
+}
+
+TEST_CASE("Row counter is exact with recursive triggers")
+{
+    TempDir temp_dir;
+    auto file = (temp_dir.path() / "db.sqlite").string();
+    auto recursive_triggers = GENERATE(0, 1);
+
+    // replaced rows fire delete triggers when recursive triggers are enabled
+    sqlitemap sm(config()
+                     .filename(file)
+                     .pragma("recursive_triggers", recursive_triggers)
+                     .row_counter(true));
+    sm.set("k1", "v1");
+    sm.set("k1", "v1-updated");
+    sm.set("k2", "v2");
+    REQUIRE(sm.set_many({{"k2", "x"}, {"k3", "v3"}}).inserted == 1);
+    REQUIRE(sm.size() == 3);
+
+    sm.del("k1");
+    REQUIRE(sm.size() == 2);
+
+    // triggers are shared with connections using the other mode
+    sqlitemap other(config().filename(file).pragma("recursive_triggers", 1 - recursive_triggers));
+    sm.commit();
+    other.set("k2", "v2-updated");
+    other.set("k4", "v4");
+    other.commit();
+    REQUIRE(sm.size() == 3);
+}
+
+TEST_CASE("Empty check does not need to count rows")
+{
+    sqlitemap sm(config().filename(":memory:"));
+    REQUIRE(sm.empty());
+
+    sm.set("k1", "v1");
+    REQUIRE_FALSE(sm.empty());
+
+    sm.del("k1");
+    REQUIRE(sm.empty());
+}
+
+TEST_CASE("Connection pool shares one database file")
+{
+    TempDir temp_dir;
+    auto file = (temp_dir.path() / "db.sqlite").string();
+
+    sqlitemap_pool pool(config().filename(file).auto_commit(true), 2);
+    REQUIRE(pool.num_readers() == 2);
+
+    pool.set("k1", "v1");
+    pool.write([](auto& sm) { sm.set("k2", "v2"); });
+
+    REQUIRE(pool.get("k1") == "v1");
+    REQUIRE(pool.contains("k2"));
+    REQUIRE_FALSE(pool.try_get("k3").has_value());
+    REQUIRE(pool.read([](const auto& sm) { return sm.size(); }) == 2);
+
+    { // readers are leased exclusively and use read-only connections
+        auto r1 = pool.lease();
+        auto r2 = pool.lease();
+        REQUIRE(&*r1 != &*r2);
+        REQUIRE(r1->is_read_only());
+        REQUIRE(r2->get("k2") == "v2");
+    }
+
+    { // database uses WAL journal mode
+        auto w = pool.writer();
+        std::string journal_mode;
+        auto callback = [](void* result, int argc, char** argv, char** col_name)
+        {
+            *static_cast<std::string*>(result) = argv[0];
+            return 0;
+        };
+        details::exec_checked(w->get_connection(), "PRAGMA journal_mode", callback, &journal_mode);
+        REQUIRE(journal_mode == "wal");
+    }
+
+    pool.del("k1");
+    REQUIRE_FALSE(pool.contains("k1"));
+}
+
+TEST_CASE("Connection pool serves concurrent readers")
+{
+    sqlitemap_pool pool(config<int, int>().auto_commit(true), 4);
+    auto temp_file = pool.writer()->config().filename();
+    REQUIRE(fs::exists(temp_file));
+
+    std::atomic<bool> done = false;
+    std::atomic<int> failures = 0;
+
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; t++)
+    {
+        readers.emplace_back(
+            [&]
+            {
+                while (!done)
+                {
+                    auto reader = pool.lease();
+                    // values are written in a single statement, so no torn reads are visible
+                    for (auto [key, value] : *reader)
+                        if (value != key * 2)
+                            failures++;
+                }
+            });
+    }
+
+    for (int i = 0; i < 200; i++)
+        pool.set(i, i * 2);
+
+    done = true;
+    for (auto& reader : readers)
+        reader.join();
+
+    REQUIRE(failures == 0);
+    REQUIRE(pool.read([](const auto& sm) { return sm.size(); }) == 200);
+}
+
+TEST_CASE("Connection pool removes temporary database file")
+{
+    std::string temp_file;
+    {
+        sqlitemap_pool pool(config(), 1);
+        temp_file = pool.writer()->config().filename();
+        REQUIRE(fs::exists(temp_file));
+    }
+    REQUIRE_FALSE(fs::exists(temp_file));
+}
+
+TEST_CASE("Connection pool rejects invalid configurations")
+{
+    REQUIRE_THROWS_AS(sqlitemap_pool(config().filename(":memory:")), sqlitemap_error);
+    REQUIRE_THROWS_AS(sqlitemap_pool(config().mode(operation_mode::r)), sqlitemap_error);
+    REQUIRE_THROWS_AS(sqlitemap_pool(config(), 0), sqlitemap_error);
+
+    TempDir temp_dir;
+    auto file = (temp_dir.path() / "db.sqlite").string();
+    sqlitemap(config().filename(file).auto_commit(true)).set("k1", "v1");
+
+    sqlitemap_pool read_only(config().filename(file).mode(operation_mode::r), 1);
+    REQUIRE(read_only.get("k1") == "v1");
+    REQUIRE_THROWS_AS(read_only.writer(), sqlitemap_error);
+}
+
+TEST_CASE("Async sqlitemap executes operations on worker thread")
+{
+    TempDir temp_dir;
+    auto file = (temp_dir.path() / "db.sqlite").string();
+
+    async_sqlitemap sm(config().filename(file).auto_commit(true));
+
+    auto caller = std::this_thread::get_id();
+    auto worker = sm.submit_read([](const auto&) { return std::this_thread::get_id(); });
+    REQUIRE(worker.get() != caller);
+
+    sm.async_set("k1", "v1").get();
+    sm.async_set("k2", "v2").get();
+    sm.async_set("k3", "v3").get();
+
+    REQUIRE(sm.async_get("k1").get() == "v1");
+    REQUIRE_FALSE(sm.async_get("k4").get().has_value());
+
+    auto entries = sm.async_scan("k2", "k9").get();
+    REQUIRE(entries.size() == 2);
+    REQUIRE(entries[0] == std::pair<std::string, std::string>("k2", "v2"));
+    REQUIRE(entries[1] == std::pair<std::string, std::string>("k3", "v3"));
+    REQUIRE(sm.async_scan().get().size() == 3);
+
+    REQUIRE(sm.async_erase("k1").get() == 1);
+    REQUIRE(sm.async_erase("k1").get() == 0);
+    REQUIRE(sm.submit([](auto& map) { return map.size(); }).get() == 2);
+
+    // writes are committed when their futures resolve
+    sqlitemap client(config().filename(file));
+    REQUIRE(client.get("k2") == "v2");
+    REQUIRE_FALSE(client.contains("k1"));
+}
+
+TEST_CASE("Async sqlitemap invokes completion callbacks")
+{
+    async_sqlitemap sm(config<int, std::string>().auto_commit(true));
+
+    std::promise<std::exception_ptr> set_done;
+    sm.async_set(1, "one", [&](std::exception_ptr error) { set_done.set_value(error); });
+    REQUIRE(set_done.get_future().get() == nullptr);
+
+    std::promise<std::optional<std::string>> get_done;
+    sm.async_get(1, [&](std::optional<std::string> value, std::exception_ptr error)
+                 { get_done.set_value(value); });
+    REQUIRE(get_done.get_future().get() == "one");
+
+    std::promise<size_t> scan_done;
+    sm.async_scan(0, 10, [&](std::vector<std::pair<int, std::string>> entries, auto error)
+                  { scan_done.set_value(entries.size()); });
+    REQUIRE(scan_done.get_future().get() == 1);
+
+    std::promise<size_t> erase_done;
+    sm.async_erase(1, [&](size_t num_erased, auto error) { erase_done.set_value(num_erased); });
+    REQUIRE(erase_done.get_future().get() == 1);
+
+    // exceptions thrown by callbacks do not stop the worker
+    sm.async_set(2, "two", [](auto) { throw std::runtime_error("callback failed"); });
+    REQUIRE(sm.async_get(2).get() == "two");
+}
+
+TEST_CASE("Async sqlitemap hands completion callbacks to executor")
+{
+    std::mutex mutex;
+    std::vector<std::function<void()>> posted;
+    auto post = [&](std::function<void()> fn)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        posted.push_back(std::move(fn));
+    };
+    async_sqlitemap sm(config<int, std::string>(), 10, post);
+
+    std::thread::id called_on;
+    std::optional<std::string> value;
+    sm.async_set(1, "one", [](auto) {});
+    sm.async_get(1, [&](std::optional<std::string> v, auto)
+                 {
+                     called_on = std::this_thread::get_id();
+                     value = v;
+                 });
+    sm.async_commit().get();
+
+    // callbacks do not run before the executor runs them on this thread
+    std::vector<std::function<void()>> ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ready.swap(posted);
+    }
+    REQUIRE(ready.size() == 2);
+    REQUIRE_FALSE(value.has_value());
+
+    for (auto& fn : ready)
+        fn();
+    REQUIRE(value == "one");
+    REQUIRE(called_on == std::this_thread::get_id());
+}
+
+TEST_CASE("Async sqlitemap coalesces queued writes into one transaction")
+{
+    async_sqlitemap sm(config<int, int>().auto_commit(true));
+
+    int num_commits = 0;
+    sm.submit(
+          [&](auto& map)
+          {
+              auto on_commit = [](void* count)
+              {
+                  ++*static_cast<int*>(count);
+                  return 0;
+              };
+              sqlite3_commit_hook(map.get_connection(), on_commit, &num_commits);
+          })
+        .get();
+
+    // block the worker until all writes are queued, they would be split into batches otherwise
+    std::promise<void> started;
+    std::promise<void> release;
+    auto blocked = release.get_future().share();
+    sm.submit_read(
+        [&started, blocked](const auto&)
+        {
+            started.set_value();
+            blocked.wait();
+        });
+    started.get_future().wait();
+
+    std::vector<std::future<void>> writes;
+    for (int i = 0; i < 100; i++)
+        writes.push_back(sm.async_set(i, i * i));
+    auto failing = sm.submit([](auto&) -> int { throw std::runtime_error("failed"); });
+
+    release.set_value();
+    for (auto& write : writes)
+        write.get();
+
+    // failing operations do not affect the other operations of their batch
+    REQUIRE_THROWS_AS(failing.get(), std::runtime_error);
+    REQUIRE(num_commits == 1);
+    REQUIRE(sm.async_get(99).get() == 99 * 99);
+    REQUIRE(sm.async_scan().get().size() == 100);
+}
+
+TEST_CASE("Async sqlitemap commits explicitly under auto_commit")
+{
+    TempDir temp_dir;
+    auto file = (temp_dir.path() / "db.sqlite").string();
+
+    async_sqlitemap sm(config().filename(file).auto_commit(true));
+    REQUIRE_NOTHROW(sm.async_commit().get());
+
+    // block the worker so that writes and commit are executed as one coalesced batch
+    std::promise<void> started;
+    std::promise<void> release;
+    auto blocked = release.get_future().share();
+    sm.submit_read(
+        [&started, blocked](const auto&)
+        {
+            started.set_value();
+            blocked.wait();
+        });
+    started.get_future().wait();
+
+    auto write = sm.async_set("k1", "v1");
+    auto commit = sm.async_commit();
+    auto write_after_commit = sm.async_set("k2", "v2");
+
+    release.set_value();
+    REQUIRE_NOTHROW(write.get());
+    REQUIRE_NOTHROW(commit.get());
+    REQUIRE_NOTHROW(write_after_commit.get());
+
+    sqlitemap client(config().filename(file));
+    REQUIRE(client.get("k1") == "v1");
+    REQUIRE(client.get("k2") == "v2");
+}
+
+TEST_CASE("Async sqlitemap reports errors")
+{
+    REQUIRE_THROWS_AS(async_sqlitemap(config().filename("/not/existing/dir/db.sqlite")),
+                      sqlitemap_error);
+
+    TempDir temp_dir;
+    auto file = (temp_dir.path() / "db.sqlite").string();
+    sqlitemap(config().filename(file).auto_commit(true)).set("k1", "v1");
+
+    async_sqlitemap read_only(config().filename(file).mode(operation_mode::r));
+    REQUIRE(read_only.async_get("k1").get() == "v1");
+    REQUIRE_THROWS_AS(read_only.async_set("k2", "v2").get(), sqlitemap_error);
+    REQUIRE_THROWS_AS(read_only.async_erase("k1").get(), sqlitemap_error);
+
+    std::promise<std::exception_ptr> done;
+    read_only.async_set("k2", "v2", [&](std::exception_ptr error) { done.set_value(error); });
+    REQUIRE(done.get_future().get() != nullptr);
+}
+
+TEST_CASE("Async sqlitemap executes pending operations before closing")
+{
+    TempDir temp_dir;
+    auto file = (temp_dir.path() / "db.sqlite").string();
+
+    {
+        async_sqlitemap sm(config<int, int>().filename(file), 10);
+        REQUIRE(sm.max_batch_size() == 10);
+        for (int i = 0; i < 100; i++)
+            sm.async_set(i, i);
+        sm.async_commit();
+    }
+
+    sqlitemap client(config<int, int>().filename(file));
+    REQUIRE(client.size() == 100);
+}
+
+TEST_CASE("Performance profiles apply validated pragmas")
+{
+    TempDir temp_dir;
+    auto file = (temp_dir.path() / "db.sqlite").string();
+
+    auto profile = GENERATE(performance_profile::durable, performance_profile::balanced,
+                            performance_profile::bulk_load, performance_profile::read_mostly);
+
+    std::vector<std::string> warnings;
+    std::string debug_log;
+    auto test_logger = [&](log_level level, const std::string& msg)
+    {
+        if (level == log_level::warn)
+            warnings.push_back(msg);
+        else if (msg.find("Performance profile") != std::string::npos)
+            debug_log = msg;
+    };
+
+    sqlitemap sm(config()
+                     .filename(file)
+                     .profile(profile)
+                     .pragma("cache_size", 100) // explicit pragmas take precedence
+                     .log_level(log_level::debug)
+                     .log_impl(test_logger));
+
+    REQUIRE(sm.config().profile() == profile);
+    REQUIRE(warnings.empty());
+    REQUIRE_THAT(debug_log, Catch::Matchers::ContainsSubstring(to_string(profile)));
+    REQUIRE_THAT(debug_log, Catch::Matchers::ContainsSubstring("journal_mode = wal"));
+
+    auto db = sm.get_connection();
+    for (const auto& [flag, value] : details::profile_pragmas(profile))
+    {
+        if (flag != "cache_size")
+            REQUIRE(details::pragma_value(db, flag) == value);
+    }
+    REQUIRE(details::pragma_value(db, "cache_size") == "100");
+
+    sm.set("k1", "v1");
+    sm.commit();
+    REQUIRE(sm.get("k1") == "v1");
+}
+
+TEST_CASE("Performance profiles report pragmas SQLite could not apply")
+{
+    std::vector<std::string> warnings;
+    auto test_logger = [&](log_level level, const std::string& msg)
+    {
+        if (level == log_level::warn)
+            warnings.push_back(msg);
+    };
+
+    // in-memory databases neither support WAL journal mode nor memory mapped I/O
+    sqlitemap sm(config()
+                     .filename(":memory:")
+                     .profile(performance_profile::balanced)
+                     .log_level(log_level::warn)
+                     .log_impl(test_logger));
+
+    REQUIRE(warnings.size() == 2);
+    REQUIRE_THAT(warnings[0], Catch::Matchers::ContainsSubstring("journal_mode = wal"));
+    REQUIRE_THAT(warnings[1], Catch::Matchers::ContainsSubstring("mmap_size"));
+    REQUIRE(details::profile_pragmas(performance_profile::none).empty());
+    REQUIRE(config().profile() == performance_profile::none);
+}
+
+TEST_CASE("Erase entries matching a SQL condition")
+{
+    auto auto_commit = GENERATE(false, true);
+    sqlitemap sm(config<std::string, int>().auto_commit(auto_commit));
+    sm.set_many({{"tmp_a", 1}, {"tmp_b", 2}, {"keep_a", 3}, {"keep_b", 40}, {"tmp_c", 50}});
+
+    REQUIRE(sm.erase_where("key LIKE ?", "tmp_%") == 3);
+    REQUIRE(sm.size() == 2);
+    REQUIRE(sm.contains("keep_a"));
+
+    REQUIRE(sm.erase_where("value > ? AND key = ?", 10, std::string("keep_b")) == 1);
+    REQUIRE(sm.erase_where("value > ?", 10) == 0);
+    REQUIRE(sm.size() == 1);
+
+    REQUIRE(sm.erase_where("1") == 1);
+    REQUIRE(sm.empty());
+
+    REQUIRE_THROWS_AS(sm.erase_where("no_such_column = 1"), sqlitemap_error);
+
+    sm.commit();
+    REQUIRE(sm.empty());
+}
+
+TEST_CASE("Erase range of keys")
+{
+    sqlitemap sm(config<int, int>());
+    for (int i = 0; i < 10; i++)
+        sm.set(i, i);
+
+    REQUIRE(sm.erase_range(3, 6) == 3);
+    REQUIRE(sm.erase_range(3, 6) == 0);
+    REQUIRE(sm.erase_range(8, 100) == 2);
+    REQUIRE(sm.size() == 5);
+
+    std::vector<int> keys;
+    for (auto it = sm.keys_begin(); it != sm.keys_end(); ++it)
+        keys.push_back(*it);
+    REQUIRE(keys == std::vector<int>{0, 1, 2, 6, 7});
+
+    sm.rollback();
+    REQUIRE(sm.empty());
+}
+
+TEST_CASE("Erase if deletes matches within one savepoint")
+{
+    sqlitemap sm(config<int, int>().auto_commit(true));
+    for (int i = 0; i < 100; i++)
+        sm.set(i, i * 10);
+
+    auto num_erased = sm.erase_if([](const auto& entry) { return entry.first % 3 == 0; });
+    REQUIRE(num_erased == 34);
+    REQUIRE(sm.size() == 66);
+    REQUIRE(sqlite3_get_autocommit(sm.get_connection()) != 0);
+
+    REQUIRE(sm.erase_if([](const auto& entry) { return entry.second < 0; }) == 0);
+
+    // nothing is erased when predicate throws
+    REQUIRE_THROWS(sm.erase_if(
+        [](const auto& entry) -> bool { throw std::runtime_error("predicate failed"); }));
+    REQUIRE(sm.size() == 66);
+}
+
+TEST_CASE("Value cache serves repeated reads")
+{
+    int num_decoded = 0;
+    auto vc = value_codec([](int v) { return std::to_string(v); },
+                          [&](const std::string& v)
+                          {
+                              num_decoded++;
+                              return std::stoi(v);
+                          });
+
+    sqlitemap sm(config(vc).value_cache_size(2));
+    REQUIRE(sm.cache_stats().size == 0);
+
+    sm.set("k1", 1);
+    sm.set("k2", 2);
+    sm.set("k3", 3);
+
+    REQUIRE(sm.get("k1") == 1);
+    REQUIRE(sm.get("k1") == 1);
+    REQUIRE(sm["k1"] == 1);
+    REQUIRE(num_decoded == 1);
+
+    auto stats = sm.cache_stats();
+    REQUIRE(stats.hits == 2);
+    REQUIRE(stats.misses == 1);
+    REQUIRE(stats.size == 1);
+    REQUIRE(stats.num_bytes == 1);
+
+    // least recently used entry gets evicted
+    sm.get("k2");
+    sm.get("k1");
+    sm.get("k3");
+    REQUIRE(sm.cache_stats().size == 2);
+    num_decoded = 0;
+    sm.get("k1");
+    REQUIRE(num_decoded == 0);
+    sm.get("k2");
+    REQUIRE(num_decoded == 1);
+
+    // misses are not cached
+    REQUIRE_FALSE(sm.try_get("unknown").has_value());
+    REQUIRE_FALSE(sm.try_get("unknown").has_value());
+    REQUIRE(sm.cache_stats().size == 2);
+
+    // disabled by default
+    sqlitemap uncached;
+    uncached.set("k1", "v1");
+    uncached.get("k1");
+    REQUIRE(uncached.cache_stats().hits == 0);
+    REQUIRE(uncached.cache_stats().misses == 0);
+}
+
+TEST_CASE("Value cache respects its byte budget")
+{
+    sqlitemap sm(config().value_cache_size(100).value_cache_bytes(10));
+    sm.set("small", "12345");
+    sm.set("medium", "1234567");
+    sm.set("large", "12345678901");
+
+    sm.get("large"); // exceeds byte budget on its own
+    REQUIRE(sm.cache_stats().size == 0);
+
+    sm.get("small");
+    sm.get("medium"); // evicts small
+    REQUIRE(sm.cache_stats().size == 1);
+    REQUIRE(sm.cache_stats().num_bytes == 7);
+}
+
+TEST_CASE("Value cache is invalidated by writes")
+{
+    sqlitemap sm(config<std::string, int>().value_cache_size(100));
+    auto fill = [&]
+    {
+        for (int i = 0; i < 5; i++)
+        {
+            sm.set("k" + std::to_string(i), i);
+            sm.get("k" + std::to_string(i));
+        }
+        REQUIRE(sm.cache_stats().size == 5);
+    };
+
+    fill();
+    sm.set("k1", 10);
+    REQUIRE(sm.get("k1") == 10);
+
+    sm["k2"] = 20;
+    REQUIRE(sm.get("k2") == 20);
+
+    sm.del("k3");
+    REQUIRE_FALSE(sm.try_get("k3").has_value());
+
+    REQUIRE(sm.erase("k4") == 1);
+    REQUIRE_FALSE(sm.try_get("k4").has_value());
+
+    sm.set_many({{"k0", 100}, {"k5", 5}});
+    REQUIRE(sm.get("k0") == 100);
+
+    sm.erase_if([](const auto& entry) { return entry.first == "k0"; });
+    REQUIRE_FALSE(sm.try_get("k0").has_value());
+
+    fill();
+    sm.erase_range("k1", "k3");
+    REQUIRE(sm.cache_stats().size == 0);
+    REQUIRE_FALSE(sm.try_get("k1").has_value());
+    REQUIRE(sm.get("k3") == 3);
+
+    fill();
+    sm.erase_where("value > ?", 2);
+    REQUIRE(sm.cache_stats().size == 0);
+    REQUIRE_FALSE(sm.try_get("k4").has_value());
+
+    fill();
+    sm.clear();
+    REQUIRE(sm.cache_stats().size == 0);
+    REQUIRE_FALSE(sm.try_get("k0").has_value());
+}
+
+TEST_CASE("Value cache is invalidated by rollback")
+{
+    TempDir temp_dir;
+    auto file = (temp_dir.path() / "db.sqlite").string();
+
+    sqlitemap sm(config<std::string, int>().filename(file).value_cache_size(100));
+    sm.set("k1", 1);
+    sm.set("k2", 2);
+    sm.commit();
+    REQUIRE(sm.get("k1") == 1);
+
+    // values written and read within a transaction are discarded by rollback
+    sm.set("k1", 10);
+    sm.set("k3", 3);
+    REQUIRE(sm.get("k1") == 10);
+    REQUIRE(sm.get("k3") == 3);
+    sm.del("k2");
+    REQUIRE_FALSE(sm.try_get("k2").has_value());
+
+    sm.rollback();
+    REQUIRE(sm.cache_stats().size == 0);
+    REQUIRE(sm.get("k1") == 1);
+    REQUIRE(sm.get("k2") == 2);
+    REQUIRE_FALSE(sm.try_get("k3").has_value());
+
+    // failing bulk writes roll back their savepoint, cached values stay consistent
+    auto vc = value_codec([](int v)
+                          {
+                              if (v < 0)
+                                  throw std::runtime_error("negative");
+                              return v;
+                          },
+                          [](int v) { return v; });
+    sqlitemap strict(config(vc).filename(file).table("strict").value_cache_size(100));
+    strict.set("k1", 1);
+    REQUIRE(strict.get("k1") == 1);
+    REQUIRE_THROWS(strict.set_many({{"k1", 10}, {"k2", -1}}));
+    REQUIRE(strict.get("k1") == 1);
+}
+
+TEST_CASE("Write-behind buffer flushes on row threshold")
+{
+    TempDir temp_dir;
+    auto file = (temp_dir.path() / "db.sqlite").string();
+
+    sqlitemap sm(config<int, std::string>().filename(file).auto_commit(true).write_behind_rows(3));
+    sqlitemap other(config<int, std::string>().filename(file).mode(operation_mode::r));
+
+    sm.set(1, "v1");
+    sm.set(2, "v2");
+    sm.set(2, "v2-updated"); // same key, still two pending writes
+    REQUIRE(other.size() == 0);
+
+    // reads see pending writes
+    REQUIRE(sm.get(2) == "v2-updated");
+    REQUIRE(sm.contains(1));
+
+    sm.del(1);
+    REQUIRE_FALSE(sm.contains(1));
+    REQUIRE_FALSE(sm.try_get(1).has_value());
+    REQUIRE(other.size() == 0);
+
+    sm.set(3, "v3"); // third pending key, all pending writes flushed within one transaction
+    REQUIRE(other.size() == 2);
+    REQUIRE(other.get(2) == "v2-updated");
+    REQUIRE_FALSE(other.contains(1));
+
+    sm.set(4, "v4");
+    REQUIRE(other.size() == 2);
+    sm.flush();
+    REQUIRE(other.size() == 3);
+}
+
+TEST_CASE("Write-behind buffer flushes on byte threshold")
+{
+    TempDir temp_dir;
+    auto file = (temp_dir.path() / "db.sqlite").string();
+    sqlitemap other(config().filename(file));
+
+    {
+        sqlitemap sm(config()
+                         .filename(file)
+                         .auto_commit(true)
+                         .write_behind_rows(1000)
+                         .write_behind_bytes(20));
+        sm.set("k1", "0123456789"); // 12 bytes
+        REQUIRE_FALSE(other.contains("k1"));
+        sm.set("k2", "0123456789"); // 24 bytes
+        REQUIRE(other.contains("k2"));
+
+        sm.set("k3", "v3");
+        REQUIRE(sm.contains("k3"));
+        REQUIRE_FALSE(other.contains("k3")); // reads never flush
+    } // close flushes pending writes
+    REQUIRE(other.contains("k3"));
+}
+
+TEST_CASE("Write-behind buffer is seen by point reads and flushed before writes")
+{
+    sqlitemap sm(config<int, int>().write_behind_rows(1000));
+    sm.set(1, 1);
+    sm.set(2, 2);
+    sm.set(3, 3);
+
+    // point reads see pending writes
+    REQUIRE(sm.contains(1));
+    auto values = sm.get_many({3, 1, 9});
+    REQUIRE(values[0] == 3);
+    REQUIRE(values[1] == 1);
+    REQUIRE_FALSE(values[2].has_value());
+
+    // other queries only see flushed writes
+    REQUIRE(sm.size() == 0);
+    REQUIRE(sm.empty());
+    sm.flush();
+    REQUIRE(sm.size() == 3);
+
+    sm.set(4, 4);
+    sm.del(1);
+    REQUIRE(std::distance(sm.begin(), sm.end()) == 3);
+    REQUIRE(sm.begin()->first == 1);
+    sm.flush();
+    REQUIRE(sm.begin()->first == 2);
+
+    sm.set(5, 5);
+    REQUIRE(sm.lower_bound(5) == sm.end());
+    sm.set(2, 20);
+    values = sm.get_many({2});
+    REQUIRE(values[0] == 20);
+
+    // writes to the database flush pending writes first
+    sm.set(6, 6);
+    REQUIRE(sm.erase_range(5, 7) == 2);
+
+    sm.set(7, 7);
+    REQUIRE(sm.erase_where("key > ?", 6) == 1);
+    REQUIRE(sm.size() == 3);
+    REQUIRE(sm.get(2) == 20);
+}
+
+TEST_CASE("Write-behind buffer follows transactions")
+{
+    TempDir temp_dir;
+    auto file = (temp_dir.path() / "db.sqlite").string();
+    sqlitemap other(config<int, int>().filename(file));
+
+    sqlitemap sm(config<int, int>().filename(file).write_behind_rows(1000));
+    sm.set(1, 1);
+    sm.commit();
+    REQUIRE(other.get(1) == 1);
+
+    // pending and flushed writes of the transaction are discarded by rollback
+    sm.set(2, 2);
+    sm.flush();
+    sm.set(3, 3);
+    sm.rollback();
+    REQUIRE_FALSE(sm.contains(2));
+    REQUIRE_FALSE(sm.contains(3));
+    REQUIRE(sm.size() == 1);
+
+    // without write-behind nothing is buffered
+    sqlitemap direct(config<int, int>().filename(file).auto_commit(true));
+    direct.set(4, 4);
+    REQUIRE(other.get(4) == 4);
+}
+
+TEST_CASE("Write-behind buffer survives rollback under auto_commit")
+{
+    TempDir temp_dir;
+    auto file = (temp_dir.path() / "db.sqlite").string();
+    sqlitemap other(config<int, int>().filename(file));
+
+    sqlitemap sm(config<int, int>().filename(file).auto_commit(true).write_behind_rows(1000));
+    sm.set(1, 1);
+    sm.rollback(); // pending writes count as committed, rollback flushes them
+    REQUIRE(sm.get(1) == 1);
+    REQUIRE(other.get(1) == 1);
+}
+
+TEST_CASE("Write-behind buffer keeps pending writes when flushing fails")
+{
+    TempDir temp_dir;
+    auto file = (temp_dir.path() / "db.sqlite").string();
+    sqlitemap other(config<int, int>().filename(file).auto_commit(true));
+
+    sqlitemap sm(config<int, int>().filename(file).auto_commit(true).write_behind_rows(1000));
+    sm.set(1, 1);
+    sm.set(2, 2);
+
+    // a conflicting writer holds the lock
+    details::exec_checked(other.get_connection(), "BEGIN EXCLUSIVE");
+    REQUIRE_THROWS_AS(sm.flush(), sqlitemap_error);
+    REQUIRE(sm.get(1) == 1);
+    REQUIRE(sm.get(2) == 2);
+
+    details::exec_checked(other.get_connection(), "COMMIT");
+    sm.flush();
+    REQUIRE(other.get(1) == 1);
+    REQUIRE(other.get(2) == 2);
+}
+
+TEST_CASE("Visit values without copying them")
+{
+    sqlitemap sm(config());
+    sm.set("k1", "value one");
+
+    std::string visited;
+    REQUIRE(sm.visit("k1",
+                     [&](std::string_view value)
+                     {
+                         static_assert(std::is_same_v<decltype(value), std::string_view>);
+                         visited = value;
+                     }));
+    REQUIRE(visited == "value one");
+    REQUIRE_FALSE(sm.visit("unknown", [&](std::string_view value) { FAIL("not expected"); }));
+
+    sqlitemap smb(config<std::string, blob>());
+    smb.set("b1", blob{std::byte{1}, std::byte{2}, std::byte{3}});
+    smb.set("b2", blob{});
+
+    size_t sum = 0;
+    smb.visit("b1",
+              [&](blob_view value)
+              {
+                  REQUIRE(value.size() == 3);
+                  for (auto b : value)
+                      sum += std::to_integer<size_t>(b);
+              });
+    REQUIRE(sum == 6);
+    smb.visit("b2", [&](blob_view value) { REQUIRE(value.empty()); });
+
+#ifdef __cpp_lib_span
+    smb.visit("b1", [](std::span<const std::byte> value) { REQUIRE(value.size() == 3); });
+#endif
+
+    sqlitemap smi(config<int, int>());
+    smi.set(1, 42);
+    smi.visit(1, [](int value) { REQUIRE(value == 42); });
+}
+
+TEST_CASE("Visit all entries without copying values")
+{
+    sqlitemap sm(config<int, blob>());
+    for (int i = 0; i < 10; i++)
+        sm.set(i, blob(i * 100, std::byte{1}));
+
+    size_t total_size = 0;
+    std::vector<int> keys;
+    auto num_visited = sm.visit_all(
+        [&](int key, blob_view value)
+        {
+            keys.push_back(key);
+            total_size += value.size();
+        });
+
+    REQUIRE(num_visited == 10);
+    REQUIRE(keys.size() == 10);
+    REQUIRE(total_size == 4500);
+
+    sqlitemap empty_map;
+    REQUIRE(empty_map.visit_all([](const auto&, auto) { FAIL("not expected"); }) == 0);
+}
+
+TEST_CASE("Visit sees pending writes")
+{
+    sqlitemap sm(config().write_behind_rows(100));
+    sm.set("k1", "pending");
+    sm.set("k2", "deleted");
+    sm.del("k2");
+
+    std::string visited;
+    REQUIRE(sm.visit("k1", [&](std::string_view value) { visited = value; }));
+    REQUIRE(visited == "pending");
+    REQUIRE_FALSE(sm.visit("k2", [&](std::string_view value) { FAIL("not expected"); }));
+
+    // like other scans visit_all only sees flushed writes
+    REQUIRE(sm.visit_all([](const std::string&, std::string_view) {}) == 0);
+    sm.flush();
+    REQUIRE(sm.visit_all([](const std::string&, std::string_view) {}) == 1);
+}
+
+TEST_CASE("Stream large blobs in chunks")
+{
+    sqlitemap sm(config<std::string, blob>().auto_commit(true));
+
+    const size_t chunk_size = 4096;
+    const size_t num_chunks = 256;
+    {
+        auto writer = sm.write_blob("large", chunk_size * num_chunks);
+        REQUIRE(writer.size() == chunk_size * num_chunks);
+
+        blob chunk(chunk_size);
+        for (size_t i = 0; i < num_chunks; i++)
+        {
+            std::fill(chunk.begin(), chunk.end(), std::byte(i % 256));
+            writer.write(i * chunk_size, chunk);
+        }
+
+        REQUIRE_THROWS_AS(writer.write(writer.size() - 1, chunk), sqlitemap_error);
+    }
+
+    auto reader = sm.read_blob("large");
+    REQUIRE(reader.size() == chunk_size * num_chunks);
+    for (size_t i = 0; i < num_chunks; i += 17)
+    {
+        auto chunk = reader.read(i * chunk_size, chunk_size);
+        REQUIRE(chunk.size() == chunk_size);
+        REQUIRE(chunk.front() == std::byte(i % 256));
+        REQUIRE(chunk.back() == std::byte(i % 256));
+    }
+
+    // reads are truncated at the end of the blob
+    REQUIRE(reader.read(reader.size() - 10, chunk_size).size() == 10);
+    REQUIRE(reader.read(reader.size() + 10, chunk_size).empty());
+
+    std::byte buffer[8];
+    REQUIRE(reader.read(chunk_size, buffer, sizeof(buffer)) == sizeof(buffer));
+    REQUIRE(buffer[0] == std::byte{1});
+    reader.close();
+
+    REQUIRE(sm.get("large").size() == chunk_size * num_chunks);
+}
+
+TEST_CASE("Update blobs in place")
+{
+    sqlitemap sm(config<std::string, blob>().value_cache_size(10));
+    sm.set("b", blob(8, std::byte{0}));
+    REQUIRE(sm.get("b") == blob(8, std::byte{0})); // cached
+
+    {
+        auto writer = sm.update_blob("b");
+        writer.write(2, blob{std::byte{7}, std::byte{7}});
+    }
+    REQUIRE(sm.get("b")[2] == std::byte{7});
+    REQUIRE(sm.get("b")[4] == std::byte{0});
+
+    // handles expire when the entry is modified by other means
+    auto reader = sm.read_blob("b");
+    sm.set("b", blob(4, std::byte{1}));
+    REQUIRE_THROWS_AS(reader.read(0, 4), sqlitemap_error);
+    reader.close();
+
+    // writes belong to the surrounding transaction
+    sm.commit();
+    sm.write_blob("new", 16);
+    sm.rollback();
+    REQUIRE_FALSE(sm.contains("new"));
+
+    REQUIRE_THROWS_AS(sm.read_blob("unknown"), sqlitemap_error);
+    REQUIRE_THROWS_AS(sm.update_blob("unknown"), sqlitemap_error);
+}
+
+TEST_CASE("Blob writes invalidate values cached while the handle is open")
+{
+    sqlitemap sm(config<std::string, blob>().value_cache_size(10));
+    sm.set("b", blob(4, std::byte{0}));
+
+    auto writer = sm.update_blob("b");
+    REQUIRE(sm.get("b") == blob(4, std::byte{0})); // cached while the handle is open
+    writer.write(0, blob{std::byte{1}});
+    REQUIRE(sm.get("b")[0] == std::byte{1});
+    writer.write(1, blob{std::byte{2}});
+    REQUIRE(sm.get("b")[1] == std::byte{2});
+
+    auto moved = std::move(writer);
+    moved.write(2, blob{std::byte{3}});
+    REQUIRE(sm.get("b")[2] == std::byte{3});
+    moved.close();
+    REQUIRE(sm.get("b") == blob{std::byte{1}, std::byte{2}, std::byte{3}, std::byte{0}});
+
+    auto new_writer = sm.write_blob("n", 2);
+    REQUIRE(sm.get("n") == blob(2, std::byte{0}));
+    new_writer.write(0, blob{std::byte{5}, std::byte{6}});
+    REQUIRE(sm.get("n") == blob{std::byte{5}, std::byte{6}});
+}
+
+TEST_CASE("Blob handles require blobs stored without transformation")
+{
+    STATIC_REQUIRE(decltype(sqlitemap(config<std::string, blob>()))::supports_blob_handles);
+    STATIC_REQUIRE_FALSE(decltype(sqlitemap(config()))::supports_blob_handles);
+
+    // value codecs transforming the blob would be bypassed by blob handles
+    auto reversing = value_codec(
+        +[](const blob& b) { return blob(b.rbegin(), b.rend()); },
+        +[](const blob& b) { return blob(b.rbegin(), b.rend()); });
+    STATIC_REQUIRE_FALSE(
+        decltype(sqlitemap(config(key_codec<std::string>(), reversing)))::supports_blob_handles);
+
+    codecs::value_codec<blob, blob> type_erased = value_codec<blob>();
+    STATIC_REQUIRE_FALSE(
+        decltype(sqlitemap(config(key_codec<std::string>(), type_erased)))::supports_blob_handles);
+}
+
+TEST_CASE("Text with embedded nul characters is stored completely")
+{
+    sqlitemap sm(config().value_cache_size(0));
+    std::string key("k\0ey", 4);
+    std::string value("va\0lue", 6);
+
+    sm.set(key, value);
+    REQUIRE(sm.get(key) == value);
+    REQUIRE(sm.get(key).size() == 6);
+    REQUIRE_FALSE(sm.contains("k"));
+
+    sm.set_many({{key, "updated"}});
+    REQUIRE(sm.get(key) == "updated");
+
+    auto it = sm.begin();
+    REQUIRE(it->first == key);
+
+    sm.del(key);
+    REQUIRE(sm.empty());
+}
+
+TEST_CASE("Metrics record calls, errors and latencies per operation")
+{
+    sqlitemap sm(config<int, std::string>().metrics(true));
+    // committing the table created on connect is no call of the user
+    REQUIRE(sm.metrics()[metric_operation::commit].calls == 0);
+
+    sm.set(1, "one");
+    sm.set(2, "two");
+    REQUIRE(sm.get(1) == "one");
+    REQUIRE_FALSE(sm.try_get(3).has_value());
+    REQUIRE_THROWS_AS(sm.get(4), sqlitemap_error);
+    REQUIRE(sm.contains(2));
+    sm.del(2);
+    REQUIRE(sm.size() == 1);
+    for (const auto& entry : sm)
+        REQUIRE(entry.first == 1);
+    sm.commit();
+    sm.rollback();
+
+    auto metrics = sm.metrics();
+    auto& set = metrics[metric_operation::set];
+    REQUIRE(set.calls == 2);
+    REQUIRE(set.errors == 0);
+    REQUIRE(set.latency().count == 2);
+    REQUIRE(set.latency(metric_phase::encode).count == 2);
+    REQUIRE(set.latency(metric_phase::prepare).count == 2);
+    REQUIRE(set.latency(metric_phase::step).count == 2);
+    REQUIRE(set.latency(metric_phase::decode).count == 0);
+
+    // get is measured by try_get, missing keys are not counted as errors
+    auto& get = metrics[metric_operation::get];
+    REQUIRE(get.calls == 3);
+    REQUIRE(get.errors == 0);
+    REQUIRE(get.latency(metric_phase::decode).count == 1);
+
+    REQUIRE(metrics[metric_operation::count].calls == 1);
+    REQUIRE(metrics[metric_operation::del].calls == 1);
+    REQUIRE(metrics[metric_operation::size].calls == 1);
+    REQUIRE(metrics[metric_operation::commit].calls == 1);
+    REQUIRE(metrics[metric_operation::rollback].calls == 1);
+
+    // one step per row and a final one finding no more rows
+    auto& iterate = metrics[metric_operation::iterate];
+    REQUIRE(iterate.calls == 2);
+    REQUIRE(iterate.latency(metric_phase::decode).count == 1);
+    REQUIRE(iterate.latency(metric_phase::prepare).count == 1);
+
+    auto total = set.latency();
+    REQUIRE(total.percentile(0.5) <= total.percentile(0.99));
+    REQUIRE(total.percentile(1.0) >= total.mean());
+
+    sm.reset_metrics();
+    REQUIRE(sm.metrics()[metric_operation::set].calls == 0);
+}
+
+TEST_CASE("Metrics count errors")
+{
+    TempDir temp_dir;
+    auto file = (temp_dir.path() / "db.sqlite").string();
+    sqlitemap(config().filename(file).auto_commit(true)).set("k1", "v1");
+
+    sqlitemap sm(config().filename(file).mode(operation_mode::r).metrics(true));
+    REQUIRE_THROWS_AS(sm.set("k2", "v2"), sqlitemap_error);
+    REQUIRE_THROWS_AS(sm.del("k1"), sqlitemap_error);
+
+    auto metrics = sm.metrics();
+    REQUIRE(metrics[metric_operation::set].calls == 1);
+    REQUIRE(metrics[metric_operation::set].errors == 1);
+    REQUIRE(metrics[metric_operation::del].errors == 1);
+}
+
+TEST_CASE("Metrics are disabled by default")
+{
+    auto cfg = config<int, int>();
+    sqlitemap sm(cfg);
+    sm.set(1, 1);
+    REQUIRE(sm.get(1) == 1);
+    REQUIRE(sm.metrics()[metric_operation::set].calls == 0);
+    REQUIRE_FALSE(sm.config().metrics());
+
+    // maps created from the same configuration record their own metrics
+    cfg.metrics(true);
+    sqlitemap a(cfg);
+    sqlitemap b(cfg);
+    a.set(1, 1);
+    REQUIRE(a.metrics()[metric_operation::set].calls == 1);
+    REQUIRE(b.metrics()[metric_operation::set].calls == 0);
+}
+
+TEST_CASE("Latency histogram percentiles")
+{
+    latency_histogram histogram;
+    REQUIRE(histogram.percentile(0.99).count() == 0);
+    REQUIRE(histogram.mean().count() == 0);
+
+    // 90 latencies within [512, 1023] ns and 10 within [65536, 131071] ns
+    histogram.buckets[10] = 90;
+    histogram.buckets[17] = 10;
+    histogram.count = 100;
+    histogram.sum_ns = 90 * 600 + 10 * 70000;
+
+    REQUIRE(histogram.percentile(0.0).count() == 1023);
+    REQUIRE(histogram.percentile(0.5).count() == 1023);
+    REQUIRE(histogram.percentile(0.95).count() == 131071);
+    REQUIRE(histogram.percentile(1.0).count() == 131071);
+    REQUIRE(histogram.mean().count() == 7540);
+}
+
+TEST_CASE("Stats report SQLite internals and statement statistics")
+{
+    TempDir temp_dir;
+    auto file = (temp_dir.path() / "db.sqlite").string();
+    sqlitemap sm(config<int, std::string>().filename(file).auto_commit(true));
+
+    for (int i = 0; i < 100; i++)
+        sm.set(i, std::string(100, 'x'));
+    for (int i = 0; i < 10; i++)
+        REQUIRE(sm.try_get(i).has_value());
+
+    auto stats = sm.stats();
+    REQUIRE(stats.cache_hits > 0);
+    REQUIRE(stats.cache_memory > 0);
+    REQUIRE(stats.schema_memory > 0);
+    REQUIRE(stats.memory_used > 0);
+    REQUIRE(stats.memory_highwater >= stats.memory_used);
+
+    auto statement = [&](const std::string& shape)
+    {
+        auto it = std::find_if(stats.statements.begin(), stats.statements.end(),
+                               [&](const auto& s) { return s.shape == shape; });
+        REQUIRE(it != stats.statements.end());
+        return *it;
+    };
+
+    auto lookups = statement("SELECT value FROM :table WHERE key = ?");
+    REQUIRE(lookups.runs == 10);
+    REQUIRE(lookups.fullscan_steps == 0); // primary key lookups do not scan
+    REQUIRE(lookups.sorts == 0);
+    REQUIRE(statement("REPLACE INTO :table (key, value) VALUES (?,?)").runs == 100);
+}
+
+TEST_CASE("Tracing logs slow statements with expanded sql")
+{
+    std::vector<std::string> warnings;
+    auto log_impl = [&](log_level level, const std::string& msg)
+    {
+        if (level == log_level::warn)
+            warnings.push_back(msg);
+    };
+    auto cfg = config().log_level(log_level::warn).log_impl(log_impl);
+
+    SECTION("statements at or above the threshold are logged")
+    {
+        sqlitemap sm(cfg.trace(true).slow_query_threshold(std::chrono::nanoseconds(0)));
+        sm.set("k1", "v1");
+        warnings.clear();
+
+        REQUIRE(sm.get("k1") == "v1");
+        REQUIRE(warnings.size() == 1);
+        REQUIRE_THAT(warnings[0], Catch::Matchers::ContainsSubstring(" ns: SELECT value FROM"));
+        REQUIRE_THAT(warnings[0], Catch::Matchers::ContainsSubstring("WHERE key = 'k1'"));
+        REQUIRE_THAT(warnings[0], Catch::Matchers::ContainsSubstring(sm.config().filename()));
+    }
+
+    SECTION("fast statements are not logged")
+    {
+        sqlitemap sm(cfg.trace(true).slow_query_threshold(std::chrono::hours(1)));
+        sm.set("k1", "v1");
+        REQUIRE(sm.get("k1") == "v1");
+        REQUIRE(warnings.empty());
+    }
+
+    SECTION("sampling drops slow statements")
+    {
+        sqlitemap sm(cfg.trace(true)
+                         .slow_query_threshold(std::chrono::nanoseconds(0))
+                         .trace_sample_rate(0.0));
+        sm.set("k1", "v1");
+        REQUIRE(sm.get("k1") == "v1");
+        REQUIRE(warnings.empty());
+    }
+
+    SECTION("tracing is disabled by default")
+    {
+        REQUIRE_FALSE(cfg.trace());
+        sqlitemap sm(cfg.slow_query_threshold(std::chrono::nanoseconds(0)));
+        sm.set("k1", "v1");
+        REQUIRE(warnings.empty());
+    }
+
+    SECTION("tracing survives moving the map")
+    {
+        sqlitemap sm(cfg.trace(true).slow_query_threshold(std::chrono::nanoseconds(0)));
+        sqlitemap moved(std::move(sm));
+        warnings.clear();
+        REQUIRE(moved.count("k1") == 0);
+        REQUIRE(warnings.size() == 1);
+    }
+
+    SECTION("later changes of the logger apply to slow statements")
+    {
+        sqlitemap sm(cfg.trace(true).slow_query_threshold(std::chrono::nanoseconds(0)));
+        sm.set("k1", "v1");
+
+        sm.log().set_level(log_level::error);
+        warnings.clear();
+        REQUIRE(sm.get("k1") == "v1");
+        REQUIRE(warnings.empty());
+
+        std::vector<std::string> redirected;
+        sm.log().set_level(log_level::warn);
+        sm.log().register_log_impl([&](log_level, const std::string& msg)
+                                   { redirected.push_back(msg); });
+        REQUIRE(sm.get("k1") == "v1");
+        REQUIRE(warnings.empty());
+        REQUIRE(redirected.size() == 1);
+    }
+}
+
+TEST_CASE("Iteration follows insertion order by default")
+{
+    sqlitemap sm;
+    REQUIRE(sm.config().iteration_order() == iteration_order::insertion);
+
+    sm.set("c", "3");
+    sm.set("a", "1");
+    sm.set("b", "2");
+
+    std::vector<std::string> keys;
+    for (const auto& entry : sm)
+        keys.push_back(entry.first);
+    REQUIRE(keys == std::vector<std::string>{"c", "a", "b"});
+
+    std::vector<std::string> reversed;
+    for (auto it = sm.values_rbegin(); it != sm.values_rend(); ++it)
+        reversed.push_back(*it);
+    REQUIRE(reversed == std::vector<std::string>{"2", "1", "3"});
+}
+
+TEST_CASE("Iteration in key order")
+{
+    sqlitemap sm(config().iteration_order(iteration_order::key));
+    for (auto key : {"m", "b", "z", "a", "k"})
+        sm.set(key, std::string(key) + key);
+
+    std::vector<std::string> keys;
+    for (const auto& [key, value] : sm)
+    {
+        REQUIRE(value == key + key);
+        keys.push_back(key);
+    }
+    REQUIRE(keys == std::vector<std::string>{"a", "b", "k", "m", "z"});
+
+    std::vector<std::string> reversed;
+    for (auto it = sm.rbegin(); it != sm.rend(); ++it)
+        reversed.push_back(it->first);
+    REQUIRE(reversed == std::vector<std::string>{"z", "m", "k", "b", "a"});
+
+    std::vector<std::string> values;
+    for (auto it = sm.values_cbegin(); it != sm.values_cend(); ++it)
+        values.push_back(*it);
+    REQUIRE(values == std::vector<std::string>{"aa", "bb", "kk", "mm", "zz"});
+
+    std::vector<std::string> reversed_keys;
+    for (auto it = sm.keys_crbegin(); it != sm.keys_crend(); ++it)
+        reversed_keys.push_back(*it);
+    REQUIRE(reversed_keys == std::vector<std::string>{"z", "m", "k", "b", "a"});
+}
+
+TEST_CASE("Maps iterated in key order can be diffed in one pass")
+{
+    auto cfg = config<int, int>().iteration_order(iteration_order::key);
+    sqlitemap left(cfg);
+    sqlitemap right(cfg);
+    left.set_many({{5, 5}, {1, 1}, {3, 3}, {7, 7}});
+    right.set_many({{3, 3}, {7, 70}, {2, 2}, {5, 5}});
+
+    std::vector<int> only_left;
+    std::vector<int> only_right;
+    std::vector<int> changed;
+
+    auto l = left.cbegin();
+    auto r = right.cbegin();
+    while (l != left.cend() || r != right.cend())
+    {
+        if (r == right.cend() || (l != left.cend() && l->first < r->first))
+        {
+            only_left.push_back(l->first);
+            ++l;
+        }
+        else if (l == left.cend() || r->first < l->first)
+        {
+            only_right.push_back(r->first);
+            ++r;
+        }
+        else
+        {
+            if (l->second != r->second)
+                changed.push_back(l->first);
+            ++l;
+            ++r;
+        }
+    }
+
+    REQUIRE(only_left == std::vector<int>{1});
+    REQUIRE(only_right == std::vector<int>{2});
+    REQUIRE(changed == std::vector<int>{7});
+}
+
+TEST_CASE("WITHOUT ROWID table layout")
+{
+    TempDir temp_dir;
+    auto file = (temp_dir.path() / "db.sqlite").string();
+    sqlitemap sm(config<std::string, blob>()
+                     .filename(file)
+                     .table_layout(table_layout::without_rowid)
+                     .row_counter(true));
+
+    std::string create_sql;
+    auto query = "SELECT sql FROM sqlite_master WHERE name = 'unnamed'";
+    details::exec_checked(sm.get_connection(), query,
+                          [](void* out, int, char** values, char**)
+                          {
+                              *static_cast<std::string*>(out) = values[0];
+                              return 0;
+                          },
+                          &create_sql);
+    REQUIRE_THAT(create_sql, Catch::Matchers::ContainsSubstring("WITHOUT ROWID"));
+
+    for (auto key : {"m", "b", "z", "a"})
+        sm.set(key, blob{std::byte(key[0])});
+    sm.del("z");
+    REQUIRE(sm.size() == 3);
+    REQUIRE(sm.get("b") == blob{std::byte('b')});
+    REQUIRE(sm.contains("m"));
+    REQUIRE_FALSE(sm.contains("z"));
+
+    // rows are clustered by key, reverse iteration is key ordered as well
+    std::vector<std::string> keys;
+    for (const auto& entry : sm)
+        keys.push_back(entry.first);
+    REQUIRE(keys == std::vector<std::string>{"a", "b", "m"});
+
+    std::vector<std::string> reversed;
+    for (auto it = sm.keys_rbegin(); it != sm.keys_rend(); ++it)
+        reversed.push_back(*it);
+    REQUIRE(reversed == std::vector<std::string>{"m", "b", "a"});
+
+    REQUIRE_THROWS_WITH(sm.read_blob("a"), Catch::Matchers::ContainsSubstring("WITHOUT ROWID"));
+    REQUIRE_THROWS_AS(sm.write_blob("c", 16), sqlitemap_error);
+    REQUIRE_THROWS_AS(sm.update_blob("a"), sqlitemap_error);
+    REQUIRE_FALSE(sm.contains("c"));
+}
+
+TEST_CASE("Existing tables keep their layout")
+{
+    TempDir temp_dir;
+    auto file = (temp_dir.path() / "db.sqlite").string();
+    {
+        sqlitemap sm(config<std::string, blob>().filename(file).auto_commit(true));
+        sm.set("b", blob{std::byte(1)});
+        sm.set("a", blob{std::byte(2)});
+    }
+
+    std::vector<std::string> warnings;
+    auto log_impl = [&](log_level level, const std::string& msg)
+    {
+        if (level == log_level::warn)
+            warnings.push_back(msg);
+    };
+
+    sqlitemap sm(config<std::string, blob>()
+                     .filename(file)
+                     .table_layout(table_layout::without_rowid)
+                     .log_level(log_level::warn)
+                     .log_impl(log_impl));
+    REQUIRE(warnings.size() == 1);
+    REQUIRE_THAT(warnings[0], Catch::Matchers::ContainsSubstring("keeps its rowid layout"));
+
+    // still a rowid table, so blob handles work and reverse iteration follows the rowid
+    REQUIRE(sm.read_blob("a").size() == 1);
+    REQUIRE(*sm.keys_rbegin() == "a");
+}
@@ -0,0 +1,164 @@
+// sqlitemap
+// SPDX-FileCopyrightText: 2024-present Benno Waldhauer
+// SPDX-License-Identifier: MIT
+
+#include <bw/sqlitemap/sqlitemap.hpp>
+#include <catch2/catch_all.hpp>
+#include <future>
+#include <thread>
+
+#include <bw/tempdir/tempdir.hpp>
+
+using namespace bw::sqlitemap;
+using namespace bw::tempdir;
+
+#ifdef __cpp_lib_coroutine
+
+namespace {
+
+// Eagerly started coroutine, its completion is observed through a std::future
+struct task
+{
+    struct promise_type
+    {
+        std::promise<void> done;
+
+        task get_return_object()
+        {
+            return {done.get_future()};
+        }
+
+        std::suspend_never initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        std::suspend_never final_suspend() noexcept
+        {
+            return {};
+        }
+
+        void return_void()
+        {
+            done.set_value();
+        }
+
+        void unhandled_exception()
+        {
+            done.set_exception(std::current_exception());
+        }
+    };
+
+    std::future<void> completion;
+};
+
+} // namespace
+
+TEST_CASE("Awaitable operations of async sqlitemap")
+{
+    async_sqlitemap sm(config<int, std::string>().auto_commit(true));
+
+    std::optional<std::string> found;
+    std::optional<std::string> missing;
+    size_t num_erased = 0;
+    auto caller = std::this_thread::get_id();
+    std::thread::id resumed_on;
+
+    auto run = [&]() -> task
+    {
+        co_await sm.set(1, "one");
+        co_await sm.set(2, "two");
+        resumed_on = std::this_thread::get_id();
+        found = co_await sm.get(1);
+        missing = co_await sm.get(3);
+        num_erased = co_await sm.erase(2);
+        co_await sm.commit();
+    };
+    run().completion.get();
+
+    REQUIRE(found == "one");
+    REQUIRE_FALSE(missing.has_value());
+    REQUIRE(num_erased == 1);
+    REQUIRE(resumed_on != caller);
+    REQUIRE(sm.async_scan().get().size() == 1);
+}
+
+TEST_CASE("Awaitable operations rethrow errors")
+{
+    TempDir temp_dir;
+    auto file = (temp_dir.path() / "db.sqlite").string();
+    sqlitemap(config<int, std::string>().filename(file).auto_commit(true)).set(1, "one");
+
+    async_sqlitemap sm(config<int, std::string>().filename(file).mode(operation_mode::r));
+
+    std::optional<std::string> value;
+    bool set_failed = false;
+    auto run = [&]() -> task
+    {
+        try
+        {
+            co_await sm.set(2, "two");
+        }
+        catch (const sqlitemap_error&)
+        {
+            set_failed = true;
+        }
+        value = co_await sm.get(1);
+        co_await sm.erase(1);
+    };
+
+    REQUIRE_THROWS_AS(run().completion.get(), sqlitemap_error);
+    REQUIRE(set_failed);
+    REQUIRE(value == "one");
+}
+
+TEST_CASE("Scan stream of async sqlitemap yields entries in key order")
+{
+    async_sqlitemap sm(config<int, int>().metrics(true));
+    for (int i = 9; i >= 0; i--)
+        sm.async_set(i, i * i);
+
+    std::vector<std::pair<int, int>> all;
+    std::vector<std::pair<int, int>> ranged;
+    std::vector<std::pair<int, int>> empty;
+
+    auto run = [&]() -> task
+    {
+        // chunks of 3 entries, the last one is incomplete
+        auto stream = sm.scan(3);
+        while (auto entry = co_await stream.next())
+            all.push_back(*entry);
+
+        // entries are read behind the last chunk, even when written while scanning
+        auto range = sm.scan(2, 8, 2);
+        while (auto entry = co_await range.next())
+        {
+            ranged.push_back(*entry);
+            if (entry->first == 3)
+                co_await sm.set(4, -1);
+        }
+
+        auto none = sm.scan(20, 30);
+        while (auto entry = co_await none.next())
+            empty.push_back(*entry);
+    };
+    run().completion.get();
+
+    REQUIRE(all.size() == 10);
+    for (int i = 0; i < 10; i++)
+        REQUIRE(all[i] == std::pair(i, i * i));
+
+    REQUIRE(ranged.size() == 6);
+    REQUIRE(ranged.front() == std::pair(2, 4));
+    REQUIRE(ranged[2] == std::pair(4, -1));
+    REQUIRE(ranged.back() == std::pair(7, 49));
+    REQUIRE(empty.empty());
+
+    // chunks are read by iterators recording into the metrics of the map
+    auto num_prepared = sm.submit_read(
+        [](const auto& map)
+        { return map.metrics()[metric_operation::iterate].latency(metric_phase::prepare).count; });
+    REQUIRE(num_prepared.get() == 4 + 4 + 1); // complete chunks are followed by another fetch
+}
+
+#endif
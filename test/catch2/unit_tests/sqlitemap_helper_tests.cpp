@@ -125,3 +125,211 @@ TEST_CASE("sqlitemap can be configured to use custom logger")
     sm.log().trace("db idle...");
     REQUIRE(log_content.empty());
 }
+
+TEST_CASE("statement_cache hands out statements exclusively and reuses released ones")
+{
+    sqlite3* db = nullptr;
+    details::check_ok(sqlite3_open(":memory:", &db), db);
+
+    int num_prepared = 0;
+    auto make_sql = [&]
+    {
+        num_prepared++;
+        return std::string("SELECT ?");
+    };
+
+    {
+        details::statement_cache cache(2);
+        REQUIRE(cache.capacity() == 2);
+
+        {
+            auto h1 = cache.acquire(db, "SELECT ?", make_sql);
+            auto h2 = cache.acquire(db, "SELECT ?", make_sql);
+            auto h3 = cache.acquire(db, "SELECT ?", make_sql);
+            REQUIRE(num_prepared == 3);
+            REQUIRE(h1.get() != h2.get());
+            REQUIRE(h2.get() != h3.get());
+
+            details::bind_param_checked(h1.get(), 1, 42);
+            REQUIRE(sqlite3_step(h1.get()) == SQLITE_ROW);
+        }
+
+        // capacity limits number of kept statements, the third one got finalized
+        REQUIRE(cache.num_idle() == 2);
+
+        {
+            auto h = cache.acquire(db, "SELECT ?", make_sql);
+            REQUIRE(num_prepared == 3);
+
+            // released statements are reset and bindings are cleared
+            REQUIRE(sqlite3_stmt_busy(h.get()) == 0);
+            REQUIRE(sqlite3_step(h.get()) == SQLITE_ROW);
+            REQUIRE(sqlite3_column_type(h.get(), 0) == SQLITE_NULL);
+        }
+
+        cache.clear();
+        REQUIRE(cache.num_idle() == 0);
+        REQUIRE(sqlite3_next_stmt(db, nullptr) == nullptr);
+
+        {
+            // statements acquired before clear() are finalized on release
+            auto h = cache.acquire(db, "SELECT ?", make_sql);
+            cache.clear();
+        }
+        REQUIRE(cache.num_idle() == 0);
+        REQUIRE(sqlite3_next_stmt(db, nullptr) == nullptr);
+    }
+
+    REQUIRE(sqlite3_close(db) == SQLITE_OK);
+}
+
+TEST_CASE("bind_param binds text and blob views with explicit lengths")
+{
+    sqlite3* db = nullptr;
+    details::check_ok(sqlite3_open(":memory:", &db), db);
+
+    sqlite3_stmt* stmt = nullptr;
+    details::prepare_checked(db, "SELECT ?1, length(CAST(?1 AS BLOB))", &stmt);
+
+    auto bound_size = [&]
+    {
+        REQUIRE(sqlite3_step(stmt) == SQLITE_ROW);
+        auto size = sqlite3_column_int(stmt, 1);
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+        return size;
+    };
+
+    // no strlen scan, neither embedded nul characters nor missing terminators matter
+    std::string with_nul("ab\0cd", 5);
+    details::bind_param_checked(stmt, 1, with_nul);
+    REQUIRE(bound_size() == 5);
+
+    std::string_view prefix = std::string_view("hello world").substr(0, 5);
+    details::bind_param_checked(stmt, 1, prefix);
+    REQUIRE(sqlite3_step(stmt) == SQLITE_ROW);
+    REQUIRE(details::column_value<std::string>(stmt, 0) == "hello");
+    REQUIRE(details::column_view<std::string>(stmt, 0) == "hello");
+    sqlite3_reset(stmt);
+
+    blob data{std::byte{1}, std::byte{0}, std::byte{2}};
+    details::bind_param_checked(stmt, 1, blob_view(data.data(), 2));
+    REQUIRE(bound_size() == 2);
+
+#ifdef __cpp_lib_span
+    details::bind_param_checked(stmt, 1, std::span<const std::byte>(data));
+    REQUIRE(bound_size() == 3);
+#endif
+
+    // empty views without data are bound as empty values, not as NULL
+    auto bound_type = [&]
+    {
+        REQUIRE(sqlite3_step(stmt) == SQLITE_ROW);
+        auto type = sqlite3_column_type(stmt, 0);
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+        return type;
+    };
+
+    details::bind_param_checked(stmt, 1, std::string_view());
+    REQUIRE(bound_type() == SQLITE_TEXT);
+    details::bind_param_checked(stmt, 1, std::string_view(), "", db, SQLITE_STATIC);
+    REQUIRE(bound_type() == SQLITE_TEXT);
+    details::bind_param_checked(stmt, 1, blob_view());
+    REQUIRE(bound_type() == SQLITE_BLOB);
+    details::bind_param_checked(stmt, 1, blob());
+    REQUIRE(bound_type() == SQLITE_BLOB);
+
+    {
+        // transient bindings are copied, so the value may go away before the step
+        std::string temporary = "copied";
+        details::bind_param_checked(stmt, 1, temporary);
+        temporary.assign("changed");
+    }
+    REQUIRE(sqlite3_step(stmt) == SQLITE_ROW);
+    REQUIRE(details::column_value<std::string>(stmt, 0) == "copied");
+    sqlite3_reset(stmt);
+
+    {
+        // static bindings refer to the value itself
+        std::string borrowed = "borrowed";
+        details::bind_param_checked(stmt, 1, borrowed, "", db, SQLITE_STATIC);
+        borrowed[0] = 'B';
+        REQUIRE(sqlite3_step(stmt) == SQLITE_ROW);
+        REQUIRE(details::column_value<std::string>(stmt, 0) == "Borrowed");
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+    }
+
+    sqlite3_finalize(stmt);
+    REQUIRE(sqlite3_close(db) == SQLITE_OK);
+}
+
+TEST_CASE("statement_cache clears static bindings on release")
+{
+    sqlite3* db = nullptr;
+    details::check_ok(sqlite3_open(":memory:", &db), db);
+    details::statement_cache cache(1);
+    auto make_sql = [] { return std::string("SELECT ?"); };
+
+    {
+        auto value = std::make_unique<std::string>("short lived");
+        auto h = cache.acquire(db, "SELECT ?", make_sql);
+        details::bind_param_checked(h.get(), 1, *value, "", db, SQLITE_STATIC);
+        REQUIRE(sqlite3_step(h.get()) == SQLITE_ROW);
+    } // handle is released before the bound value is destroyed
+
+    auto h = cache.acquire(db, "SELECT ?", make_sql);
+    auto expanded_sql = sqlite3_expanded_sql(h.get());
+    REQUIRE(std::string(expanded_sql) == "SELECT NULL");
+    sqlite3_free(expanded_sql);
+
+    REQUIRE(sqlite3_step(h.get()) == SQLITE_ROW);
+    REQUIRE(sqlite3_column_type(h.get(), 0) == SQLITE_NULL);
+}
+
+TEST_CASE("statement_cache accumulates statement status per shape")
+{
+    sqlite3* db = nullptr;
+    details::check_ok(sqlite3_open(":memory:", &db), db);
+    details::exec_checked(db, "CREATE TABLE t (x INTEGER); INSERT INTO t VALUES (3), (1), (2)");
+
+    {
+        details::statement_cache cache(1);
+        auto shape = "SELECT x FROM t ORDER BY x";
+        auto make_sql = [&] { return std::string(shape); };
+
+        for (int run = 0; run < 2; run++)
+        {
+            // the second statement does not fit into the cache, but its counters are kept
+            auto h1 = cache.acquire(db, shape, make_sql);
+            auto h2 = cache.acquire(db, shape, make_sql);
+            while (sqlite3_step(h1.get()) == SQLITE_ROW)
+                ;
+            while (sqlite3_step(h2.get()) == SQLITE_ROW)
+                ;
+        }
+
+        auto stats = cache.stats();
+        REQUIRE(stats.size() == 1);
+        REQUIRE(stats[0].shape == shape);
+        REQUIRE(stats[0].runs == 4);
+        REQUIRE(stats[0].sorts == 4);
+        REQUIRE(stats[0].fullscan_steps > 0);
+        REQUIRE(stats[0].vm_steps > stats[0].fullscan_steps);
+        REQUIRE(stats[0].reprepares == 0);
+
+        // counters of cached statements are reset once they are accumulated
+        auto h = cache.acquire(db, shape, make_sql);
+        REQUIRE(sqlite3_stmt_status(h.get(), SQLITE_STMTSTATUS_VM_STEP, 0) == 0);
+    }
+
+    REQUIRE(sqlite3_close(db) == SQLITE_OK);
+}
+
+TEST_CASE("Text can be quoted as sql literal")
+{
+    REQUIRE(details::quote_literal("") == "''");
+    REQUIRE(details::quote_literal("table") == "'table'");
+    REQUIRE(details::quote_literal("it's") == "'it''s'");
+}